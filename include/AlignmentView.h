@@ -0,0 +1,69 @@
+#ifndef ALIGNMENT_VIEW_H
+#define ALIGNMENT_VIEW_H
+
+#pragma once
+
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include "Utils.h"
+#include "SamStream.h"
+
+#include "BamAlignment.h"
+
+using namespace boost;
+using namespace BamTools;
+
+namespace MOJO
+{
+	// Compact view of one bwa alignment of a read: the primary record or one
+	// of the alternatives in its XA tag.  bwa gives each alternative its own
+	// signed position (the sign being its strand) and CIGAR.  As MOJO always
+	// has, only the reference, unsigned position and edit distance are taken
+	// from the tag; an alternative keeps the strand and matched length of
+	// the primary.
+	struct AlignmentView
+	{
+		int refId;
+		int position;			//0-based
+		int matchedLength;		//sum of M operations in the CIGAR
+		int nm;
+		bool reverseStrand;
+	};
+
+	// Expands a record into its primary and XA alignments without copying the
+	// record or allocating per read: the XA tag is parsed in place from the
+	// raw tag data (or SAM line) and reference names are looked up through a
+	// reused key.
+	class XAExpander
+	{
+		private:
+			bool byNumber;
+			unordered_map<string, int> refNameToId;
+			string key;
+
+			static bool FindStringTag(const BamAlignment &al, const char *tag,
+				const char **value, size_t *length);
+
+			int GetRefId(const char *name, size_t length);
+
+			void ExpandXA(const char *xa, size_t length,
+				vector<AlignmentView> *aligns);
+
+		public:
+			// Reference ids are indexes into refs
+			XAExpander(const RefVector &refs);
+
+			// Reference ids are the numbers in reference names, as in g<geneId>
+			XAExpander();
+
+			// Clears aligns (keeping its capacity) and fills it with the primary
+			// alignment followed by the XA alternatives with no more mismatches
+			void Expand(const BamAlignment &al, vector<AlignmentView> *aligns);
+
+			void Expand(const SamRecord &rec, vector<AlignmentView> *aligns);
+	};
+};
+
+#endif
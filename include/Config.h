@@ -36,6 +36,47 @@ namespace MOJO
 			static Module LoadStatusFile(string statusFile);
 	};
 
+	// Checkpoint of one split (task) of a module: a hash of the parameters it
+	// ran with, the size and checksum of its inputs and outputs, and a count
+	// of the records it produced.  On resume, a task is only re-run if its
+	// manifest is missing or no longer matches.
+	class TaskManifest
+	{
+		private:
+			struct FileRecord
+			{
+				string path;
+				long long size;
+				unsigned long checksum;
+			};
+
+			string filename;
+			unsigned long paramsHash;
+			vector<FileRecord> inputs, outputs;
+
+			static FileRecord Fingerprint(string file, long long sampleBytes);
+
+		public:
+			long long Count;
+
+			TaskManifest(string file, string parameters);
+
+			// Inputs may be large; only their first and last MB are checksummed
+			void AddInput(string file);
+
+			void AddOutput(string file);
+
+			// True if the saved manifest has the same parameters and inputs and
+			// every output still matches; loads its Count
+			bool IsValid();
+
+			// Removes the saved manifest before the task is (re-)run
+			void Invalidate();
+
+			// Saves the manifest once all outputs are written
+			void Save();
+	};
+
 	class Config 
 	{
 		public:
@@ -74,6 +115,11 @@ namespace MOJO
 			//filtering files
 			string megablastOutputFile, repeatMaskerFile;
 
+			//binary bundle of the reference and filtering files; written from
+			//them on the first load if missing or out of date
+			string referenceBundleFile;
+			bool verifyReferenceBundle;
+
 			//Compute parameters
 			int maxCores, maxMem, maxBwaMem;
 
@@ -96,7 +142,7 @@ namespace MOJO
 			string fastqEncodingString;
 
 			string JunctionFilter_dir;
-			vector<string> ExtractUnaligned_fq1, ExtractUnaligned_fq2;
+			vector<string> ExtractUnaligned_reads;
 
 			string statusFilesDir;
 			string statusFile_ExtractUnaligned;
@@ -107,7 +153,7 @@ namespace MOJO
 
 			string readcountFile;
 
-			int readcount;
+			long long readcount;
 
 			Config();
 			
@@ -121,10 +167,16 @@ namespace MOJO
 			
 			static Config *GetConfig();
 			
-			static string GenerateCatCmdsForSplit(int end, int split_id,
-				int num_splits, bool silent=false);
+			//Splits flagged in skipSplits (already complete) are sent to
+			///dev/null rather than to a fifo
+			static string GenerateFanOutCmdsForSplits(int end, int num_splits,
+				bool silent=false, const vector<bool> *skipSplits=NULL);
+
+			//False (logged) if the splitter of <end> failed; safe to call from
+			// every reader of its splits
+			static bool WaitForFanOut(int end);
 
-			int GetTotalReadcount();
+			long long GetTotalReadcount();
 
 			void FinalCleanup();
 	};
@@ -7,6 +7,7 @@
 #include "Config.h"
 #include "GeneModel.h"
 #include "FusionJunction.h"
+#include "DiscordantPairs.h"
 
 namespace MOJO 
 {
@@ -15,7 +16,7 @@ namespace MOJO
 	class DiscordantClusterFinder 
 	{
 		private:
-			static string GetFlatFilename();
+			static string GetPairsFilename();
 
 		public:
 			static int NextClusterID;
@@ -33,13 +34,13 @@ namespace MOJO
 
 			DiscordantClusterAlignment() {};
 			
-			DiscordantClusterAlignment( string stA, string lenA, string strndA,
-				string stB, string lenB, string strndB, string uniq)
+			DiscordantClusterAlignment(const DiscordantPair &pair)
 			{
-				startA = stoi(stA), endA = startA + stoi(lenA);
-				startB = stoi(stB), endB = startB + stoi(lenB);
-				strandA = strndA, strandB = strndB;
-				isUnique = (bool)stoi(uniq);
+				startA = pair.positionA, endA = startA + pair.lengthA;
+				startB = pair.positionB, endB = startB + pair.lengthB;
+				strandA = pair.strandA ? "-" : "+";
+				strandB = pair.strandB ? "-" : "+";
+				isUnique = pair.isUnique;
 			}
 	};
 
@@ -0,0 +1,93 @@
+#ifndef DISCORDANTPAIRS_H
+#define DISCORDANTPAIRS_H
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "Utils.h"
+#include "Read.h"
+
+using namespace std;
+
+#define DISCORDANT_PAIRS_MAGIC "MOJODSC1"
+
+namespace MOJO
+{
+	// One discordant read pair (or one XA combination of it), end A being the
+	// end on the gene with the lower id.  Positions are 0-based; strand is 1
+	// for reverse; mate is 1 or 2; copy numbers the XA combinations of a
+	// read after the first (readname_<copy>).
+	struct DiscordantPair
+	{
+		ReadId readId;
+		int32_t geneA, positionA, lengthA;
+		int32_t geneB, positionB, lengthB;
+		uint16_t copy;
+		uint8_t strandA, strandB;
+		uint8_t mateA, mateB;
+		uint8_t isUnique;
+		uint8_t reserved;
+	};
+
+	static_assert(sizeof(DiscordantPair) == 40,
+		"DiscordantPair must stay a fixed-width 40 byte record");
+
+	// discordant.pairs: the 8 byte magic followed by DiscordantPair records in
+	// host byte order.  Records are appended to the file in batches.
+	class DiscordantPairWriter
+	{
+		private:
+			static boost::mutex appendMutex;
+			string fileName;
+			vector<DiscordantPair> buffer;
+			long long numPairs;
+
+		public:
+			// Truncates file and writes the magic; call before any writer
+			static void Create(string file);
+
+			DiscordantPairWriter(string file);
+
+			~DiscordantPairWriter();
+
+			void Write(const DiscordantPair &pair);
+
+			// Appends buffered records to the file
+			void Flush();
+
+			long long GetNumPairs() { return numPairs; }
+	};
+
+	// Read-only memory map of a discordant.pairs file
+	class DiscordantPairReader
+	{
+		private:
+			string fileName;
+			void *map;
+			size_t mapLength;
+			const DiscordantPair *pairs;
+			size_t numPairs;
+
+		public:
+			DiscordantPairReader(string file);
+
+			~DiscordantPairReader();
+
+			const DiscordantPair *begin() const { return pairs; }
+
+			const DiscordantPair *end() const { return pairs + numPairs; }
+
+			size_t size() const { return numPairs; }
+
+			// The record as a line of the former discordant.flat text format
+			static string ToText(const DiscordantPair &pair);
+	};
+};
+
+#endif
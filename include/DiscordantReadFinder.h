@@ -13,12 +13,9 @@
 #include "Config.h"
 #include "FastqParser.h"
 #include "GeneModel.h"
-
-#include "BamReader.h"
-#include "BamWriter.h"
-#include "BamAlignment.h"
-
-using namespace BamTools;
+#include "AlignmentView.h"
+#include "DiscordantPairs.h"
+#include "SamStream.h"
 
 namespace MOJO 
 {
@@ -32,9 +29,6 @@ namespace MOJO
 	{
 		public:
 			static bool Run();
-			
-			static vector<BamAlignment> GetBwaAlignsFromXA(BamAlignment al,
-				unordered_map<string, int> *geneToNameMap);
 
 		private:
 			static boost::mutex statsUpdateMutex1, statsUpdateMutex2;
@@ -53,25 +47,49 @@ namespace MOJO
 			static void ExtractUnalignedReads(ComputePerTask cpt);
 			
 			static void ExtractUnalignedReads_worker(int thread, ComputePerTask cpt, 
-				string chan);
+				string chan, TaskManifest *manifest);
+
+			//Checkpoints of the splits, with their parameters and inputs
+			static TaskManifest GetExtractUnalignedManifest(int split, 
+				ComputePerTask cpt);
+
+			static TaskManifest GetDiscordantManifest(int chunk);
 			
 			static void FindDiscordantReads(ComputePerTask cpt);
+
+			//Read ids increase through every per-split file, which lets the
+			//workers merge-join them; exits if that does not hold
+			static void CheckReadIdOrder(ReadId previousId, ReadId readId, 
+				string source);
+
+			static FILE *OpenOrExit(string file, const char *mode);
 			
-			static void FindDiscordantReads_worker(string threadIdStr, int tCores, 
-				string chan);
+			//Splits the unaligned reads into chunks; returns their number
+			static int WriteUnalignedChunks(int numSplits);
+
+			static void FindDiscordantReads_chunk(int chunk, int tCores, 
+				string chan, TaskManifest *manifest);
 			
 			static void FindDiscordantReads_ByIteration(string fqPrefix, 
-				string threadIdStr, int tCores, string chan);
+				string threadIdStr, int tCores, string chan, 
+				DiscordantPairWriter *discPairs, FILE *discSam, FILE *statusOut);
 
 			static void UpdateUnalignedReadCount(int cnt);
 			
 			static void UpdateDiscordantReadCount(int cnt);
 
 			//Utility function
-			static string BuildFlatReadString(BamAlignment fAl, BamAlignment sAl, 
-				RefVector *refVect);
+			static DiscordantPair BuildDiscordantPair(const AlignmentView &fAl,
+				int fMate, const AlignmentView &sAl, int sMate, ReadId readId,
+				int copy, bool isUnique);
 			
-			static string GetFlatFilename();
+			static string GetPairsFilename();
+
+			static string GetChunkPairsFilename(int chunk);
+
+			static string GetChunkReadsFilename(int chunk);
+
+			static string GetUnalignedReadsFilename(int split);
 	};
 };
 #endif
@@ -8,11 +8,12 @@
 #include <sstream>
 
 #include <boost/unordered_map.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "Utils.h"
 #include "Read.h"
+#include "GzipReader.h"
+#include "PackedReads.h"
 
 using namespace std; 
 using namespace boost;
@@ -25,19 +26,77 @@ namespace MOJO
 		ILLUMINA 
 	};
 
+	// A fastq record as views into the buffer of the FastqRecordBatch that
+	// holds it; name excludes the leading '@'
+	struct FastqRecord
+	{
+		boost::string_ref name;
+		boost::string_ref sequence;
+		boost::string_ref quality;
+	};
+
+	class FastqRecordBatch
+	{
+		public:
+			string buffer;
+			vector<FastqRecord> records;
+	};
+
+	// Reads a fastq(.gz) file in large blocks and parses them into batches of
+	// whole records without copying the record text.  Decompression already
+	// runs ahead on the GzipReader's threads, so parsing is done in the
+	// caller's thread.
+	class FastqBatchReader
+	{
+		private:
+			static const size_t BATCH_BYTES = 4 << 20;
+
+			GzipReader *source;
+			string carry;
+			bool sourceDone;
+			FastqRecordBatch current;
+
+			FastqBatchReader(const FastqBatchReader&);
+
+			FastqBatchReader& operator=(const FastqBatchReader&);
+
+			bool FillBatch(FastqRecordBatch *batch);
+
+		public:
+			FastqBatchReader(string file, int threads = 1);
+
+			~FastqBatchReader();
+
+			// Returns the next batch, or 0 at the end of the file.  The batch
+			// (and views into it) stay valid until the next call.
+			const FastqRecordBatch *GetNextBatch();
+	};
+
 	class FastqFile 
 	{
 		private:
-			bool fileOpened;
+			FastqBatchReader *reader;
+			const FastqRecordBatch *batch;
+			size_t recordIdx;
+			bool atEnd;
+
+			FastqFile(const FastqFile&);
+
+			FastqFile& operator=(const FastqFile&);
+
 		public:
 			string fileName;
-			boost::iostreams::filtering_istream *fileStream;
 			ifstream *fileStreamByPos;
 
-			FastqFile() : fileStream(0), fileStreamByPos(0){};
+			FastqFile() : reader(0), batch(0), recordIdx(0), atEnd(false),
+				fileStreamByPos(0) {};
+
+			FastqFile(string file) : reader(0), batch(0), recordIdx(0), 
+				atEnd(false), fileName(file), fileStreamByPos(0) {};
+
+			~FastqFile();
 
-			FastqFile(string file) : 
-				fileName(file), fileStream(0), fileStreamByPos(0) {};
+			bool GetNextRecord(FastqRecord *record);
 
 			bool GetNextRead(Read *read);
 
@@ -46,23 +105,71 @@ namespace MOJO
 			bool EndOfFile();
 	};
 
+	// Buffered fastq writer.  Records (optionally trimmed) are copied straight
+	// into a large output buffer; there is no per-record allocation or 
+	// formatting, and no limit on read length.
+	class FastqWriter
+	{
+		private:
+			static const size_t BUFFER_SIZE = 1 << 20;
+
+			FILE *fp;
+			string fileName;
+			vector<char> buffer;
+			size_t used;
+
+			void Append(const char *s, size_t len);
+
+			void Flush();
+
+		public:
+			FastqWriter(string file, bool append = false);
+
+			~FastqWriter();
+
+			// Writes @name\nseq\n+name\nqual\n, dropping ltrim bases from the 
+			// 5' end and rtrim bases from the 3' end.  Reads without a name
+			// are skipped.
+			void Write(const Read &read, int rtrim = 0, int ltrim = 0,
+				bool convertToSanger = false);
+
+			// Writes at most maxLength bases starting at startAt; the window is
+			// shifted left if it runs past the 3' end of the read
+			void WriteSubstring(const Read &read, int maxLength, int startAt);
+
+			void Close();
+	};
+
 	class FastqParser 
 	{
 		private:
 			FastqFile *end1File, *end2File;
+			PackedReadReader *packedReads;
+			PairedRead packedPair;
+			bool packedAtEnd;
 			string firstEndFile, secondEndFile, indexFile;
 			int numReads;
 			unordered_map<int, std::pair<long long, long long> > index;
+
+			FastqParser(const FastqParser&);
+
+			FastqParser& operator=(const FastqParser&);
 		
 		public:
+			// If only <firstFile> is given and it is a PackedReadWriter file, 
+			// pairs are read from it instead of from two fastqs
 			FastqParser(string firstFile, string secondFile="" );
 
 			FastqParser(string firstFile, string secondFile, string indexFile);
 
+			~FastqParser();
+
 			PairedRead GetNextPairedRead();
 
 			bool GetNextPairedRead(PairedRead *pr);
 
+			bool GetNextPairedRecord(FastqRecord *first, FastqRecord *second);
+
 			bool EndOfFile();
 
 			void CreateTrimmedFiles(string firstEndOutFile, string secondEndOutFile, 
@@ -45,6 +45,7 @@ namespace MOJO
 				(*this).ReadName = rd.ReadName;
 				(*this).Sequence = rd.Sequence;
 				(*this).Quality = rd.Quality;
+				(*this).Id = rd.Id;
 				return *this;
 			}
 
@@ -72,6 +73,7 @@ namespace MOJO
 				(*this).ReadName = rd.ReadName;
 				(*this).Sequence = rd.Sequence;
 				(*this).Quality = rd.Quality;
+				(*this).Id = rd.Id;
 				return *this;
 			}
 	};
@@ -155,7 +157,7 @@ namespace MOJO
 
 			void SetAsSpurious();
 
-			void MarkARspurious(string trimmedReadName);
+			void MarkARspurious(ReadId readId);
 
 			void MarkPCRduplicates();
 
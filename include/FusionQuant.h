@@ -51,8 +51,10 @@ namespace MOJO
 	{
 		int position;
 		int alignedLength;
-		int readId;
+		ReadId readId;
 		int end;
+
+		static BamAlignmentEnd FromRecord(const BamAlignment &aln);
 	};
 
 	class PairedBamAlignment
@@ -62,9 +64,9 @@ namespace MOJO
 			Exon *fExon, *sExon;
 			Isoform *fIso, *sIso;
 			
-			PairedBamAlignment(BamAlignment a1, BamAlignment a2) ;
+			PairedBamAlignment(BamAlignmentEnd a1, BamAlignmentEnd a2);
 
-			int GetReadId() 
+			ReadId GetReadId() 
 			{
 				return fAln.readId;
 			}
@@ -92,9 +94,9 @@ namespace MOJO
 			JunctionStats CompileStatsForJunction(Junction *j);
 
 			static void FindFusionGeneMappingReads_worker(int threadId, 
-				ComputePerTask cpt, string mapFa);
+				int step, ComputePerTask cpt, string mapFa);
 
-			Exon* FindExonsMappedByRead(BamAlignment aln, string name);
+			Exon* FindExonsMappedByRead(const BamAlignmentEnd &aln, const string &name);
 	};
 }
 
@@ -8,10 +8,15 @@
 
 #include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/once.hpp>
 
 #include "Utils.h"
 #include "GeneModelObjs.h"
 #include "Config.h"
+#include "IntervalIndex.h"
+#include "IdTable.h"
+#include "HomologyIndex.h"
+#include "ReferenceBundle.h"
 
 using namespace std;
 using namespace boost;
@@ -21,14 +26,35 @@ namespace MOJO
 	class GeneModel 
 	{
 		private:
-			static map<string, map<int, Gene*> > chromGenesRefSeq;
+			//genomic extents of the genes on each chromosome, built on first use
+			static unordered_map<string, IntervalIndex> chromGeneIndex;
+			static boost::once_flag chromGeneIndexOnce;
+
+			static void BuildChromGeneIndex();
+
+			static const IntervalIndex *GetChromGeneIndex(const string &chr);
+
+			void LoadGeneModelFromText();
+
+			// Builds the model from the binary reference bundle, writing it
+			// first if it is missing or out of date; returns false, having
+			// loaded nothing, if it can be neither opened nor written
+			bool LoadGeneModelFromBundle();
+
+			//storage the exon sequences point into: the mapped bundle, or
+			//the sequences of the exon file one after another
+			ReferenceBundle bundle;
+			string exonSequences;
 
 		public:
 			static GeneModel gm;
-			unordered_map<int, Gene*> GenesMap;
-			unordered_map<int, Exon*> ExonsMap;
+			IdTable<Gene> GenesMap;
+			IdTable<Exon> ExonsMap;
 			//need to transition uc000abc.2 ids to custom ids 
 			unordered_map<string, Isoform*> IsoformsMap;	
+			//megablast hits between genes, from the bundle's homology section;
+			//parsed from the megablast file only if the bundle can't be written
+			HomologyIndex homology;
 			bool IsGeneModelLoaded;
 
 			GeneModel() : IsGeneModelLoaded(false) {};
@@ -42,6 +68,14 @@ namespace MOJO
 			static GeneModel *GetGeneModel();
 
 			static string GetGeneNameForCoordinates(string chr, int pos);
+
+			// Id of the gene whose genomic extent contains chr:pos, or -1.
+			// Where genes overlap, the one starting first is returned.
+			static int GetGeneIdForCoordinates(const string &chr, int pos);
+
+			// GetGeneIdForCoordinates for a batch of positions on one chromosome
+			static void GetGeneIdsForCoordinates(const string &chr, 
+				const vector<int> &positions, vector<int> *geneIds);
 	};
 }
 #endif
\ No newline at end of file
@@ -8,8 +8,12 @@
 
 #include <boost/unordered_map.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "Utils.h"
+#include "IntervalIndex.h"
+#include "IntervalSet.h"
 
 using namespace std;
 using namespace boost;
@@ -26,22 +30,45 @@ namespace MOJO
 		THREE_P 
 	};
 
-	struct CoordinatePair
-	{
-		public:
-			int startA, endA, startB, endB;
-
-			CoordinatePair() : startA(0), endA(0), startB(0), endB(0) {}
-
-			CoordinatePair(int sA, int eA, int sB, int eB) :
-				startA(sA), endA(eA), startB(sB), endB(eB) {}
-	};
-
 	class Gene
 	{
 		private:
 			string scrambledExonSequence;
 
+			//built by BuildExonIndex for genes with many exons: allExons by
+			//start and the running sums of their lengths in start and in end
+			//order; and every exon of every isoform, numbered in the order of
+			//the isoforms.  Smaller genes are scanned.
+			IntervalIndex exonIndex, isoformExonIndex;
+			vector<long long> lengthSumByStart, lengthSumByEnd;
+			vector<int> exonStarts, exonEnds;
+			vector<int> isoformOffsets, isoformExonStarts;
+			vector<Exon *> isoformExons;
+
+			//union of allExons as blocks of transcriptomic coordinates, with
+			//the offset of each in the exonic sequence; and the length of the
+			//union up to and from each exon
+			struct ExonicBlock
+			{
+				int start, end, offset;
+			};
+			vector<ExonicBlock> exonicBlocks;
+			vector<int> upstreamLengths, downstreamLengths;
+			int exonicLength;
+			//bases of the blocks, built on first use
+			string exonicSequence;
+			boost::once_flag exonUnionOnce = BOOST_ONCE_INIT;
+			boost::once_flag exonicSequenceOnce = BOOST_ONCE_INIT;
+
+			void IndexExonUnion();
+
+			void BuildExonicSequence();
+
+			//number of exonic bases before pos
+			int GetExonicOffset(int pos);
+
+			int GetAllExonsIndex(Exon *ex);
+
 		public:
 			string name, chr, strand;
 			int geneId;
@@ -51,8 +78,7 @@ namespace MOJO
 			vector<Isoform *> isoforms;
 			vector<Exon *> allExons;
 
-			boost::unordered_map<int, vector<CoordinatePair> > blastHits;
-			vector< std::pair<int, int> > repeatRegions;
+			IntervalSet repeatRegions;
 
 			// upstream/downstream genes
 			int nextGeneDist, prevGeneDist;
@@ -71,12 +97,16 @@ namespace MOJO
 					isoformsStrVect.pop_back();
 			}
 
+			//Indexes the exons; call once isoforms and allExons are linked
+			void BuildExonIndex();
+
 			//Get the size of exonic region between two coordinates within a gene
 			int GetExonicDistanceBetweenCoords(int coordA, int coordB);
 
 			vector<Exon*> FindExonsWithinPoints(int start, int end,
 				bool considerIntronic = true);
 
+			// Whether readStart..readEnd lies inside a repeat-masked region
 			bool DoesRegionContainRepeat(int readStart, int readEnd);
 
 			bool operator==(const Gene & g) const
@@ -96,6 +126,9 @@ namespace MOJO
 			string GetTranscribedSequence();
 
 			string GetPartialTranscript(Exon *targetExon, FRAG_TYPE frag);
+
+			//GetPartialTranscript(targetExon, frag).length()
+			int GetPartialTranscriptLength(Exon *targetExon, FRAG_TYPE frag);
 				
 			static bool compareGenes(Gene* a, Gene* b)
 			{ 
@@ -118,6 +151,7 @@ namespace MOJO
 			int cdsStartDistFromTxStart, cdsEndDistFromTxEnd;
 			vector<string> exonsStrVect;
 			vector<Exon*> exons;
+			int transcriptLength;		//set by Gene::BuildExonIndex
 
 			string GetChr() 
 			{ 
@@ -129,9 +163,9 @@ namespace MOJO
 				return ((gene != 0) ? gene->strand : ""); 
 			}
 
-			Isoform(){}
+			Isoform() : transcriptLength(-1) {}
 			
-			Isoform(Gene *g, string id, string exonCsv)
+			Isoform(Gene *g, string id, string exonCsv) : transcriptLength(-1)
 			{
 				gene = g;
 				isoformIdStr = id;
@@ -154,11 +188,12 @@ namespace MOJO
 			vector<Isoform *> exonIsoforms;
 			int exonId;
 			int exStart, exEnd, exStart_genomic, exEnd_genomic;
-			string sequence;
+			boost::string_ref sequence;	//held by the gene model
+			int allExonsIndex;			//position in gene->allExons
 			
-			Exon() {}
+			Exon() : allExonsIndex(-1) {}
 			
-			Exon(Gene *g, string id)
+			Exon(Gene *g, string id) : allExonsIndex(-1)
 			{
 				gene = g;
 				exonId = stoi(id.substr(1, id.length() - 1));
@@ -0,0 +1,100 @@
+#ifndef GZIPREADER_H
+#define GZIPREADER_H
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <deque>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <zlib.h>
+
+using namespace std;
+
+namespace MOJO
+{
+	enum GZIP_FORMAT {
+		PLAIN_TEXT,
+		GZIP_STREAM,
+		BGZF_BLOCKS
+	};
+
+	// Sequential reader for plain, gzipped and BGZF (bgzip) files.  A background
+	// thread decompresses ahead of the consumer.  BGZF blocks are independent,
+	// so they are inflated in batches across <numThreads> threads, started once
+	// per reader; a plain gzip stream can only be inflated serially and is 
+	// streamed by the single background thread.  If the file cannot be opened
+	// or is corrupt, reading ends early and HasFailed() is set.
+	class GzipReader
+	{
+		private:
+			static const size_t CHUNK_SIZE = 1 << 20;
+			static const size_t MAX_QUEUED_CHUNKS = 4;
+			static const int BLOCKS_PER_THREAD = 16;
+
+			string fileName;
+			FILE *fp;
+			GZIP_FORMAT format;
+			int numThreads;
+
+			deque<string *> chunks;
+			string *current;
+			size_t currentPos;
+			bool producerDone, stopRequested, failed;
+			string error;
+			boost::mutex queueMutex;
+			boost::condition_variable queueNotEmpty, queueNotFull;
+			boost::thread *producer;
+
+			//BGZF batch handed to the inflate workers
+			vector<string> blocks, inflated;
+			int batchNumber, batchThreads, workersBusy;
+			bool poolStop, inflateFailed;
+			boost::mutex poolMutex;
+			boost::condition_variable batchReady, batchDone;
+
+			void Fail(string message);
+
+			void InflateWorker(int worker);
+
+			void Produce();
+
+			void ProduceBgzf();
+
+			void ProduceGzip();
+
+			void ProducePlain();
+
+			bool PushChunk(string *chunk);
+
+			bool ReadBgzfBlock(string *block);
+
+			static bool InflateBgzfBlocks(const vector<string> &blocks,
+				vector<string> *out, int first, int step);
+
+			bool NextChunk();
+
+		public:
+			GzipReader(string file, int threads = 1);
+
+			~GzipReader();
+
+			GZIP_FORMAT GetFormat() { return format; }
+
+			size_t Read(char *buf, size_t n);
+
+			bool ReadLine(char *buf, int maxLen);
+
+			// Whether reading stopped on an error rather than end of file
+			bool HasFailed();
+
+			string GetError();
+
+			static GZIP_FORMAT DetectFormat(string file);
+	};
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef HOMOLOGY_INDEX_H
+#define HOMOLOGY_INDEX_H
+
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+namespace MOJO
+{
+	// Megablast hits between pairs of genes in compressed sparse rows: the
+	// genes with the lower id of a pair are the rows, the other genes of
+	// their pairs the columns, and each pair owns a run of hit extents on
+	// either gene.  Each hit is stored once; the extents of a pair are
+	// sorted by start with the running maximum of their ends, so whether a
+	// hit spans a region is a binary search.
+	class HomologyIndex
+	{
+		private:
+			struct Hit
+			{
+				int geneLow, geneHigh;
+				int startLow, endLow, startHigh, endHigh;
+			};
+
+			struct Extent
+			{
+				int start, maxEnd;		//max end of the pair's extents so far
+			};
+
+			vector<Hit> hits;					//cleared by Build
+			vector<int> rowGenes;
+			vector<unsigned> rowFirst;			//into columns, one past rows
+			vector<int> columnGenes;
+			vector<unsigned> columnFirst;		//into extents, one past columns
+			vector<Extent> lowExtents, highExtents;
+
+			// Whether an extent in [first, last) starts before start and 
+			// ends after end
+			static bool Spans(const Extent *first, const Extent *last, 
+				int start, int end);
+
+			static void SortExtents(vector<Extent> &extents, size_t first, 
+				size_t last);
+
+		public:
+			// startA..endA on geneA aligns to startB..endB on geneB
+			void Add(int geneA, int startA, int endA, int geneB, int startB, 
+				int endB);
+
+			// Sorts the hits into the index; call once after the last Add
+			void Build();
+
+			// Whether a hit between geneA and geneB reaches past both ends of
+			// startA..endA on geneA, or past both ends of startB..endB on geneB
+			bool IsHomologous(int geneA, int startA, int endA, int geneB, 
+				int startB, int endB) const;
+
+			size_t size() const { return lowExtents.size(); }
+	};
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef ID_TABLE_H
+#define ID_TABLE_H
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+
+#include <boost/unordered_map.hpp>
+
+using namespace std;
+using namespace boost;
+
+#define ID_TABLE_SLACK 4096
+
+namespace MOJO
+{
+	// Map of integer ids to objects for ids that mostly number a dense range,
+	// as gene and exon ids do: those are pointers in a vector indexed by
+	// id - base, the few ids far outside the range go to a hash map.  Reads
+	// through find() and [] of present ids leave the table unchanged, so it
+	// may be read concurrently once loaded.  Null entries count as absent.
+	template <typename T>
+	class IdTable
+	{
+		public:
+			typedef pair<int, T*> value_type;
+
+			class iterator
+			{
+				friend class IdTable;
+
+				private:
+					IdTable *table;
+					size_t slot;		//slots.size() once in the hash map
+					typename unordered_map<int, T*>::iterator sparseIter;
+
+					iterator(IdTable *t, size_t s,
+						typename unordered_map<int, T*>::iterator si)
+						: table(t), slot(s), sparseIter(si) {}
+
+					void SkipEmpty()
+					{
+						while (slot < table->slots.size() && table->slots[slot] == 0)
+							slot++;
+						while (slot == table->slots.size() &&
+							sparseIter != table->sparse.end() && sparseIter->second == 0)
+							++sparseIter;
+					}
+
+				public:
+					typedef forward_iterator_tag iterator_category;
+					typedef IdTable::value_type value_type;
+					typedef ptrdiff_t difference_type;
+					typedef const value_type *pointer;
+					typedef value_type reference;
+
+					struct arrow
+					{
+						value_type value;
+						const value_type *operator->() const { return &value; }
+					};
+
+					value_type operator*() const
+					{
+						if (slot < table->slots.size())
+							return value_type(table->base + (int)slot, table->slots[slot]);
+						return value_type(sparseIter->first, sparseIter->second);
+					}
+
+					arrow operator->() const
+					{
+						arrow a = { **this };
+						return a;
+					}
+
+					iterator &operator++()
+					{
+						if (slot < table->slots.size())
+							slot++;
+						else
+							++sparseIter;
+						SkipEmpty();
+						return *this;
+					}
+
+					iterator operator++(int)
+					{
+						iterator it = *this;
+						++(*this);
+						return it;
+					}
+
+					bool operator==(const iterator &it) const
+					{
+						return slot == it.slot && sparseIter == it.sparseIter;
+					}
+
+					bool operator!=(const iterator &it) const
+					{
+						return !(*this == it);
+					}
+			};
+
+			IdTable() : base(0), numDense(0) {}
+
+			// Entry of id, inserting a null one if there is none
+			T *&operator[](int id)
+			{
+				if (!IsDense(id)) {
+					typename unordered_map<int, T*>::iterator it = sparse.find(id);
+					if (it != sparse.end())
+						return it->second;
+					if (!Grow(id))
+						return sparse[id];
+				}
+				T *&entry = slots[id - base];
+				if (entry == 0)
+					numDense++;
+				return entry;
+			}
+
+			iterator find(int id)
+			{
+				if (IsDense(id)) {
+					if (slots[id - base] != 0)
+						return iterator(this, id - base, sparse.begin());
+				}
+				else {
+					typename unordered_map<int, T*>::iterator it = sparse.find(id);
+					if (it != sparse.end() && it->second != 0)
+						return iterator(this, slots.size(), it);
+				}
+				return end();
+			}
+
+			iterator begin()
+			{
+				iterator it(this, 0, sparse.begin());
+				it.SkipEmpty();
+				return it;
+			}
+
+			iterator end()
+			{
+				return iterator(this, slots.size(), sparse.end());
+			}
+
+			// Number of non-null entries; walks the table
+			size_t size() const
+			{
+				size_t n = 0;
+				for (size_t i = 0; i < slots.size(); i++)
+					n += (slots[i] != 0);
+				for (auto it = sparse.begin(); it != sparse.end(); ++it)
+					n += (it->second != 0);
+				return n;
+			}
+
+		private:
+			int base;
+			vector<T*> slots;
+			size_t numDense;				//slots entered through []
+			unordered_map<int, T*> sparse;
+
+			bool IsDense(int id) const
+			{
+				return id >= base && (long long)id - base < (long long)slots.size();
+			}
+
+			// Extends the slots to cover id unless that leaves them less than
+			// about half full; entries of the hash map now covered move over
+			bool Grow(int id)
+			{
+				long long lo = id, hi = id;
+				if (!slots.empty()) {
+					lo = std::min(lo, (long long)base);
+					hi = std::max(hi, (long long)base + (long long)slots.size() - 1);
+				}
+				if (hi - lo + 1 > 2 * (long long)(numDense + 1) + ID_TABLE_SLACK)
+					return false;
+				if (slots.empty() || lo == base)
+					slots.resize((size_t)(hi - lo + 1), 0);
+				else {
+					vector<T*> grown((size_t)(hi - lo + 1), 0);
+					std::copy(slots.begin(), slots.end(), grown.begin() + (base - lo));
+					slots.swap(grown);
+				}
+				base = (int)lo;
+				for (auto it = sparse.begin(); it != sparse.end();) {
+					if (IsDense(it->first)) {
+						if (it->second != 0 && slots[it->first - base] == 0)
+							numDense++;
+						slots[it->first - base] = it->second;
+						it = sparse.erase(it);
+					}
+					else
+						++it;
+				}
+				return true;
+			}
+	};
+};
+
+#endif
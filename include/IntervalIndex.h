@@ -0,0 +1,47 @@
+#ifndef INTERVAL_INDEX_H
+#define INTERVAL_INDEX_H
+
+#pragma once
+
+#include <vector>
+
+using namespace std;
+
+namespace MOJO
+{
+	// Static index of the intervals on one sequence for point queries.
+	// Intervals are kept sorted by start along with the running maximum of
+	// their ends, so a query binary searches the last start below the point
+	// and walks back only while an earlier interval can still reach it.
+	class IntervalIndex
+	{
+		private:
+			struct Interval
+			{
+				int start, end, id;
+			};
+
+			vector<Interval> intervals;
+			vector<int> maxEnd;		//max end of intervals[0..i]
+
+		public:
+			// start and end may be given in either order
+			void Add(int start, int end, int id);
+
+			// Sorts the intervals; call once after the last Add
+			void Build();
+
+			// id of the interval strictly containing pos (start < pos < end)
+			// with the lowest start, or of the one added last among those
+			// sharing it; -1 if there is none
+			int Find(int pos) const;
+
+			// Appends to ids the ids of the intervals with start <= hi and
+			// end >= lo, in no particular order
+			void FindAll(int lo, int hi, vector<int> *ids) const;
+
+			size_t size() const { return intervals.size(); }
+	};
+};
+
+#endif
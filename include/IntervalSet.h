@@ -0,0 +1,36 @@
+#ifndef INTERVAL_SET_H
+#define INTERVAL_SET_H
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+namespace MOJO
+{
+	// Union of the intervals on one sequence for containment queries.
+	// Overlapping and abutting intervals are merged into disjoint regions
+	// sorted by start, so the only region that can contain an interval is
+	// the last one starting before it.
+	class IntervalSet
+	{
+		private:
+			vector< pair<int, int> > regions;
+
+		public:
+			// Intervals with end <= start are empty and ignored
+			void Add(int start, int end);
+
+			// Sorts and merges the intervals; call once after the last Add
+			void Build();
+
+			// Whether a region extends past both ends of start..end
+			bool Contains(int start, int end) const;
+
+			size_t size() const { return regions.size(); }
+	};
+};
+
+#endif
@@ -41,6 +41,8 @@ namespace MOJO
 
 			static string GetJunctionReadsFqFilename(int end);
 
+			static string GetUnalignedReadsFqFilename(int end);
+
 			static string GetJunctionAlignmentsFilename();
 
 			static string GetJunctionAlignmentsBamFilename();
@@ -0,0 +1,80 @@
+#ifndef PACKEDREADS_H
+#define PACKEDREADS_H
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+
+#include "Read.h"
+
+using namespace std;
+
+#define PACKED_READS_MAGIC "MOJORDS3"
+
+namespace MOJO
+{
+	// Binary container for paired-end reads with numeric read names (as
+	// produced by SplitFastqEvenly).  After the 8 byte magic, each pair is
+	//   int64 readId
+	// followed by, for each end,
+	//   uint16 length, uint16 numExceptions, uint16 qualityCount,
+	//   uint8 qualityEncoding
+	//   (length + 3) / 4 bytes of 2-bit bases (A=0, C=1, G=2, T=3)
+	//   numExceptions x (uint16 position, char base) for non-ACGT bases
+	//   qualityCount x char quality (RAW_QUALITIES), or
+	//   qualityCount x (char quality, uint8 runLength) (QUALITY_RUNS)
+	// Qualities are run-length encoded only where that is smaller, as for
+	// binned qualities.  Encoding is lossless; read names are restored as 
+	// <readId>/<end>.
+	enum QualityEncoding {
+		RAW_QUALITIES = 0,
+		QUALITY_RUNS
+	};
+
+	class PackedReadWriter
+	{
+		private:
+			FILE *fp;
+			string fileName, record, runs;
+			long long numPairs;
+
+			void EncodeEnd(const Read &read);
+
+		public:
+			PackedReadWriter(string file);
+
+			~PackedReadWriter();
+
+			void Write(PairedRead &pr);
+
+			void Close();
+
+			long long GetNumPairs() { return numPairs; }
+	};
+
+	class PackedReadReader
+	{
+		private:
+			FILE *fp;
+			string fileName, packed;
+
+			bool DecodeEnd(Read *read);
+
+		public:
+			PackedReadReader(string file);
+
+			~PackedReadReader();
+
+			bool GetNextPairedRead(PairedRead *pr);
+
+			// Writes all pairs as fastqs (FastqWriter format); appends if
+			// append is set.  Returns the number of pairs written.
+			long long ExportFastq(string fq1, string fq2, bool append = false);
+
+			static bool IsPackedReadFile(string file);
+	};
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PROCESSRUNNER_H
+#define PROCESSRUNNER_H
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+
+#include <boost/thread/mutex.hpp>
+
+#include "Utils.h"
+
+#define PROCESS_MAX_OUTPUT (1 << 20)
+#define PROCESS_KILL_GRACE_SECONDS 5
+
+namespace MOJO
+{
+	// Keeps the first and last maxBytes / 2 bytes of a stream
+	class BoundedBuffer
+	{
+		private:
+			size_t half;
+			long long dropped;
+			string head, tail;
+
+		public:
+			BoundedBuffer(size_t max_bytes) : half(max(max_bytes / 2, (size_t)1)),
+				dropped(0) {}
+
+			void Append(const char *data, size_t length);
+
+			string Str() const;
+	};
+
+	// Runs a command line with posix_spawn as "bash -c" in its own process
+	// group; the command goes straight into argv, so it needs no quoting and
+	// has no length limit beyond the system's.  stdout and stderr are read
+	// through separate non-blocking pipes into bounded buffers.  When the
+	// timeout expires or Cancel() is called the whole process group gets
+	// SIGTERM, then SIGKILL after a grace period.
+	class ProcessRunner
+	{
+		public:
+			typedef std::function<void(const char *, size_t)> OutputCallback;
+
+			ProcessRunner(string cmd, int timeoutSeconds = 0,
+				size_t maxOutputBytes = PROCESS_MAX_OUTPUT);
+
+			// stdout is handed to onStdout as it arrives instead of being
+			// buffered into SystemCall::output
+			void SetStdoutCallback(OutputCallback onStdout);
+
+			// Spawns the command and blocks until it has exited
+			SystemCall Run();
+
+			// Terminates the process group of a running command; may be called
+			// from any thread
+			void Cancel();
+
+		private:
+			string cmd;
+			int timeoutSeconds;
+			size_t maxOutputBytes;
+			OutputCallback onStdout;
+
+			boost::mutex pidMutex;
+			pid_t pid;
+			std::atomic<bool> cancelled;
+
+			void Signal(int sig);
+	};
+};
+
+#endif
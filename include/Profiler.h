@@ -0,0 +1,101 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <set>
+
+#include <boost/thread/mutex.hpp>
+
+#include "Utils.h"
+
+namespace MOJO
+{
+	class ProfileStage;
+
+	class ProfileEvent
+	{
+		public:
+			string name, category, detail;
+			int64_t startMicros;
+			int threadNumber;
+			ResourceUsage usage;
+	};
+
+	// Collects the timeline of external commands (recorded by ProcessRunner)
+	// and in-process stages (ProfileStage) over the whole run.  At the end of
+	// a run it is written as Chrome/Perfetto trace JSON and as a per-stage
+	// summary table.
+	class Profiler
+	{
+		public:
+			// Microseconds since the start of the run
+			static int64_t NowMicros();
+
+			static void Record(string name, string category, int64_t startMicros,
+				const ResourceUsage &usage, string detail = "");
+
+			// Tool name of a command line, e.g. "bowtie2" or "bwa sampe"; 
+			// subshells, variable assignments and leading fifo/file setup
+			// commands are skipped
+			static string GetCommandName(const string &cmd);
+
+			// RSS of MOJO and the commands it runs, from the memory poller;
+			// each open stage keeps the highest sample taken while it ran
+			static void SampleMemory(long rssKb);
+
+			// rchar/wchar from /proc/<pid>/io, /proc/self/io or
+			// /proc/thread-self/io; false if the file cannot be read
+			static bool ReadIoCounters(string ioFile, long long *readBytes,
+				long long *writeBytes);
+
+			// Load in chrome://tracing or ui.perfetto.dev
+			static void WriteTrace(string file);
+
+			// One row per stage or command name: count, wall, cpu, max RSS, I/O
+			static void WriteSummary(string file);
+
+		private:
+			friend class ProfileStage;
+
+			static boost::mutex eventsMutex;
+			static vector<ProfileEvent> events;
+			static set<ProfileStage *> openStages;	//guarded by eventsMutex
+
+			static int GetThreadNumber();
+	};
+
+	// Records the enclosing scope as a stage, including the external commands
+	// run meanwhile.  perThread limits CPU and I/O to the calling thread (and
+	// leaves out commands), for stages that run alongside others.  Max RSS is
+	// the peak of MOJO and its commands while the stage ran, whichever thread
+	// the memory belongs to: the samples of Profiler::SampleMemory plus the
+	// RSS of MOJO itself at the start and the end.
+	class ProfileStage
+	{
+		private:
+			friend class Profiler;
+
+			string name, category;
+			bool perThread;
+			int64_t startMicros;
+			double startUser, startSys;
+			long long startRead, startWrite;
+			long peakRssKb;							//guarded by eventsMutex
+
+			void Sample(double *user, double *sys, long long *readBytes, 
+				long long *writeBytes);
+
+			static long GetOwnRssKb();
+
+		public:
+			ProfileStage(string name, string category = "stage",
+				bool perThread = false);
+
+			~ProfileStage();
+	};
+};
+
+#endif
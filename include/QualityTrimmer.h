@@ -0,0 +1,30 @@
+#ifndef QUALITYTRIMMER_H
+#define QUALITYTRIMMER_H
+
+#pragma once
+
+#include <cstddef>
+
+namespace MOJO
+{
+	// 3' quality trimming (bwa -q algorithm) and Illumina-1.3 to Sanger quality
+	// conversion, shared by the fastq split tools.
+	class QualityTrimmer
+	{
+		public:
+			static const int MIN_TRIMMED_LENGTH = 36;
+
+			// Returns the length to trim the read to.  Qualities are decoded
+			// with offset 64 if toSanger (then converted in place) or 33
+			// otherwise.  Reads whose last base is at or above <threshold> are
+			// not trimmed; trimmed reads are never shorter than
+			// MIN_TRIMMED_LENGTH.
+			static int TrimRead(char *quality, size_t length, int threshold,
+				bool toSanger);
+
+			// Subtracts 31 from every quality character (phred+64 -> phred+33)
+			static void ConvertToSanger(char *quality, size_t length);
+	};
+};
+
+#endif
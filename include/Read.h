@@ -4,6 +4,7 @@
 #pragma once
 
 #include <cstring>
+#include <cstdint>
 #include <iostream>
 
 #include "Utils.h"
@@ -13,6 +14,14 @@ using namespace boost;
 
 namespace MOJO 
 {
+	// Reads are renamed to READ_ID_BASE + <read number> when the input is
+	// split (SplitFastqEvenly), so past ingest a read is identified by this
+	// number alone; it is parsed from the name once, where reads are loaded
+	typedef int64_t ReadId;
+
+	static const ReadId READ_ID_BASE = 100000000;
+	static const ReadId INVALID_READ_ID = -1;
+
 	class ReadAlignment 
 	{
 		public:
@@ -25,19 +34,24 @@ namespace MOJO
 	{
 		public:
 			string ReadName, Sequence, Quality;
+			ReadId Id;
 			vector<ReadAlignment> alignments;
 
-			Read() {};
+			Read() : Id(INVALID_READ_ID) {};
 
 			static string TrimReadName(string read, string findChr = "@");
+
+			// Numeric read id of a name such as "@100000042/1" or
+			// "100000042_3"; INVALID_READ_ID if the name is not numeric
+			static ReadId ParseReadId(const char *name, size_t length);
+
+			static ReadId ParseReadId(const string &name)
+			{
+				return ParseReadId(name.data(), name.size());
+			}
 			
 			string GetTrimmedReadName();
 			
-			void GetFastqString(char *buf, int rtrim = 0, int ltrim = 0,
-				bool convertToSanger = false);
-			
-			void GetFastqSubstring(char *buf, int maxLength, int startAt);
-			
 			void Initialize();
 			
 			Read& operator=(const Read& rd) 
@@ -45,6 +59,7 @@ namespace MOJO
 				(*this).ReadName = rd.ReadName;
 				(*this).Sequence = rd.Sequence;
 				(*this).Quality = rd.Quality;
+				(*this).Id = rd.Id;
 				return *this;
 			}
 
@@ -62,8 +77,25 @@ namespace MOJO
 				return FirstRead.GetTrimmedReadName();
 			}
 
+			ReadId GetReadId() const
+			{
+				return FirstRead.Id;
+			}
+
 			void Initialize();
 	};
+
+	// Dense set of read ids, one bit per id above READ_ID_BASE
+	class ReadIdSet
+	{
+		private:
+			vector<uint64_t> bits;
+
+		public:
+			void Insert(ReadId id);
+
+			bool Contains(ReadId id) const;
+	};
 };
 
 #endif
@@ -0,0 +1,214 @@
+#ifndef REFERENCE_BUNDLE_H
+#define REFERENCE_BUNDLE_H
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+using namespace std;
+
+#define REFERENCE_BUNDLE_MAGIC "MOJOREF1"
+#define REFERENCE_BUNDLE_VERSION 1
+
+namespace MOJO
+{
+	// Text files a bundle is built from, in the order of its fingerprints
+	enum BundleSource {
+		GENE_SOURCE = 0,
+		ISOFORM_SOURCE,
+		EXON_SOURCE,
+		MEGABLAST_SOURCE,
+		REPEAT_SOURCE,
+		NUM_BUNDLE_SOURCES
+	};
+
+	enum BundleSectionType {
+		GENES_SECTION = 0,
+		ISOFORMS_SECTION,
+		EXONS_SECTION,
+		GENE_ISOFORMS_SECTION,		//uint32_t isoform indexes
+		ISOFORM_EXONS_SECTION,		//uint32_t exon indexes
+		HOMOLOGY_SECTION,
+		REPEATS_SECTION,
+		STRINGS_SECTION,			//NUL terminated names and ids
+		SEQUENCE_SECTION,			//concatenated exon sequences
+		NUM_BUNDLE_SECTIONS
+	};
+
+	// Records hold the values of the text files as written there; genes are
+	// referenced by gene id, isoforms and exons by record index, strings and
+	// sequences by offset into their section.
+	struct BundleGene
+	{
+		int32_t geneId;
+		int32_t txStart_genomic, txEnd_genomic;
+		int32_t txStart_transcriptomic, txEnd_transcriptomic;
+		uint32_t firstIsoform, numIsoforms;	//range of GENE_ISOFORMS
+		uint32_t name, chr, strand;
+	};
+
+	struct BundleIsoform
+	{
+		int32_t geneId;
+		int32_t txStart, txEnd;
+		int32_t cdsStart, cdsEnd;				//columns 6 and 7 of Isoform.txt
+		uint32_t firstExon, numExons;			//range of ISOFORM_EXONS
+		uint32_t isoformId;
+	};
+
+	struct BundleExon
+	{
+		int32_t geneId, exonId;
+		int32_t exStart, exEnd, exStart_genomic, exEnd_genomic;
+		uint32_t sequenceLength, reserved;
+		uint64_t sequence;
+	};
+
+	struct BundleHomology
+	{
+		int32_t geneA, geneB;
+		int32_t startA, endA, startB, endB;
+	};
+
+	struct BundleRepeat
+	{
+		int32_t geneId;
+		int32_t start, end;						//relative to the gene start
+		int32_t reserved;
+	};
+
+	struct BundleFingerprint
+	{
+		int64_t size;							//-1 if the file did not exist
+		uint32_t checksum, reserved;
+	};
+
+	struct BundleSection
+	{
+		uint64_t offset, count;					//count is bytes for blobs
+	};
+
+	// Every section starts on an 8 byte boundary after the header; checksum
+	// is the crc32 of all bytes after the header.
+	struct ReferenceBundleHeader
+	{
+		char magic[8];
+		uint32_t version, checksum;
+		uint64_t fileSize;
+		BundleFingerprint sources[NUM_BUNDLE_SOURCES];
+		BundleSection sections[NUM_BUNDLE_SECTIONS];
+	};
+
+	static_assert(sizeof(BundleGene) == 40 && sizeof(BundleIsoform) == 32 &&
+		sizeof(BundleExon) == 40 && sizeof(BundleHomology) == 24 &&
+		sizeof(BundleRepeat) == 16 && sizeof(ReferenceBundleHeader) == 248,
+		"Reference bundle records must keep their fixed widths");
+
+	// Versioned binary image of the gene model, megablast hits and repeats,
+	// written next to the text files by the reference builder or by the
+	// first MOJO run to load them, and mapped read-only at load time.  A
+	// bundle is only used while the text files it was built from are
+	// unchanged.
+	class ReferenceBundle
+	{
+		private:
+			string fileName;
+			void *map;
+			size_t mapLength;
+			const ReferenceBundleHeader *header;
+
+			ReferenceBundle(const ReferenceBundle&);
+
+			ReferenceBundle& operator=(const ReferenceBundle&);
+
+			static BundleFingerprint GetFingerprint(string file);
+
+			// Whether every string, sequence, record index and gene id a
+			// record refers to is within the bundle
+			bool CheckReferences(string *error) const;
+
+			const void *GetSection(BundleSectionType type) const
+			{
+				return (const char *)map + header->sections[type].offset;
+			}
+
+		public:
+			ReferenceBundle();
+
+			~ReferenceBundle();
+
+			// The source files of a reference built into geneModelDir
+			static vector<string> GetSourceFiles(string geneModelDir);
+
+			// Parses the source files and writes bundleFile; on failure
+			// returns false and sets error, leaving no bundle behind
+			static bool Write(string bundleFile, const vector<string> &sources,
+				string *error);
+
+			// Maps bundleFile and checks its version, checksum (unless
+			// verifyChecksum is false), that every reference between its
+			// records is in range and that it was built from sources as they
+			// are now
+			bool Open(string bundleFile, const vector<string> &sources,
+				string *error, bool verifyChecksum = true);
+
+			// Unmaps the bundle; records read from it become invalid
+			void Close();
+
+			size_t Count(BundleSectionType type) const
+			{
+				return (size_t)header->sections[type].count;
+			}
+
+			const BundleGene *Genes() const
+			{
+				return (const BundleGene *)GetSection(GENES_SECTION);
+			}
+
+			const BundleIsoform *Isoforms() const
+			{
+				return (const BundleIsoform *)GetSection(ISOFORMS_SECTION);
+			}
+
+			const BundleExon *Exons() const
+			{
+				return (const BundleExon *)GetSection(EXONS_SECTION);
+			}
+
+			const uint32_t *GeneIsoforms() const
+			{
+				return (const uint32_t *)GetSection(GENE_ISOFORMS_SECTION);
+			}
+
+			const uint32_t *IsoformExons() const
+			{
+				return (const uint32_t *)GetSection(ISOFORM_EXONS_SECTION);
+			}
+
+			const BundleHomology *Homology() const
+			{
+				return (const BundleHomology *)GetSection(HOMOLOGY_SECTION);
+			}
+
+			const BundleRepeat *Repeats() const
+			{
+				return (const BundleRepeat *)GetSection(REPEATS_SECTION);
+			}
+
+			const char *GetString(uint32_t offset) const
+			{
+				return (const char *)GetSection(STRINGS_SECTION) + offset;
+			}
+
+			const char *GetSequence(uint64_t offset) const
+			{
+				return (const char *)GetSection(SEQUENCE_SECTION) + offset;
+			}
+	};
+};
+
+#endif
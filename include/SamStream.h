@@ -0,0 +1,90 @@
+#ifndef SAMSTREAM_H
+#define SAMSTREAM_H
+
+#pragma once
+
+#include <functional>
+
+#include <boost/utility/string_ref.hpp>
+
+#include "Utils.h"
+#include "Read.h"
+
+namespace MOJO
+{
+	// One alignment line of a SAM stream.  Views point into the line buffer
+	// and are only valid for the duration of the callback.
+	class SamRecord
+	{
+		public:
+			boost::string_ref line;
+			boost::string_ref qname;
+			boost::string_ref rname;
+			boost::string_ref cigar;
+			boost::string_ref tags;		//optional fields, tab separated
+			int flag;
+			int position;				//1-based
+			int mapq;
+
+			bool IsMapped() const { return (flag & 4) == 0 && rname != "*"; }
+
+			// Numeric read name (see SplitFastqEvenly); INVALID_READ_ID if the
+			// name is not numeric
+			ReadId GetReadId() const;
+
+			// Numeric part of a reference name such as "G1234" after skipping
+			// <prefixLength> characters; -1 if there are no digits
+			int GetRefNumber(int prefixLength = 1) const;
+
+			// Value of an optional field, e.g. GetTag("XA") for "XA:Z:<value>";
+			// false if the record has no such field
+			bool GetTag(const char *tag, boost::string_ref *value) const;
+	};
+
+	// Mapped record reduced to numbers, for the batch interface
+	struct SamHit
+	{
+		ReadId readId;
+		int refNumber;
+		int flag;
+		int position;
+	};
+
+	// Runs an aligner (or any command writing SAM to stdout) through
+	// ProcessRunner and parses its output in-process as it arrives; header
+	// lines are skipped unless an onHeader callback is given.  The returned
+	// SystemCall carries the command's stderr and is logged like
+	// Utils::ExecuteCommand.
+	class SamStream
+	{
+		public:
+			typedef std::function<void(const SamRecord &)> RecordCallback;
+
+			// end1/end2 are the mapped ends of a pair, null where unmapped
+			typedef std::function<void(const SamRecord *end1, 
+				const SamRecord *end2)> PairCallback;
+
+			// A header line without its newline
+			typedef std::function<void(boost::string_ref)> HeaderCallback;
+
+			// Parses one SAM line (without the newline); false for header
+			// lines and lines with too few fields
+			static bool Parse(const char *p, const char *end, SamRecord *rec);
+
+			static SystemCall Run(string cmd, string channelName,
+				RecordCallback onRecord, HeaderCallback onHeader = HeaderCallback());
+
+			// Appends every mapped record to <hits>
+			static SystemCall Run(string cmd, string channelName,
+				vector<SamHit> *hits, int refPrefixLength = 1);
+
+			// For paired aligners that write both ends of a pair on adjacent
+			// lines (bwa sampe): reports each pair with at least one mapped
+			// end, in output order.  Unmapped ends (including the flag 7
+			// records sampe sometimes emits) are filtered out in-stream.
+			static SystemCall RunPairs(string cmd, string channelName,
+				PairCallback onPair, HeaderCallback onHeader = HeaderCallback());
+	};
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#pragma once
+
+#include <deque>
+#include <functional>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "Utils.h"
+
+namespace MOJO
+{
+	// Runs a DAG of tasks within a core and memory (GB) budget, by default
+	// --max_cores and --max_mem.  Each task declares what it needs and which
+	// (previously added) tasks it depends on.  Ready tasks are started in the
+	// order they were added whenever they fit in what is left of the budget,
+	// so the next task starts as soon as a running one finishes.  A task
+	// asking for more than the whole budget is clamped to it and runs alone.
+	class TaskScheduler
+	{
+		public:
+			typedef int TaskId;
+			typedef std::function<void()> TaskFunction;
+
+			TaskScheduler(int max_cores = ComputePerTask::MAX_CPU,
+				int max_mem = ComputePerTask::MAX_MEM);
+
+			~TaskScheduler();
+
+			// onComplete is run on the thread calling Run(), one task at a
+			// time; dependents of the task are started only after it returns
+			TaskId AddTask(string name, int cores, int mem, TaskFunction run,
+				vector<TaskId> dependsOn = vector<TaskId>(),
+				TaskFunction onComplete = TaskFunction());
+
+			// Blocks until every task has completed
+			void Run();
+
+		private:
+			enum TaskState { PENDING, RUNNING, FINISHED, DONE };
+
+			struct Task
+			{
+				string name;
+				int cores, mem;
+				TaskFunction run, onComplete;
+				vector<TaskId> dependsOn;
+				TaskState state;
+				boost::thread *thread;
+			};
+
+			vector<Task> tasks;
+			int maxCores, maxMem, freeCores, freeMem;
+			deque<TaskId> finished;
+			boost::mutex mtx;
+			boost::condition_variable taskFinished;
+
+			bool IsReady(const Task &task);
+
+			void Execute(TaskId id);
+	};
+};
+
+#endif
@@ -5,6 +5,7 @@
 
 #define BOOST_LOG_DYN_LINK
 
+#include <cstdio>
 #include <vector>
 #include <cstring>
 #include <sstream>
@@ -51,17 +52,46 @@ namespace b_lt = boost::local_time;
 
 namespace MOJO 
 {
+	//CPU, memory and I/O used by a command or a stage; bytes are as counted
+	//by read/write calls (/proc/<pid>/io rchar and wchar)
+	class ResourceUsage
+	{
+		public:
+			double wallSeconds, userSeconds, sysSeconds;
+			long maxRssKb;
+			long long readBytes, writeBytes;
+
+			ResourceUsage() : wallSeconds(0), userSeconds(0), sysSeconds(0),
+				maxRssKb(0), readBytes(0), writeBytes(0) {}
+
+			friend ostream& operator<<(ostream &outStream, 
+				const ResourceUsage &usage)
+			{
+				char buf[300];
+				sprintf(buf, "wall %.2fs, user %.2fs, sys %.2fs, max RSS %.1fMB, "
+					"read %.1fMB, written %.1fMB", usage.wallSeconds, 
+					usage.userSeconds, usage.sysSeconds, usage.maxRssKb / 1024.0,
+					usage.readBytes / 1048576.0, usage.writeBytes / 1048576.0);
+				return outStream << buf;
+			}
+	};
+
 	class SystemCall 
 	{
 		public:
 			string systemcall;
 			string output;
+			string error;
 			int exit_code;
+			int signal;
+			bool timedOut;
+			ResourceUsage usage;
 
-			SystemCall() : exit_code(0) {}
+			SystemCall() : exit_code(0), signal(0), timedOut(false) {}
 			
 			SystemCall(string cmd, string out, int code) : 
-				systemcall(cmd), output(out), exit_code(code) {}
+				systemcall(cmd), output(out), exit_code(code), signal(0),
+				timedOut(false) {}
 			
 			friend ostream& operator<<(ostream &outStream, const SystemCall &call) 
 			{
@@ -70,9 +100,20 @@ namespace MOJO
 				if (!s.empty() && s.length() > 1 && s[s.length() - 1] == '\n')
 					s.erase(s.length() - 1);
 
+				string e = call.error;
+				if (!e.empty() && e[e.length() - 1] == '\n')
+					e.erase(e.length() - 1);
+
 				outStream << "\tCommand: " << call.systemcall << endl;
 				outStream << "\tOutput: " << s << endl;
+				if (!e.empty())
+					outStream << "\tError: " << e << endl;
 				outStream << "\tExit Code: " << call.exit_code << endl;
+				if (call.signal != 0)
+					outStream << "\tSignal: " << call.signal << 
+						(call.timedOut ? " (timed out)" : "") << endl;
+				if (call.usage.wallSeconds > 0)
+					outStream << "\tResources: " << call.usage << endl;
 				return outStream;
 			}
 	};
@@ -80,13 +121,23 @@ namespace MOJO
 	class SystemInfo 
 	{
 		public:
+			//CPUs this process may use: affinity mask, capped by the cgroup
+			//cpu quota
 			static int GetSystemCpuCount();
 	
+			//GB; the cgroup memory limit when lower than physical memory
 			static double GetTotalSystemMemory();
 			
-			static std::pair<double, double> GetTotalMemoryUsage(int sid, int pid = 0);
+			//Resident memory (GB) of pid and its descendants, and of pid alone
+			static std::pair<double, double> GetTotalMemoryUsage(int pid);
 			
 			static double GetTotalFreeMemory();
+
+			//cgroup v2 cpu.max / v1 cfs quota in cpus; 0 if unlimited
+			static double GetCgroupCpuLimit();
+
+			//cgroup v2 memory.max / v1 limit_in_bytes in GB; 0 if unlimited
+			static double GetCgroupMemoryLimit();
 			
 			SystemInfo();
 	};
@@ -132,13 +183,17 @@ namespace MOJO
 
 			static vector<string> SplitToVector(string line, string chr);
 			
-			static SystemCall ExecuteCommand(const char* cmd, 
+			//Runs cmd through ProcessRunner; output holds stdout, error holds
+			//stderr.  A timeout of 0 waits indefinitely.
+			static SystemCall ExecuteCommand(const string &cmd, 
 				string channelName = "",
 				bool doPrintErrors = true, 
-				bool exitOnFail = DONOT_EXIT_ON_FAIL);
-			
-			static SystemCall ExecuteCommand(char* cmd, string channelName = "",
-				bool doPrintErrors = true, bool exitOnFail = DONOT_EXIT_ON_FAIL);
+				bool exitOnFail = DONOT_EXIT_ON_FAIL,
+				int timeoutSeconds = 0);
+
+			//Logs a finished command the way ExecuteCommand does
+			static void LogSystemCall(const SystemCall &call, string channelName,
+				bool doPrintErrors = true);
 			
 			static bool FileExists(string file, bool logMsg = false);
 			
@@ -148,6 +203,11 @@ namespace MOJO
 			
 			static int LineCount(string file);
 
+			//CRC-32 and size of a file; with sampleBytes > 0 only the first and
+			//last sampleBytes are checksummed.  False if it cannot be read.
+			static bool FileChecksum(string file, unsigned long *crc, 
+				long long *size, long long sampleBytes = 0);
+
 			static vector<string> SortListOfFilesBySize(vector<string> files, 
 				bool ascending = true);
 
@@ -0,0 +1,165 @@
+
+#include <cstring>
+
+#include "AlignmentView.h"
+
+namespace MOJO
+{
+	XAExpander::XAExpander() : byNumber(true) {}
+
+	XAExpander::XAExpander(const RefVector &refs) : byNumber(false)
+	{
+		for (int rv = 0; rv < (int)refs.size(); rv++)
+			refNameToId[refs[rv].RefName] = rv;
+	}
+
+	static size_t TagValueSize(char type)
+	{
+		switch (type) {
+			case 'A': case 'c': case 'C': return 1;
+			case 's': case 'S': return 2;
+			case 'i': case 'I': case 'f': return 4;
+			default: return 0;
+		}
+	}
+
+	// Walks the packed tag data (two-character tag, type, value) of a record
+	bool XAExpander::FindStringTag(const BamAlignment &al, const char *tag,
+		const char **value, size_t *length)
+	{
+		const char *p = al.TagData.data();
+		const char *end = p + al.TagData.size();
+		while (p + 3 <= end) {
+			bool match = (p[0] == tag[0] && p[1] == tag[1]);
+			char type = p[2];
+			p += 3;
+			if (type == 'Z' || type == 'H') {
+				const char *stop = (const char *)memchr(p, '\0', end - p);
+				if (stop == NULL)
+					stop = end;
+				if (match) {
+					*value = p;
+					*length = stop - p;
+					return true;
+				}
+				p = stop + 1;
+			}
+			else if (type == 'B') {
+				if (p + 5 > end)
+					return false;
+				int32_t count;
+				memcpy(&count, p + 1, sizeof(count));
+				p += 5 + (size_t)count * TagValueSize(p[0]);
+			}
+			else {
+				size_t size = TagValueSize(type);
+				if (size == 0)
+					return false;
+				p += size;
+			}
+		}
+		return false;
+	}
+
+	// Parses a signed decimal integer at p, stopping at the first non-digit
+	static int ParseInt(const char *&p, const char *end)
+	{
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-'))
+			negative = (*p++ == '-');
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+			value = value * 10 + (*p++ - '0');
+		return negative ? -value : value;
+	}
+
+	int XAExpander::GetRefId(const char *name, size_t length)
+	{
+		if (byNumber) {
+			const char *p = name + min<size_t>(1, length);
+			return ParseInt(p, name + length);
+		}
+		key.assign(name, length);
+		auto it = refNameToId.find(key);
+		return (it == refNameToId.end()) ? 0 : it->second;
+	}
+
+	//XA:Z:gene,+pos,CIGAR,NM;gene,-pos,CIGAR,NM;...
+	void XAExpander::ExpandXA(const char *p, size_t length,
+		vector<AlignmentView> *aligns)
+	{
+		const AlignmentView primary = aligns->front();
+		const char *end = p + length;
+		while (p < end) {
+			const char *next = (const char *)memchr(p, ';', end - p);
+			if (next == NULL)
+				next = end;
+			const char *comma = (const char *)memchr(p, ',', next - p);
+			if (next - p >= 2 && comma != NULL) {
+				const char *field = comma + 1;
+				AlignmentView alt = primary;
+				// offset by -1 to convert to 0-based offset for bam
+				alt.position = abs(ParseInt(field, next)) - 1;
+				const char *cigarEnd = NULL;
+				if (field < next && *field == ',')
+					cigarEnd = (const char *)memchr(field + 1, ',', next - field - 1);
+				if (cigarEnd != NULL) {
+					field = cigarEnd + 1;
+					alt.nm = ParseInt(field, next);
+					if (alt.nm <= primary.nm) {
+						alt.refId = GetRefId(p, comma - p);
+						aligns->push_back(alt);
+					}
+				}
+			}
+			p = next + 1;
+		}
+	}
+
+	void XAExpander::Expand(const BamAlignment &al, vector<AlignmentView> *aligns)
+	{
+		aligns->clear();
+		AlignmentView primary;
+		primary.refId = al.RefID;
+		primary.position = al.Position;
+		primary.reverseStrand = al.IsReverseStrand();
+		primary.matchedLength = 0;
+		for (auto &op : al.CigarData)
+			if (op.Type == 'M')
+				primary.matchedLength += op.Length;
+		primary.nm = 0;
+		al.GetTag("NM", primary.nm);
+		aligns->push_back(primary);
+
+		const char *xa;
+		size_t length;
+		if (FindStringTag(al, "XA", &xa, &length))
+			ExpandXA(xa, length, aligns);
+	}
+
+	void XAExpander::Expand(const SamRecord &rec, vector<AlignmentView> *aligns)
+	{
+		aligns->clear();
+		AlignmentView primary;
+		primary.refId = GetRefId(rec.rname.data(), rec.rname.size());
+		primary.position = rec.position - 1;
+		primary.reverseStrand = (rec.flag & 0x10) != 0;
+		primary.matchedLength = 0;
+		const char *p = rec.cigar.data(), *end = p + rec.cigar.size();
+		while (p < end) {
+			int length = ParseInt(p, end);
+			if (p < end && *p++ == 'M')
+				primary.matchedLength += length;
+		}
+		primary.nm = 0;
+		boost::string_ref value;
+		if (rec.GetTag("NM", &value)) {
+			p = value.data();
+			primary.nm = ParseInt(p, value.data() + value.size());
+		}
+		aligns->push_back(primary);
+
+		if (rec.GetTag("XA", &value))
+			ExpandXA(value.data(), value.size(), aligns);
+	}
+}
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+#include "GzipReader.h"
+
+using namespace std;
+using namespace MOJO;
+
+const int MAX_CHARS_LINE = 1000;
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static void Report(string method, long long bytes, long long lines, double secs)
+{
+	printf("%-32s %12lld bytes %10lld lines %8.3f s %9.1f MB/s\n",
+		method.c_str(), bytes, lines, secs, bytes / secs / (1 << 20));
+}
+
+// BenchmarkGzipReader compares decompression throughput of the line reading
+// paths used on fastq input: `gzip -dc` (split ingest before SplitFastqEvenly),
+// boost::iostreams gzip_decompressor + getline (FastqFile before GzipReader)
+// and GzipReader at the given thread counts.
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		cout << endl << "BenchmarkGzipReader - fastq(.gz) decompression throughput" << endl << endl;
+		cout << "  Usage: BenchmarkGzipReader <file.fastq[.gz]> [<threads> ...]" << endl;
+		cout << "      <file.fastq[.gz]>  - plain, gzip or BGZF (bgzip) compressed file" << endl;
+		cout << "      <threads>          - GzipReader thread counts to test; default 1 2 4 8" << endl << endl;
+		return 0;
+	}
+	string file = argv[1];
+	vector<int> threadCounts;
+	for (int i = 2; i < argc; i++)
+		threadCounts.push_back(atoi(argv[i]));
+	if (threadCounts.empty())
+		threadCounts = vector<int>{ 1, 2, 4, 8 };
+
+	string formats[] = { "plain", "gzip", "bgzf" };
+	cout << "File: " << file << " (" << formats[GzipReader::DetectFormat(file)]
+		<< ")" << endl;
+
+	{
+		auto start = chrono::steady_clock::now();
+		string cmd = "gzip -dcf " + file + " > /dev/null";
+		if (system(cmd.c_str()) == 0)
+			printf("%-32s %8.3f s\n", "gzip -dc > /dev/null", SecondsSince(start));
+	}
+
+	{
+		auto start = chrono::steady_clock::now();
+		std::ifstream ifs(file.c_str(), std::ios_base::in | std::ios_base::binary);
+		boost::iostreams::filtering_istream in;
+		if (GzipReader::DetectFormat(file) != PLAIN_TEXT)
+			in.push(boost::iostreams::gzip_decompressor());
+		in.push(ifs);
+		long long bytes = 0, lines = 0;
+		for (string s; std::getline(in, s); lines++)
+			bytes += s.size() + 1;
+		Report("iostreams gzip_decompressor", bytes, lines, SecondsSince(start));
+	}
+
+	for (auto t : threadCounts) {
+		auto start = chrono::steady_clock::now();
+		GzipReader in(file, t);
+		char line[MAX_CHARS_LINE];
+		long long bytes = 0, lines = 0;
+		while (in.ReadLine(line, MAX_CHARS_LINE)) {
+			bytes += strlen(line);
+			lines++;
+		}
+		if (in.HasFailed()) {
+			cerr << "Error: " << in.GetError() << endl;
+			return 1;
+		}
+		Report("GzipReader (" + to_string(t) + " threads)", bytes, lines,
+			SecondsSince(start));
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "IntervalIndex.h"
+
+using namespace std;
+using namespace MOJO;
+
+struct SimGene
+{
+	int start, end, id;
+};
+
+// The per-query scan GeneModel::GetGeneNameForCoordinates replaced, kept as
+// the reference for output comparison
+static int FindByScan(const map<int, SimGene> &genes, int pos)
+{
+	for (auto iter : genes) {
+		const SimGene &g = iter.second;
+		if ((pos > g.start && pos < g.end) || (pos > g.end && pos < g.start))
+			return g.id;
+	}
+	return -1;
+}
+
+// Genes with distinct starts and lengths from 1kb to ~2Mb (mostly short),
+// roughly the density of a RefSeq annotation on a 100Mb chromosome
+static vector<SimGene> SimulateGenes(int numGenes, int chromLength)
+{
+	mt19937 rng(numGenes);
+	uniform_int_distribution<int> start(0, chromLength);
+	exponential_distribution<double> length(1.0 / 30000);
+	map<int, bool> used;
+	vector<SimGene> genes;
+	while ((int)genes.size() < numGenes) {
+		int s = start(rng);
+		if (used.count(s))
+			continue;
+		used[s] = true;
+		int len = 1000 + min(2000000, (int)length(rng));
+		SimGene g = { s, s + len, (int)genes.size() + 1 };
+		genes.push_back(g);
+	}
+	return genes;
+}
+
+// BenchmarkIntervalIndex times gene lookups for random positions with the
+// former linear scan and with IntervalIndex, and checks that both return
+// the same genes.
+int main(int argc, char *argv[])
+{
+	int numQueries = 200000, chromLength = 100000000;
+	vector<int> geneCounts{ 1000, 2000, 4000 };
+	if (argc > 1)
+		numQueries = atoi(argv[1]);
+	if (argc > 2) {
+		geneCounts.clear();
+		for (int i = 2; i < argc; i++)
+			geneCounts.push_back(atoi(argv[i]));
+	}
+	if (argc == 1) {
+		cout << endl << "BenchmarkIntervalIndex - gene lookup microbenchmark" << endl << endl;
+		cout << "  Usage: BenchmarkIntervalIndex <num_queries> [<genes_per_chromosome> ...]" << endl;
+		cout << "  Running with " << numQueries << " queries, 1000 2000 4000 genes" << endl << endl;
+	}
+
+	printf("%-8s %12s %12s %8s %s\n", "genes", "scan(s)", "index(s)", "speedup",
+		"identical");
+	for (auto numGenes : geneCounts) {
+		auto genes = SimulateGenes(numGenes, chromLength);
+		map<int, SimGene> byStart;
+		IntervalIndex index;
+		for (auto &g : genes) {
+			byStart[g.start] = g;
+			index.Add(g.start, g.end, g.id);
+		}
+		index.Build();
+
+		mt19937 rng(numQueries);
+		uniform_int_distribution<int> pos(0, chromLength);
+		vector<int> queries(numQueries);
+		for (auto &q : queries)
+			q = pos(rng);
+
+		vector<int> outA, outB;
+		auto start = chrono::steady_clock::now();
+		for (auto q : queries)
+			outA.push_back(FindByScan(byStart, q));
+		auto mid = chrono::steady_clock::now();
+		for (auto q : queries)
+			outB.push_back(index.Find(q));
+		auto end = chrono::steady_clock::now();
+
+		double a = chrono::duration<double>(mid - start).count();
+		double b = chrono::duration<double>(end - mid).count();
+		printf("%-8d %12.3f %12.3f %7.1fx %s\n", numGenes, a, b, a / b,
+			outA == outB ? "yes" : "NO");
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "QualityTrimmer.h"
+
+using namespace std;
+using namespace MOJO;
+
+// The quadratic trimming loop QualityTrimmer::TrimRead replaced (with
+// cum_quals[0] initialised), kept as the reference for output comparison
+static int TrimReadQuadratic(char *quality, int threshold, bool toSanger)
+{
+	int offset = toSanger ? 64 : 33;
+	auto read_length = strlen(quality);
+
+	if (threshold <= 0 || (int)quality[read_length - 1] - offset >= threshold) {
+		if (toSanger)
+			for (size_t i = 0; i < read_length; i++)
+				quality[i] = (char)((int)quality[i] - 31);
+		return read_length;
+	}
+
+	int cum_quals[500];
+	cum_quals[0] = 0;
+	for (size_t i = 0; i < read_length; i++) {
+		int x = i + 1;
+		cum_quals[x] = 0;
+		for (size_t j = x; j < read_length; j++)
+			cum_quals[x] += threshold - ((int)quality[j] - offset);
+		if (toSanger)
+			quality[i] = (char)((int)quality[i] - 31);
+	}
+
+	int trim_till = 0, maxval = 0;
+	for (size_t i = 0; i < read_length; i++) {
+		if (maxval < cum_quals[i]) {
+			trim_till = i;
+			maxval = cum_quals[i];
+		}
+	}
+	return trim_till < 36 ? 36 : trim_till;
+}
+
+// Qualities mostly high with a degrading 3' tail, as in real Illumina reads
+static vector<string> SimulateQualities(int numReads, int length, bool illumina)
+{
+	mt19937 rng(length);
+	uniform_int_distribution<int> high(25, 40), low(2, 20), coin(0, 3);
+	int offset = illumina ? 64 : 33;
+	vector<string> quals(numReads, string(length, ' '));
+	for (auto &q : quals) {
+		int tail = coin(rng) == 0 ? 0 : length / 4;
+		for (int i = 0; i < length; i++)
+			q[i] = (char)(offset + (i >= length - tail ? low(rng) : high(rng)));
+	}
+	return quals;
+}
+
+typedef int(*TrimFunction)(char *, int, bool);
+
+static int TrimLinear(char *quality, int threshold, bool toSanger)
+{
+	return QualityTrimmer::TrimRead(quality, strlen(quality), threshold, toSanger);
+}
+
+static double Time(TrimFunction f, const vector<string> &quals, int threshold,
+	bool toSanger, vector<string> *out, vector<int> *lengths)
+{
+	char buf[1000];
+	out->clear();
+	lengths->clear();
+	auto start = chrono::steady_clock::now();
+	for (auto &q : quals) {
+		memcpy(buf, q.c_str(), q.size() + 1);
+		lengths->push_back(f(buf, threshold, toSanger));
+		out->push_back(buf);
+	}
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// BenchmarkQualityTrimmer times the quadratic and the linear trimming kernels
+// at 75, 100 and 150bp (or the given lengths) and checks that both produce
+// identical trim lengths and qualities.
+int main(int argc, char *argv[])
+{
+	int numReads = 1000000, threshold = 15;
+	vector<int> readLengths{ 75, 100, 150 };
+	if (argc > 1)
+		numReads = atoi(argv[1]);
+	if (argc > 2) {
+		readLengths.clear();
+		for (int i = 2; i < argc; i++)
+			readLengths.push_back(atoi(argv[i]));
+	}
+	if (argc == 1) {
+		cout << endl << "BenchmarkQualityTrimmer - quality trimming microbenchmark" << endl << endl;
+		cout << "  Usage: BenchmarkQualityTrimmer <num_reads> [<read_length> ...]" << endl;
+		cout << "  Running with " << numReads << " reads, lengths 75 100 150" << endl << endl;
+	}
+
+	printf("%-8s %-8s %12s %12s %8s %s\n", "length", "quals", "quadratic(s)",
+		"linear(s)", "speedup", "identical");
+	for (auto length : readLengths) {
+		for (int illumina = 0; illumina <= 1; illumina++) {
+			auto quals = SimulateQualities(numReads, length, illumina == 1);
+			vector<string> outA, outB;
+			vector<int> lenA, lenB;
+			double a = Time(TrimReadQuadratic, quals, threshold, illumina == 1,
+				&outA, &lenA);
+			double b = Time(TrimLinear, quals, threshold, illumina == 1,
+				&outB, &lenB);
+			printf("%-8d %-8s %12.3f %12.3f %7.1fx %s\n", length,
+				illumina ? "illumina" : "sanger", a, b, a / b,
+				(outA == outB && lenA == lenB) ? "yes" : "NO");
+		}
+	}
+	return 0;
+}
@@ -1,5 +1,6 @@
 
 #include <fstream>
+#include <zlib.h>
 
 #include <boost/program_options.hpp>
 #include <boost/algorithm/string.hpp>
@@ -182,6 +183,14 @@ namespace MOJO
 				po::value<string>(&repeatMaskerFile)->default_value("default"), 
 				" ")
 
+			("reference_bundle_file", 
+				po::value<string>(&referenceBundleFile)->default_value("default"), 
+				" ")
+
+			("verify_reference_bundle", 
+				po::value<bool>(&verifyReferenceBundle)->default_value(true), 
+				" 0 to skip the checksum of the reference bundle on load [1]")
+
 			("split_fastq_binary", 
 				po::value<string>(&splitFastqBinary)->default_value("default"), 
 				" ")
@@ -327,10 +336,12 @@ namespace MOJO
 			megablastOutputFile = MOJOReferenceDir + "/gene_model/gene2gene.megablast.txt";
 		if (repeatMaskerFile == "default") 
 			repeatMaskerFile = MOJOReferenceDir + "/gene_model/rmsk.regions.txt";
+		if (referenceBundleFile == "default") 
+			referenceBundleFile = MOJOReferenceDir + "/gene_model/GeneModel.bundle";
 		if (filterJunctOutputBinary == "default") 
 			filterJunctOutputBinary = MOJOInstallDir + "/FilterJunctAlignOutput";
 		if (splitFastqBinary == "default") 
-			splitFastqBinary = MOJOInstallDir + "/StreamNthFastqSplit";
+			splitFastqBinary = MOJOInstallDir + "/SplitFastqEvenly";
 
 		if (blatFilterChromsCsv == "default" || blatFilterChromsCsv == "" ) {
 			blatFilterChromsCsv = "";
@@ -414,8 +425,8 @@ namespace MOJO
 			if (!Utils::FileExists(end2File, true))  
 				exit(1);
 
-			FastqParser *parser = new FastqParser(end1File, end2File);
-			encodings.push_back(parser->GetFastqEncoding());
+			FastqParser parser(end1File, end2File);
+			encodings.push_back(parser.GetFastqEncoding());
 			firstEndFastqs.push_back(end1File);
 			secondEndFastqs.push_back(end2File);
 		}
@@ -470,7 +481,7 @@ namespace MOJO
 	// ./fastqs/readcount file is generated by DiscordantReadFinder after
 	// the initial alignment to the spliced transcriptome. This function
 	// reads that file and returns the readcount
-	int Config::GetTotalReadcount() 
+	long long Config::GetTotalReadcount() 
 	{
 		if (readcount != 0)
 			return readcount;
@@ -487,7 +498,7 @@ namespace MOJO
 			return 0;
 
 		try{
-			readcount = stoi(results[1].str());
+			readcount = stoll(results[1].str());
 		}
 		catch (std::exception e) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main")
@@ -497,12 +508,16 @@ namespace MOJO
 		return readcount;
 	}
 
-	//Splits input fastqs into specified number of splits and outputs to a 
-	//named pipe.  This reduces the I/O overhead during the initial preprocessing
-	//of the reads during which reads are trimmed (for a certain length or just
-	//for quality)
-	string Config::GenerateCatCmdsForSplit(int end, int split_id,
-		int num_splits, bool silent )
+	//Decodes all lanes of <end> once and fans the reads out round-robin into
+	// one named pipe per split (workingDir/fastqs/split_<id>_<end>.fastq).  
+	// The splitter runs in the background; every split pipe must be consumed 
+	// concurrently (one reader per split) for it to make progress.  Both ends
+	// may be fanned out at once, so each gets half of the cores for BGZF input.
+	// Its exit status is left for WaitForFanOut.  Only end 1 writes the
+	// readcount and readID side files: the count is of pairs, and end 2
+	// keeps the numeric names end 1 assigned.
+	string Config::GenerateFanOutCmdsForSplits(int end, int num_splits, 
+		bool silent, const vector<bool> *skipSplits)
 	{
 		Config *c = Config::GetConfig();
 		vector<string> *fqs;
@@ -511,49 +526,65 @@ namespace MOJO
 		else
 			fqs = &c->secondEndFastqs;
 
-		int fq_idx = 0;
-		stringstream ss, ssFqFifo;
-		ssFqFifo << "cat ";
-		for (auto fq : (*fqs)){
-			string cat = "cat ";
-			if (fq.substr(fq.length() - 3, 3) == ".gz")
-				cat = "gzip -dc ";
-
-			string fifo = c->workingDir + "/fastqs/input_"
-				+ lexical_cast<string>(split_id)+"_"
-				+ lexical_cast<string>(fq_idx)+"_"
-				+ lexical_cast<string>(end)+".fifo";
-
-			ss << "rm -f " << fifo << endl;
-			ss << "sleep 1" << endl;
-			ss << "mkfifo " << fifo << endl;
-			ss << cat << " " << fq << " > " << fifo << " & " << endl;
-			ss << "sleep 1" << endl;
-			ssFqFifo << fifo << " ";
-			fq_idx++;
-		}
-
-		string fqFile = c->workingDir + "/fastqs/split_" + to_string(split_id) +
-			"_" + to_string(end) + ".fastq";
+		string fqPfx = c->workingDir + "/fastqs/split_";
 		string readCountFile = "-", readMappingFile = "-";
-		if (!silent && split_id == 0)
+		if (!silent && end == 1) {
 			readCountFile = c->workingDir + "/fastqs/readcount";
-		if (!silent && end == 1)
-			readMappingFile = fqFile + ".readID";
+			readMappingFile = fqPfx + "%d_1.fastq.readID";
+		}
 
-		ss << "rm -f " << fqFile << endl;
-		ss << "sleep 0.2" << endl;
-		ss << "mkfifo " << fqFile << endl;
-		ss << "sleep 0.2" << endl;
+		string fanOutPfx = c->workingDir + "/fastqs/fanout_" + to_string(end);
+		stringstream ss;
+		ss << "rm -f " << fanOutPfx << ".status" << endl;
+		for (int split_id = 0; split_id < num_splits; split_id++) {
+			string fqFile = fqPfx + to_string(split_id) + "_" + 
+				to_string(end) + ".fastq";
+			ss << "rm -f " << fqFile << endl;
+			if (skipSplits != NULL && (*skipSplits)[split_id]) {
+				ss << "ln -s /dev/null " << fqFile << endl;
+				if (readMappingFile != "-")
+					ss << "ln -sf /dev/null " << fqFile << ".readID" << endl;
+			}
+			else
+				ss << "mkfifo " << fqFile << endl;
+		}
 
-		ss << ssFqFifo.str() << " | " 
-			<< c->splitFastqBinary << " " << num_splits << " " << split_id << " " 
-			<< end << " 15 " << c->fastqEncodingString << " 1 " << readCountFile 
-			<< " " << readMappingFile << " > " << fqFile << " & " << endl;
+		//The status is renamed into place so that it is never read half written
+		ss << "(st=0; " << c->splitFastqBinary << " " << num_splits << " " << end 
+			<< " " << fqPfx << "%d_" << end << ".fastq 15 " 
+			<< c->fastqEncodingString << " 1 " << readCountFile << " " 
+			<< readMappingFile << " " << std::max(1, c->maxCores / 2);
+		for (auto fq : (*fqs))
+			ss << " " << fq;
+		ss << " > " << fanOutPfx << ".log 2>&1 || st=$?; echo $st > " << fanOutPfx
+			<< ".status.tmp; mv -f " << fanOutPfx << ".status.tmp " << fanOutPfx
+			<< ".status) < /dev/null > /dev/null 2>&1 &" << endl;
 
 		return ss.str();
 	}
 
+	//Blocks until the splitter of <end> has exited.  The splitter opens every
+	// split before reading any input and exits on bad input, so its readers
+	// see EOF rather than block; a reader must still check here that its split
+	// was complete and not cut short.
+	bool Config::WaitForFanOut(int end)
+	{
+		Config *c = Config::GetConfig();
+		string fanOutPfx = c->workingDir + "/fastqs/fanout_" + to_string(end);
+		while (!Utils::FileExists(fanOutPfx + ".status"))
+			boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+		int exitCode = -1;
+		ifstream in((fanOutPfx + ".status").c_str());
+		in >> exitCode;
+		if (exitCode == 0)
+			return true;
+		BOOST_LOG_CHANNEL(logger::get(), "Main") << "Splitting end " << end 
+			<< " fastqs failed with exit code " << exitCode << ". See: " 
+			<< fanOutPfx << ".log";
+		return false;
+	}
+
 	//Removes all temporary files.  Final fusion output will have the following files
 	// .fusions, .fusions.pileup, .log, .discordants.genes and .junctions.alignments.
 	// .discordants.genes has the number of unique/non-unique discordant reads mapping
@@ -619,4 +650,124 @@ namespace MOJO
 		out << "NumSplits=" << NumSplits << endl;
 		out.close();
 	}
+
+	static const long long MANIFEST_INPUT_SAMPLE_BYTES = 1 << 20;
+
+	TaskManifest::TaskManifest(string file, string parameters) : filename(file),
+		Count(0)
+	{
+		paramsHash = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)parameters.data(),
+			parameters.size());
+	}
+
+	TaskManifest::FileRecord TaskManifest::Fingerprint(string file, 
+		long long sampleBytes)
+	{
+		FileRecord r = { file, -1, 0 };
+		if (!Utils::FileChecksum(file, &r.checksum, &r.size, sampleBytes))
+			r.size = -1;
+		return r;
+	}
+
+	void TaskManifest::AddInput(string file)
+	{
+		inputs.push_back(Fingerprint(file, MANIFEST_INPUT_SAMPLE_BYTES));
+	}
+
+	void TaskManifest::AddOutput(string file)
+	{
+		outputs.push_back(Fingerprint(file, 0));
+	}
+
+	//Manifest lines are key=value; files are path<tab>size<tab>checksum
+	bool TaskManifest::IsValid()
+	{
+		ifstream in(filename.c_str());
+		if (!in.is_open())
+			return false;
+
+		bool haveParams = false, complete = false;
+		size_t numInputs = 0, numOutputs = 0;
+		string line;
+		while (getline(in, line)) {
+			size_t eq = line.find('=');
+			if (line.empty() || line[0] == '#' || eq == string::npos)
+				continue;
+			string key = line.substr(0, eq), value = line.substr(eq + 1);
+			try {
+				if (key == "Params") {
+					haveParams = true;
+					if (stoul(value, 0, 16) != paramsHash)
+						return false;
+				}
+				else if (key == "Input" || key == "Output") {
+					vector<string> f = Utils::SplitToVector(value, "\t");
+					if (f.size() != 3)
+						return false;
+					FileRecord saved = { f[0], stoll(f[1]), stoul(f[2], 0, 16) };
+					FileRecord current;
+					if (key == "Input") {
+						if (numInputs >= inputs.size() || 
+							inputs[numInputs++].path != saved.path)
+							return false;
+						current = inputs[numInputs - 1];
+					}
+					else {
+						current = Fingerprint(saved.path, 0);
+						numOutputs++;
+					}
+					if (current.size < 0 || current.size != saved.size || 
+						current.checksum != saved.checksum)
+						return false;
+				}
+				else if (key == "Count")
+					Count = stoll(value);
+				else if (key == "IsComplete")
+					complete = (value == "1");
+			}
+			catch (std::exception &e) {
+				return false;
+			}
+		}
+		return haveParams && complete && numInputs == inputs.size() && 
+			numOutputs > 0;
+	}
+
+	void TaskManifest::Invalidate()
+	{
+		boost::system::error_code ec;
+		boost::filesystem::remove(filename, ec);
+	}
+
+	//Written to a temporary file first so an interrupted save leaves no
+	//manifest behind
+	void TaskManifest::Save()
+	{
+		string tmp = filename + ".tmp";
+		ofstream out(tmp.c_str(), ios::out);
+		char hex[20];
+		out << "#### DO NOT MODIFY.  MOJO task manifest." << endl;
+		sprintf(hex, "%lx", paramsHash);
+		out << "Params=" << hex << endl;
+		for (int io = 0; io < 2; io++) {
+			for (auto &r : (io == 0 ? inputs : outputs)) {
+				if (r.size < 0) {
+					BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot "
+						<< "checksum " << r.path << " for " << filename;
+					exit(1);
+				}
+				sprintf(hex, "%lx", r.checksum);
+				out << (io == 0 ? "Input=" : "Output=") << r.path << "\t" 
+					<< r.size << "\t" << hex << endl;
+			}
+		}
+		out << "Count=" << Count << endl;
+		out << "IsComplete=1" << endl;
+		out.close();
+		if (out.fail() || rename(tmp.c_str(), filename.c_str()) != 0) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot save "
+				<< filename;
+			exit(1);
+		}
+	}
 }
\ No newline at end of file
@@ -29,11 +29,17 @@ namespace MOJO
 
 		vector<DiscordantCluster *> clusters_unfiltered, clusters;
 		unordered_map<int, unordered_map<int, DiscordantCluster *> > clustersMap;
-		ifstream discFlat(GetFlatFilename().c_str());
-		for (std::string str; getline(discFlat, str);) {
-			auto sp = Utils::SplitToVector(str, "\t");
-			Gene *gA = gm->GetGeneFromMap(sp[0]);
-			Gene *gB = gm->GetGeneFromMap(sp[5]);
+		DiscordantPairReader discPairs(GetPairsFilename());
+		for (const DiscordantPair &pair : discPairs) {
+			auto itA = gm->GenesMap.find(pair.geneA);
+			auto itB = gm->GenesMap.find(pair.geneB);
+			if (itA == gm->GenesMap.end() || itB == gm->GenesMap.end()) {
+				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error loading clusters: "
+					<< " gene(s) not found for record: " << endl 
+					<< DiscordantPairReader::ToText(pair) << endl;
+				exit(1);
+			}
+			Gene *gA = itA->second, *gB = itB->second;
 
 			// abParts is the only black listed locus (~4,500 exons); including 
 			// this works without any issues but increases the downstream 
@@ -43,15 +49,9 @@ namespace MOJO
 				gB->name.find("abParts") != string::npos)
 				continue;
 
-			if (gA == 0 || gB == 0) {
-				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error loading clusters: "
-					<< " gene(s) not found for line: " << endl << str << endl;
-				exit(1);
-			}
 			if (gA == gB || gA->chr == "chrM" || gB->chr == "chrM") 
 				continue;
-			DiscordantClusterAlignment dca(sp[1], sp[2], sp[3], sp[6], sp[7], 
-				sp[8], sp[11]);
+			DiscordantClusterAlignment dca(pair);
 
 
 			//require at least one end not mapping to repetitive region
@@ -69,21 +69,15 @@ namespace MOJO
 
 			//Uses a precomputed megablast index to determine if either end of the 
 			//discordant read maps to a region of shared homology between the two genes
-			bool blastHomologyFound = false;
-			if (gA->blastHits.find(gB->geneId) != gB->blastHits.end()) {
-				vector<CoordinatePair> coords = gA->blastHits[gB->geneId];
-				for (auto cp : coords) 
-					if ((cp.startA < dca.startA && cp.endA > dca.endA) ||
-						(cp.startB < dca.startB && cp.endB > dca.endB))
-						blastHomologyFound = true;
-			}
 			//If homology found, then ignore this discordant read
-			if (blastHomologyFound)
+			if (gm->homology.IsHomologous(gA->geneId, dca.startA, dca.endA,
+				gB->geneId, dca.startB, dca.endB))
 				continue;
 
 			if (gA->geneId > gB->geneId) {
 				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Incorrect format for: "
-					<< GetFlatFilename() << endl << str << endl;
+					<< GetPairsFilename() << endl 
+					<< DiscordantPairReader::ToText(pair) << endl;
 				exit(1);
 			}
 
@@ -195,9 +189,9 @@ namespace MOJO
 		return clusters;
 	}
 
-	string DiscordantClusterFinder::GetFlatFilename()
+	string DiscordantClusterFinder::GetPairsFilename()
 	{
 		Config *c = Config::GetConfig();
-		return c->workingDir + "discordant.flat";
+		return c->workingDir + "discordant.pairs";
 	}
 }
\ No newline at end of file
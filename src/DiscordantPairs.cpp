@@ -0,0 +1,112 @@
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "DiscordantPairs.h"
+
+namespace MOJO
+{
+	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
+		(keywords::channel = "Main"));
+
+	static const size_t MAGIC_LENGTH = 8;
+	static const size_t WRITE_BATCH_PAIRS = 65536;
+
+	boost::mutex DiscordantPairWriter::appendMutex;
+
+	void DiscordantPairWriter::Create(string file)
+	{
+		FILE *fp = fopen(file.c_str(), "wb");
+		if (fp == NULL || fwrite(DISCORDANT_PAIRS_MAGIC, 1, MAGIC_LENGTH, fp)
+			!= MAGIC_LENGTH)
+		{
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot create "
+				<< file;
+			exit(1);
+		}
+		fclose(fp);
+	}
+
+	DiscordantPairWriter::DiscordantPairWriter(string file) : fileName(file),
+		numPairs(0)
+	{
+		buffer.reserve(WRITE_BATCH_PAIRS);
+	}
+
+	DiscordantPairWriter::~DiscordantPairWriter()
+	{
+		Flush();
+	}
+
+	void DiscordantPairWriter::Write(const DiscordantPair &pair)
+	{
+		buffer.push_back(pair);
+		numPairs++;
+		if (buffer.size() >= WRITE_BATCH_PAIRS)
+			Flush();
+	}
+
+	void DiscordantPairWriter::Flush()
+	{
+		if (buffer.empty())
+			return;
+		boost::mutex::scoped_lock lock(appendMutex);
+		FILE *fp = fopen(fileName.c_str(), "ab");
+		if (fp == NULL || fwrite(buffer.data(), sizeof(DiscordantPair),
+			buffer.size(), fp) != buffer.size() || fclose(fp) != 0)
+		{
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot append "
+				<< "discordant pairs to " << fileName;
+			exit(1);
+		}
+		buffer.clear();
+	}
+
+	DiscordantPairReader::DiscordantPairReader(string file) : fileName(file),
+		map(MAP_FAILED), mapLength(0), pairs(0), numPairs(0)
+	{
+		int fd = open(file.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot open "
+				<< file;
+			exit(1);
+		}
+		mapLength = st.st_size;
+		if (mapLength > 0)
+			map = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapLength < MAGIC_LENGTH || map == MAP_FAILED ||
+			memcmp(map, DISCORDANT_PAIRS_MAGIC, MAGIC_LENGTH) != 0 ||
+			(mapLength - MAGIC_LENGTH) % sizeof(DiscordantPair) != 0)
+		{
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: " << file
+				<< " is not a discordant pairs file or is truncated";
+			exit(1);
+		}
+		madvise(map, mapLength, MADV_SEQUENTIAL);
+		pairs = (const DiscordantPair *)((const char *)map + MAGIC_LENGTH);
+		numPairs = (mapLength - MAGIC_LENGTH) / sizeof(DiscordantPair);
+	}
+
+	DiscordantPairReader::~DiscordantPairReader()
+	{
+		if (map != MAP_FAILED)
+			munmap(map, mapLength);
+	}
+
+	string DiscordantPairReader::ToText(const DiscordantPair &p)
+	{
+		char buf[300];
+		string name = to_string(p.readId);
+		if (p.copy > 0)
+			name += "_" + to_string(p.copy);
+		sprintf(buf, "g%d\t%d\t%d\t%c\t%d\tg%d\t%d\t%d\t%c\t%d\t%s\t%d",
+			p.geneA, p.positionA, p.lengthA, p.strandA ? '-' : '+', p.mateA,
+			p.geneB, p.positionB, p.lengthB, p.strandB ? '-' : '+', p.mateB,
+			name.c_str(), p.isUnique);
+		return buf;
+	}
+}
@@ -1,5 +1,9 @@
 
+#include <boost/unordered_set.hpp>
+
 #include "DiscordantReadFinder.h"
+#include "SamStream.h"
+#include "TaskScheduler.h"
 
 namespace MOJO 
 {
@@ -12,6 +16,19 @@ namespace MOJO
 	boost::mutex DiscordantReadFinder::statsUpdateMutex1;
 	boost::mutex DiscordantReadFinder::statsUpdateMutex2;
 
+	// Pairs per chunk of unaligned reads in FindDiscordantReads: large enough
+	// to amortize loading the bwa index, small enough to balance the workers
+	static const long long DISCORDANT_CHUNK_PAIRS = 250000;
+
+	// Iteration 1 alignment status of a pair with a mapped end, one fixed-width
+	// record per pair in read id order (<chunk>_iteration1.status)
+	struct IterationStatus
+	{
+		ReadId readId;
+		int32_t unalignedEnd;	//0: both ends mapped, else the unmapped end
+		int32_t reserved;
+	};
+
 	//
 	// DiscordantReadFinder::Run is the main function in this singleton class. It 
 	// first aligns all fastq reads to all possible isoforms in a given transcriptome.  
@@ -33,12 +50,26 @@ namespace MOJO
 		//aligment steps
 		ComputePerTask cpt = 
 			ComputePerTask::CalculateComputePerTask(6, 2, c->maxBwaMem);
+		//A resumed run keeps the number of splits it started with, so that
+		//the splits it completed can be reused
+		int n = modExtractUnaligned.NumSplits;
+		if (n > 0 && n != cpt.numSplits) {
+			cpt = ComputePerTask(n, max(1, ComputePerTask::MAX_CPU / n));
+			cpt.numResidualCores = 
+				max(0, ComputePerTask::MAX_CPU - cpt.numCoresPerSplit * n);
+		}
 		BOOST_LOG_CHANNEL(logger::get(), "Main")
 			<< "Extracting unaligned reads in " << cpt.numSplits << " splits";
 
-		if (!modExtractUnaligned.IsComplete) {
-			ExtractUnalignedReads(cpt);
+		bool unalignedReadsExist = true;
+		for (int i = 0; i < cpt.numSplits; i++)
+			if (!Utils::FileExists(GetUnalignedReadsFilename(i)))
+				unalignedReadsExist = false;
+		if (!modExtractUnaligned.IsComplete || !unalignedReadsExist) {
 			modExtractUnaligned.NumSplits = cpt.numSplits;
+			modExtractUnaligned.IsComplete = false;
+			modExtractUnaligned.SaveStatusFile();
+			ExtractUnalignedReads(cpt);
 			modExtractUnaligned.IsComplete = true;
 			modExtractUnaligned.SaveStatusFile();
 		}
@@ -53,7 +84,7 @@ namespace MOJO
 		BOOST_LOG_CHANNEL(logger::get(), "Main") << "Total # of unaligned reads: "
 			<< TotalUnalignedReads;
 		//Parse out the read count;
-		int readcount = c->GetTotalReadcount();
+		long long readcount = c->GetTotalReadcount();
 
 		try{
 			auto sp = Utils::SplitToVector(c->minSpanFunct, ",");
@@ -76,27 +107,16 @@ namespace MOJO
 			<< c->minSpanCount << " (--min_span) or more discordant reads";
 
 		for (int i = 0; i < modExtractUnaligned.NumSplits; i++) {
-			string fq1 = c->workingDir + "fastqs/split_" + lexical_cast<string>(i)
-				+"_unaligned_1.fastq";
-			string fq2 = c->workingDir + "fastqs/split_" + lexical_cast<string>(i)
-				+"_unaligned_2.fastq";
-			if (!Utils::FileExists(fq1) || !Utils::FileExists(fq2)) 
+			string reads = GetUnalignedReadsFilename(i);
+			if (!Utils::FileExists(reads)) 
 				continue;
-			c->ExtractUnaligned_fq1.push_back(fq1);
-			c->ExtractUnaligned_fq2.push_back(fq2);
+			c->ExtractUnaligned_reads.push_back(reads);
 		}
 
-		if (c->ExtractUnaligned_fq1.size() != modExtractUnaligned.NumSplits
-			|| c->ExtractUnaligned_fq1.size() != c->ExtractUnaligned_fq2.size()) {
-			if (modExtractUnaligned.IsComplete)
-				BOOST_LOG_CHANNEL(logger::get(), "Main")
-				<< "Error occurred while trying to resume previously started run. "
-				<< "Unaligned reads are not properly accounted for.  Please delete "
-				<< "output directory and re-run MOJO";
-			else
-				BOOST_LOG_CHANNEL(logger::get(), "Main")
-				<< "Error occurred while extracting aligned reads. Please check "
-				<< "input fastqs";
+		if (c->ExtractUnaligned_reads.size() != modExtractUnaligned.NumSplits) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main")
+			<< "Error occurred while extracting aligned reads. Please check "
+			<< "input fastqs";
 			exit(1);
 		}
 
@@ -105,7 +125,9 @@ namespace MOJO
 
 		BOOST_LOG_CHANNEL(logger::get(), "Main") << "Identifying discordant reads"
 			<< " in " << cpt.numSplits << " splits";
-		if (!modDiscordantFinder.IsComplete) {
+		if (!modDiscordantFinder.IsComplete || 
+			!Utils::FileExists(GetPairsFilename())) 
+		{
 			FindDiscordantReads(cpt);
 			modDiscordantFinder.NumSplits = cpt.numSplits;
 			modDiscordantFinder.IsComplete = true;
@@ -117,19 +139,13 @@ namespace MOJO
 		BOOST_LOG_CHANNEL(logger::get(), "Main") << "Total # of discordant reads: "
 			<< TotalDiscordantReads;
 
-		if (!Utils::FileExists(c->workingDir + "discordant.flat")) {
-			if (modDiscordantFinder.IsComplete)
-				BOOST_LOG_CHANNEL(logger::get(), "Main")
-				<< "Error occurred while trying to resume previously started "
-				<< "run. DicordantReadFinder did not finish successfully.  "
-				<< "Please delete output directory and re-run MOJO";
-			else
-				BOOST_LOG_CHANNEL(logger::get(), "Main")
-				<< "Error occurred while extracting discordant reads ";
+		if (!Utils::FileExists(GetPairsFilename())) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main")
+			<< "Error occurred while extracting discordant reads ";
 			exit(1);
 		}
 
-		if (Utils::LineCount(c->workingDir + "discordant.flat") == 0) {
+		if (DiscordantPairReader(GetPairsFilename()).size() == 0) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main")
 				<< "No discordant reads found. Exiting.";
 			exit(1);
@@ -143,16 +159,52 @@ namespace MOJO
 		Config *c = Config::GetConfig();
 		vector<boost::thread *> threads;
 		boost::filesystem::create_directories(c->workingDir + "/fastqs/");
+
+		//Splits whose checkpoint is still valid are not redone
+		vector<TaskManifest> manifests;
+		vector<bool> isComplete(cpt.numSplits, false);
+		int numToRun = 0;
+		for (int threadId = 0; threadId < cpt.numSplits; threadId++) {
+			manifests.push_back(GetExtractUnalignedManifest(threadId, cpt));
+			isComplete[threadId] = manifests.back().IsValid();
+			if (isComplete[threadId]) {
+				BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tSKIPPING split # "
+					<< threadId << ": detected output from previous run";
+				UpdateUnalignedReadCount(manifests.back().Count);
+			}
+			else {
+				manifests.back().Invalidate();
+				numToRun++;
+			}
+		}
+		if (numToRun == 0)
+			return;
+
 		try {
+			//Both ends are decoded once and streamed into the per-split fifos
+			// that the worker threads below consume
+			for (int end = 1; end <= 2; end++) {
+				string fanOut = Config::GenerateFanOutCmdsForSplits(end, 
+					cpt.numSplits, false, &isComplete);
+				if (Utils::ExecuteCommand(fanOut.c_str(), "Main").exit_code != 0)
+					exit(1);
+			}
 			int residualCores = cpt.numResidualCores;
 			for (int threadId = 0; threadId < cpt.numSplits; threadId++) {
+				if (isComplete[threadId])
+					continue;
 				string threadIdStr = lexical_cast<string>(threadId);
 				string chan = "ExtractUnaligned." + threadIdStr;
 				Logger::RegisterChannel(c->sampleOutputLogDir + chan + ".log", chan);
 				threads.push_back(new boost::thread(ExtractUnalignedReads_worker,
-					threadId, cpt, chan));
+					threadId, cpt, chan, &manifests[threadId]));
 					//threadIdStr, cpt.numCoresPerSplit + (residualCores-- > 0 ? 1 : 0), chan));
 			}
+			//A failed splitter leaves its readers at EOF, or blocked opening
+			// their fifos if it never got that far
+			for (int end = 1; end <= 2; end++)
+				if (!Config::WaitForFanOut(end))
+					exit(1);
 			for (vector<boost::thread *>::size_type j = 0; j < threads.size(); j++) {
 				threads[j]->join();
 				delete threads[j];
@@ -164,26 +216,41 @@ namespace MOJO
 		}
 	}
 
+	TaskManifest DiscordantReadFinder::GetExtractUnalignedManifest(int split,
+		ComputePerTask cpt)
+	{
+		Config *c = Config::GetConfig();
+		stringstream params;
+		params << "split=" << split << "/" << cpt.numSplits 
+			<< ";bowtie2=" << c->bowtie2Path << ";index=" 
+			<< c->bowtie2AllIsoformIndex << ";encoding=" << c->fastqEncodingString
+			<< ";options=--score-min L,-2,-0.2 -k 4";
+		TaskManifest m(c->workingDir + "fastqs/split_" + to_string(split) + 
+			".manifest", params.str());
+		for (auto fq : c->firstEndFastqs)
+			m.AddInput(fq);
+		for (auto fq : c->secondEndFastqs)
+			m.AddInput(fq);
+		return m;
+	}
+
 	void DiscordantReadFinder::ExtractUnalignedReads_worker(int thread, 
-		ComputePerTask cpt, string chan)
+		ComputePerTask cpt, string chan, TaskManifest *manifest)
 	{
 		Config *c = Config::GetConfig();
 		try
 		{
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tStarted split # "
 				<< thread << ". Log: ./logs/" << (chan + ".log[.cmds]");
-			string fq1ss = Config::GenerateCatCmdsForSplit(1, thread, cpt.numSplits);
-			string fq2ss = Config::GenerateCatCmdsForSplit(2, thread, cpt.numSplits);
-			
 			string pfx = c->workingDir + "/fastqs/split_" + 
 				lexical_cast<string>(thread);
 			//Align to an index of all canonical isoforms; filter out all reads concordantly 
 			//aligning to the transcriptome
 			char bt2buf[15000];
-			sprintf(bt2buf, "%s\n %s\n %s -p %d -x %s -1 %s_1.fastq -2 %s_2.fastq "
-				"--dovetail --no-mixed --no-discordant --un-conc "
+			sprintf(bt2buf, "%s -p %d -x %s -1 %s_1.fastq -2 %s_2.fastq "
+				"--reorder --dovetail --no-mixed --no-discordant --un-conc "
 				"%s_unaligned_%%.fastq.tmp --score-min L,-2,-0.2 > /dev/null", 
-				fq1ss.c_str(), fq2ss.c_str(), c->bowtie2Path.c_str(), 
+				c->bowtie2Path.c_str(), 
 				cpt.numCoresPerSplit, c->bowtie2AllIsoformIndex.c_str(), 
 				pfx.c_str(), pfx.c_str(), pfx.c_str());
 
@@ -197,133 +264,130 @@ namespace MOJO
 				<< "First pass alignment to AllIsoformIndex completed";
 
 			//Perform a more rigorous search to remove paired-end reads with each  
-			//end aligning in close proximity (within fragment size) to each other
-			sprintf(bt2buf, "%s -p %d -k 4 -x %s -U %s_unaligned_1.fastq.tmp "
-				" | cut -f 1,3 | grep -v '*' | grep -P -v \"^@\" "
-				"> %s_unaligned_1.align2gene",
-				c->bowtie2Path.c_str(), cpt.numCoresPerSplit, 
-				c->bowtie2AllIsoformIndex.c_str(), pfx.c_str(), pfx.c_str());
-
-			if (Utils::ExecuteCommand(bt2buf, chan).exit_code != 0) exit(1);
-			sprintf(bt2buf, "%s -p %d -k 4 -x %s -U %s_unaligned_2.fastq.tmp "
-				" | cut -f 1,3 | grep -v '*' | grep -P -v \"^@\" "
-				" > %s_unaligned_2.align2gene",
-				c->bowtie2Path.c_str(), cpt.numCoresPerSplit,
-				c->bowtie2AllIsoformIndex.c_str(), pfx.c_str(), pfx.c_str());
-			if (Utils::ExecuteCommand(bt2buf, chan).exit_code != 0) exit(1);
-			BOOST_LOG_CHANNEL(logger::get(), chan) 
-				<< "Second pass alignment to AllIsoformIndex completed";
-
-			//scoping this with the expectation that e1Genes and e2Genes 
-			//will be released after exiting
-			unordered_map<int, bool> concordantReads;
+			//end aligning in close proximity (within fragment size) to each other.
+			//Alignments (reference names are G<geneId>) are parsed as they stream
+			//out of bowtie2; --reorder keeps them, like the fastqs, in read id
+			//order, so both ends are merge-joined: the end 1 hits are spilled to
+			//a binary (readId, geneId) file that is merged with the end 2 
+			//alignments, and the concordant read ids found are in turn merged 
+			//with the fastqs.
+			string e1HitsFile = pfx + "_unaligned_1.genehits";
+			string concordantFile = pfx + "_unaligned.concordant";
+#pragma pack(push, 4)
+			struct GeneHit { ReadId readId; int32_t geneId; };
+#pragma pack(pop)
+			static_assert(sizeof(GeneHit) == 12, "GeneHit spills are 12 bytes");
 			{
-				unordered_map<int, unordered_map<int, bool> > e1Genes;
-				ifstream end1ReadToGeneFile((pfx + "_unaligned_1.align2gene").c_str());
-				ifstream end2ReadToGeneFile((pfx + "_unaligned_2.align2gene").c_str());
-				for (std::string str; getline(end1ReadToGeneFile, str);) {
-					vector<string> sp = Utils::SplitToVector(str, "\t");
-					int readId = stoi(Read::TrimReadName(sp[0]));
-					int geneId = stoi(sp[1].substr(1, sp[1].length() - 1));
-					e1Genes[readId][geneId] = 1;
-				}
-				for (std::string str; getline(end2ReadToGeneFile, str);){
-					vector<string> sp = Utils::SplitToVector(str, "\t");
-					int readId = stoi(Read::TrimReadName(sp[0]));
-					int geneId = stoi(sp[1].substr(1, sp[1].length() - 1));
-					if (e1Genes.find(readId) != e1Genes.end())
-						if (e1Genes[readId].find(geneId) != e1Genes[readId].end())
-							concordantReads[readId] = true;
-				}
-				end1ReadToGeneFile.close();
-				end2ReadToGeneFile.close();
+				FILE *hits = OpenOrExit(e1HitsFile, "wb");
+				GeneHit last = { INVALID_READ_ID, -1 };
+				sprintf(bt2buf, "%s -p %d -k 4 --reorder -x %s -U "
+					"%s_unaligned_1.fastq.tmp", c->bowtie2Path.c_str(), 
+					cpt.numCoresPerSplit, c->bowtie2AllIsoformIndex.c_str(), 
+					pfx.c_str());
+				if (SamStream::Run(bt2buf, chan, [&](const SamRecord &r) {
+					if (!r.IsMapped())
+						return;
+					GeneHit hit = { r.GetReadId(), r.GetRefNumber() };
+					if (hit.readId == last.readId && hit.geneId == last.geneId)
+						return;
+					fwrite(&hit, sizeof(GeneHit), 1, hits);
+					last = hit;
+				}).exit_code != 0) exit(1);
+				fclose(hits);
 			}
-
-			// Process <>_split_unaligned_1.aligned_gene; both ends of .aligned_gene  
-			// are sorted by read name.  Perform intersection of sorted lists.  
-			// Previous version implemented this using hashes
-			/*	
-			vector<string> end1AlignsToGene, end2AlignsToGene, bothAlignsToGene;
-
-			ifstream end1ReadToGeneFile((pfx + "_unaligned_1.align2gene").c_str());
-			ifstream end2ReadToGeneFile((pfx + "_unaligned_2.align2gene").c_str());
-			for (std::string str; getline(end1ReadToGeneFile, str);) {
-				vector<string> sp = Utils::SplitToVector(str, "\t");
-				end1AlignsToGene.push_back(Read::TrimReadName(sp[0]) + "_" + sp[1]);
-			}
-			for (std::string str; getline(end2ReadToGeneFile, str);){
-				vector<string> sp = Utils::SplitToVector(str, "\t");
-				end2AlignsToGene.push_back(Read::TrimReadName(sp[0]) + "_" + sp[1]);
-			}
-			std::set_intersection(end1AlignsToGene.begin(), end1AlignsToGene.end(),
-				end2AlignsToGene.begin(), end2AlignsToGene.end(),
-				std::inserter(bothAlignsToGene, bothAlignsToGene.begin()));
-
-			unordered_map<string, bool> concordantReads;
-			for (auto readName : bothAlignsToGene) {
-				concordantReads[Read::TrimReadName(
-					readName.substr(0, readName.find("||", 0)))] = true;
+			{
+				FILE *hits = OpenOrExit(e1HitsFile, "rb");
+				FILE *concordant = OpenOrExit(concordantFile, "wb");
+				GeneHit e1Hit;
+				ReadId e1Read = 0, lastConcordant = 0;
+				bool haveE1Hit = fread(&e1Hit, sizeof(GeneHit), 1, hits) == 1;
+				vector<int32_t> e1Genes;	//genes hit by end 1 of e1Read
+				sprintf(bt2buf, "%s -p %d -k 4 --reorder -x %s -U "
+					"%s_unaligned_2.fastq.tmp", c->bowtie2Path.c_str(), 
+					cpt.numCoresPerSplit, c->bowtie2AllIsoformIndex.c_str(), 
+					pfx.c_str());
+				if (SamStream::Run(bt2buf, chan, [&](const SamRecord &r) {
+					if (!r.IsMapped())
+						return;
+					ReadId readId = r.GetReadId();
+					if (readId != e1Read) {
+						CheckReadIdOrder(e1Read, readId, "bowtie2 output");
+						e1Read = readId;
+						e1Genes.clear();
+						while (haveE1Hit && e1Hit.readId < readId)
+							haveE1Hit = fread(&e1Hit, sizeof(GeneHit), 1, hits) == 1;
+						while (haveE1Hit && e1Hit.readId == readId) {
+							e1Genes.push_back(e1Hit.geneId);
+							haveE1Hit = fread(&e1Hit, sizeof(GeneHit), 1, hits) == 1;
+						}
+					}
+					int32_t geneId = r.GetRefNumber();
+					if (readId != lastConcordant && std::find(e1Genes.begin(), 
+						e1Genes.end(), geneId) != e1Genes.end()) 
+					{
+						fwrite(&readId, sizeof(ReadId), 1, concordant);
+						lastConcordant = readId;
+					}
+				}).exit_code != 0) exit(1);
+				fclose(hits);
+				fclose(concordant);
 			}
-			*/
+			BOOST_LOG_CHANNEL(logger::get(), chan) 
+				<< "Second pass alignment to AllIsoformIndex completed";
 
-			ofstream end1FqOut((pfx + "_unaligned_1.fastq").c_str(), ios::out);
-			ofstream end2FqOut((pfx + "_unaligned_2.fastq").c_str(), ios::out);
-			//ofstream fqi((pfx + "_unaligned.fastqIndex").c_str(), ios::out);
+			//Non-concordant pairs are kept in a packed (2-bit) reads file, and
+			//the .readID is curated to only include them
+			PackedReadWriter unalOut(pfx + "_unaligned.reads");
+			FILE *concordant = OpenOrExit(concordantFile, "rb");
+			ReadId nextConcordant;
+			bool haveConcordant = 
+				fread(&nextConcordant, sizeof(ReadId), 1, concordant) == 1;
+
+			ifstream allReadIdFile((pfx + "_1.fastq.readID").c_str()); 
+			ofstream unalReadIdFile((pfx + "_unaligned.readID").c_str(), ios::out);
+			string idLine;
+			ReadId idLineId = INVALID_READ_ID;
 
 			FastqParser fpTmp(pfx + "_unaligned_1.fastq.tmp", 
 				pfx + "_unaligned_2.fastq.tmp");
-			long readId = 1;
 			PairedRead pr;
+			ReadId lastReadId = 0;
 			while (fpTmp.GetNextPairedRead(&pr)) {
-				int readId = stoi(pr.FirstRead.GetTrimmedReadName());
-				if (concordantReads.find(readId) != concordantReads.end())
+				ReadId readId = pr.GetReadId();
+				CheckReadIdOrder(lastReadId, readId, pfx + "_unaligned_1.fastq.tmp");
+				lastReadId = readId;
+				while (haveConcordant && nextConcordant < readId)
+					haveConcordant = 
+						fread(&nextConcordant, sizeof(ReadId), 1, concordant) == 1;
+				if (haveConcordant && nextConcordant == readId)
 					continue;
+				unalOut.Write(pr);
 
-				//long long end1Pos = end1FqOut.tellp();
-				//long long end2Pos = end2FqOut.tellp();
-				//fqi << pr.FirstRead.GetTrimmedReadName() << "\t" << readId << "\t"
-				//	<< end1Pos << "\t" << end2Pos << endl;
-				//pr.FirstRead.ReadName = lexical_cast<string>(readId)+"/1";
-				//pr.SecondRead.ReadName = lexical_cast<string>(readId)+"/2";
-
-				char end1buf[500], end2buf[500];
-				pr.FirstRead.GetFastqString(end1buf);
-				pr.SecondRead.GetFastqString(end2buf);
-
-				end1FqOut.write(end1buf, strlen(end1buf));
-				end2FqOut.write(end2buf, strlen(end2buf));
-				readId++;
-			}
-			end1FqOut.close();
-			end2FqOut.close();
-
-			//Finally, curate the .readID to only include unaligned reads;
-			FastqParser *fp = new FastqParser(pfx + "_unaligned_1.fastq",
-				pfx + "_unaligned_2.fastq");
-			
-			unordered_map<int, bool> unalReadIdMap;
-			while (fp->GetNextPairedRead(&pr)) 
-				unalReadIdMap[stoi(pr.GetTrimmedReadName())] = true;
-			
-			ifstream allReadIdFile((pfx + "_1.fastq.readID").c_str(), ios::out); 
-			ofstream unalReadIdFile((pfx + "_unaligned.readID").c_str(), ios::out);
-			for (string str; getline(allReadIdFile, str);) {
-				auto sp = Utils::SplitToVector(str, "\t");
-				if (unalReadIdMap.find(stoi(sp[0])) != unalReadIdMap.end())
-					unalReadIdFile << str << endl;
+				while (idLineId < readId && getline(allReadIdFile, idLine))
+					idLineId = Read::ParseReadId(idLine);
+				if (idLineId == readId)
+					unalReadIdFile << idLine << endl;
 			}
+			unalOut.Close();
+			unalReadIdFile.close();
+			fclose(concordant);
 			
 			if (c->removeTemporaryFiles) {
 				Utils::DeleteFiles(std::vector < string > {
-					pfx + "_unaligned_1.fastq.tmp", pfx + "_unaligned_2.fastq.tmp"});
-				Utils::DeleteFiles(std::vector < string > {pfx + "_unaligned_1.align2gene",
-					pfx + "_unaligned_2.align2gene"});
+					pfx + "_unaligned_1.fastq.tmp", pfx + "_unaligned_2.fastq.tmp",
+					e1HitsFile, concordantFile});
 				Utils::DeleteFile(pfx + "_1.fastq.readID");
 				Utils::DeleteFiles(std::vector < string > {pfx + "_1.fastq",
 					pfx + "_2.fastq"});
 			}
-			int readCount = (Utils::LineCount(pfx + "_unaligned_1.fastq")) / 4;
-			UpdateUnalignedReadCount(readCount);
+			//The split may have been cut short; it must not be checkpointed
+			if (!Config::WaitForFanOut(1) || !Config::WaitForFanOut(2))
+				exit(1);
+			UpdateUnalignedReadCount(unalOut.GetNumPairs());
+			manifest->AddOutput(pfx + "_unaligned.reads");
+			manifest->AddOutput(pfx + "_unaligned.readID");
+			manifest->Count = unalOut.GetNumPairs();
+			manifest->Save();
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tFinished split # " << thread ;
 
 		}
@@ -339,45 +403,71 @@ namespace MOJO
 	{
 		Config *c = Config::GetConfig();
 
-		vector<boost::thread *> threads;
-		int residualCores = cpt.numResidualCores;
-		string alignmentFiles;
-		try {
-			for (int threadId = 0; threadId < cpt.numSplits; threadId++) {
-				string threadIdStr = lexical_cast<string>(threadId);
-				string chan = "DiscordantReads." + threadIdStr;
-				Logger::RegisterChannel(c->sampleOutputLogDir + chan + ".log", chan);
-				threads.push_back(new boost::thread(FindDiscordantReads_worker,
-					threadIdStr, cpt.numCoresPerSplit + 
-					(residualCores-- > 0 ? 1 : 0), chan));
-			}
-			for ( auto thread : threads ) {
-				thread->join();
-				delete thread;
+		//Unaligned reads are cut into many chunks that are scheduled as cores
+		//and memory free up, so that no aligner idles while another is left
+		//with a slow split
+		int numChunks = WriteUnalignedChunks(cpt.numSplits);
+		BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tAligning " << numChunks 
+			<< " chunks of unaligned reads, " << cpt.numSplits << " at a time";
+
+		vector<TaskManifest> manifests;
+		vector<int> pending;
+		for (int chunk = 0; chunk < numChunks; chunk++) {
+			manifests.push_back(GetDiscordantManifest(chunk));
+			if (manifests[chunk].IsValid()) {
+				UpdateDiscordantReadCount(manifests[chunk].Count / 4);
+				continue;
 			}
+			manifests[chunk].Invalidate();
+			pending.push_back(chunk);
+		}
+		if (pending.size() < (size_t)numChunks)
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tSKIPPING " 
+				<< (numChunks - pending.size()) << " chunks: detected output "
+				<< "from previous run";
 
-			//Merge all flat files;
-			stringstream catSS, rmSS;
-			catSS << "cat ";
-			for (int i = 0; i < cpt.numSplits; i++) {
-				catSS << c->workingDir << "split_" << i << "/split_"
-					<< i << ".discordant.flat ";
-				rmSS << "rm " << c->workingDir << "split_" << i << "/split_"
-					<< i << ".discordant.flat " << endl;
-			}
-			catSS << " > " << GetFlatFilename();
-			if (Utils::ExecuteCommand(catSS.str().c_str()).exit_code != 0) {
-				BOOST_LOG_CHANNEL(logger::get(), "Main")
-					<< "Error compiling discordant.flat. Exiting.";
-				exit(1);
+		try {
+			TaskScheduler scheduler;
+			for (int chunk : pending) {
+				string chan = "DiscordantReads." + lexical_cast<string>(chunk);
+				Logger::RegisterChannel(c->sampleOutputLogDir + chan + ".log", chan);
+				int cores = cpt.numCoresPerSplit;
+				TaskManifest *manifest = &manifests[chunk];
+				scheduler.AddTask(chan, cores, c->maxBwaMem, [=]() {
+					FindDiscordantReads_chunk(chunk, cores, chan, manifest);
+				});
 			}
-			Utils::ExecuteCommand(rmSS.str().c_str());
+			scheduler.Run();
 		}
 		catch (std::exception &e) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error occurred while "
 				<< "finding discordant reads. Error: " << e.what();
 		}
 
+		//Each chunk keeps its own pairs file so it can be reused on resume; 
+		//they are concatenated in chunk order
+		DiscordantPairWriter::Create(GetPairsFilename());
+		DiscordantPairWriter discPairs(GetPairsFilename());
+		for (int chunk = 0; chunk < numChunks; chunk++) {
+			DiscordantPairReader chunkPairs(GetChunkPairsFilename(chunk));
+			for (auto &pair : chunkPairs)
+				discPairs.Write(pair);
+		}
+		discPairs.Flush();
+
+		//Chunks that ran deleted their reads; the ones reused from a previous
+		//run had theirs rewritten only to be validated
+		if (c->removeTemporaryFiles) {
+			vector<string> reusedReads;
+			vector<bool> ran(numChunks, false);
+			for (int chunk : pending)
+				ran[chunk] = true;
+			for (int chunk = 0; chunk < numChunks; chunk++)
+				if (!ran[chunk])
+					reusedReads.push_back(GetChunkReadsFilename(chunk));
+			Utils::DeleteFiles(reusedReads);
+		}
+
 		////merge alignments
 		//char cmd[10000];
 		//sprintf(cmd, "%s merge -f -@ %d %s/splits.alignments.bam %s",
@@ -409,39 +499,115 @@ namespace MOJO
 		//}
 	}
 
+	void DiscordantReadFinder::CheckReadIdOrder(ReadId previousId, 
+		ReadId readId, string source)
+	{
+		if (readId < previousId) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: " << source 
+				<< " is not in read id order (" << readId << " after " 
+				<< previousId << "). Exiting.";
+			exit(1);
+		}
+	}
+
+	FILE *DiscordantReadFinder::OpenOrExit(string file, const char *mode)
+	{
+		FILE *fp = fopen(file.c_str(), mode);
+		if (fp == NULL) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot open " 
+				<< file << ". Exiting.";
+			exit(1);
+		}
+		return fp;
+	}
+
+	// Chunks hold up to DISCORDANT_CHUNK_PAIRS consecutive pairs of one
+	// split, so read ids stay in ascending order within each chunk.  The
+	// chunking is deterministic, which keeps chunk checkpoints valid across
+	// resumed runs.
+	int DiscordantReadFinder::WriteUnalignedChunks(int numSplits)
+	{
+		Config *c = Config::GetConfig();
+		boost::filesystem::create_directories(c->workingDir + "chunks");
+		int numChunks = 0;
+		for (int split = 0; split < numSplits; split++) {
+			PackedReadReader reader(GetUnalignedReadsFilename(split));
+			PackedReadWriter *writer = NULL;
+			PairedRead pr;
+			while (reader.GetNextPairedRead(&pr)) {
+				if (writer != NULL && writer->GetNumPairs() >= DISCORDANT_CHUNK_PAIRS) {
+					writer->Close();
+					delete writer;
+					writer = NULL;
+				}
+				if (writer == NULL)
+					writer = new PackedReadWriter(GetChunkReadsFilename(numChunks++));
+				writer->Write(pr);
+			}
+			if (writer != NULL) {
+				writer->Close();
+				delete writer;
+			}
+		}
+		return numChunks;
+	}
+
+	TaskManifest DiscordantReadFinder::GetDiscordantManifest(int chunk)
+	{
+		Config *c = Config::GetConfig();
+		string params = "bwa=" + c->bwaPath + ";index=" + 
+			c->bwaTranscriptomeIndex + ";options=aln -q 15;sampe -A -a 1000 -N 25 "
+			"-c 0.0001 -P;trim=36";
+		TaskManifest m(c->workingDir + "chunk_" + to_string(chunk) + "/chunk_" + 
+			to_string(chunk) + ".manifest", params);
+		m.AddInput(GetChunkReadsFilename(chunk));
+		return m;
+	}
+
 	// Finds discordant reads in two steps. In Step 1, unaligned reads are trimmed
 	// to 36bps and aligned to the transcriptome.  In step 2, unaligned reads in
 	// step 1 are trimmed at the 5' and 3' end to skip a potential splice junction
-	void DiscordantReadFinder::FindDiscordantReads_worker(string thread, int tCores, 
-		string chan)
+	void DiscordantReadFinder::FindDiscordantReads_chunk(int chunk, int tCores, 
+		string chan, TaskManifest *manifest)
 	{
 		Config *c = Config::GetConfig();
 
-		boost::filesystem::create_directories(c->workingDir + "/split_" + thread);
-		BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tStarted split # " << thread
+		string thread = to_string(chunk);
+		boost::filesystem::create_directories(c->workingDir + "/chunk_" + thread);
+		BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tStarted chunk # " << thread
 			<< ". Log: ./logs/" << (chan + ".log[.cmds]");
 		// Trim to 36bps and peform alignments in two steps;
-		string unalFq1 = c->workingDir + "/fastqs/split_" + thread + 
-			"_unaligned_1.fastq";
-		string unalFq2 = c->workingDir + "/fastqs/split_" + thread + 
-			"_unaligned_2.fastq";
-		string unalFqIndex = c->workingDir + "/fastqs/split_" + thread + 
-			"_unaligned.fastqIndex";
+		string unalReads = GetChunkReadsFilename(chunk);
 		//
 		// Iteration 1
 		//
-		string splitPrefix = c->workingDir + "/split_" + thread + 
-			"/split_" + thread + "_iteration1";
+		string splitPrefix = c->workingDir + "/chunk_" + thread + 
+			"/chunk_" + thread + "_iteration1";
 		string iterFq1 = splitPrefix + "_1.fastq", iterFq2 = splitPrefix + "_2.fastq";
-		FastqParser p(unalFq1, unalFq2);
+		FastqParser p(unalReads);
 		p.CreateTrimmedFiles(iterFq1, iterFq2, 36);
 		BOOST_LOG_CHANNEL(logger::get(), DChannel) 
 			<< "Created trimmed fastqs for iteration 1 ";
 		BOOST_LOG_CHANNEL(logger::get(), DChannel) 
 			<< "Starting alignments for iteration 1 ";
 		
+		string statusFile = splitPrefix + ".status";
+		FILE *statusOut = OpenOrExit(statusFile, "wb");
+		string splitPairs = GetChunkPairsFilename(chunk);
+		DiscordantPairWriter::Create(splitPairs);
+		DiscordantPairWriter discPairs(splitPairs);
+		//sampe header and the primary records of the pairs with a discordant
+		// alignment or with both primaries on one gene, kept for inspection
+		FILE *discSam = c->removeTemporaryFiles ? NULL : OpenOrExit(c->workingDir + 
+			"chunk_" + thread + "/chunk_" + thread + ".discordant.sam", "w");
+
 		DiscordantReadFinder::FindDiscordantReads_ByIteration(splitPrefix, thread, 
-			tCores, chan);
+			tCores, chan, &discPairs, discSam, statusOut);
+		if (fclose(statusOut) != 0) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot write "
+				<< statusFile << ". Exiting.";
+			exit(1);
+		}
 		
 		BOOST_LOG_CHANNEL(logger::get(), DChannel) 
 			<< "Completed alignments for iteration 1 ";
@@ -451,77 +617,59 @@ namespace MOJO
 		}
 
 		// Extract unaligned reads from Iteration 1
-		BamReader reader;
-		string iter1Bam = splitPrefix + ".sorted.bam";
-		if (!reader.Open(iter1Bam)) {
-			BOOST_LOG_CHANNEL(logger::get(), "Main")
-				<< "Failed to open " << iter1Bam;
-			exit(1);
-		}
+		FILE *statusFp = OpenOrExit(statusFile, "rb");
 
-		BamAlignment aln;
-
-		// unmappedReads --> <readname> : <which_end> key pair; <which_end> denotes, 
-		//the end that is unaligned and therefore, needs to be slided
-		unordered_map<int, int> unmappedReads;	
-		unordered_map<int, bool> ignoreReads;
-
-		while (reader.GetNextAlignment(aln)){
-			string readName = Read::TrimReadName(aln.Name);
-			int readId = stoi(readName);
-			if (aln.IsMapped() && aln.IsMateMapped()) {
-				//Some alignments have flag 7 set (doesn't make sense) -- exclude those
-				if (aln.IsPaired() && !aln.IsMapped() && aln.IsProperPair()) 
-					ignoreReads[readId] = true;
-				unmappedReads[readId] = 0;	// 0: both ends are aligned;
-			}
-			else 
-				unmappedReads[readId] = aln.IsFirstMate() ? 2 : 1;
-		}
-		reader.Close();
-		FastqParser t(unalFq1, unalFq2);
+		//Iteration 1 pairs are reported in sampe output order, i.e. in read id
+		//order like the unaligned reads, so the two are merge-joined
+		IterationStatus status;
+		bool haveStatus = fread(&status, sizeof(status), 1, statusFp) == 1;
+		FastqParser t(unalReads);
 
 		//Iteration2 parameters;
-		splitPrefix = c->workingDir + "/split_" + thread + "/split_" + 
+		splitPrefix = c->workingDir + "/chunk_" + thread + "/chunk_" + 
 			thread + "_iteration2";
 		iterFq1 = splitPrefix + "_1.fastq", iterFq2 = splitPrefix + "_2.fastq";
-		ofstream end1FqOut(iterFq1.c_str(), ios::out);
-		ofstream end2FqOut(iterFq2.c_str(), ios::out);
+		FastqWriter end1FqOut(iterFq1), end2FqOut(iterFq2);
 		int iteration1_unaligned = 0;
 
 		PairedRead pr;
 		while (t.GetNextPairedRead(&pr)) {
-			int readId = stoi(pr.GetTrimmedReadName());
-			if (ignoreReads.find(readId) != ignoreReads.end())
-				continue;
-			auto result = unmappedReads.find(readId);
-			char buf1[2000], buf2[2000];
-			if (result == unmappedReads.end()) {
-				pr.FirstRead.GetFastqSubstring(buf1, 36, 36);
-				pr.SecondRead.GetFastqSubstring(buf2, 36, 36);
-			}
-			else if ((*result).second == 1) {
-				pr.FirstRead.GetFastqSubstring(buf1, 36, 36);
-				pr.SecondRead.GetFastqSubstring(buf2, 36, 0);
-			}
-			else if ((*result).second == 2){
-				pr.FirstRead.GetFastqSubstring(buf1, 36, 0);
-				pr.SecondRead.GetFastqSubstring(buf2, 36, 36);
+			ReadId readId = pr.GetReadId();
+			// unalignedEnd --> the end that is unaligned and therefore needs to
+			// be slided; 0: both ends are aligned, -1: no alignment
+			int unalignedEnd = -1;
+			while (haveStatus && status.readId <= readId) {
+				if (status.readId == readId)
+					unalignedEnd = status.unalignedEnd;
+				ReadId previousId = status.readId;
+				haveStatus = fread(&status, sizeof(status), 1, statusFp) == 1;
+				if (haveStatus)
+					CheckReadIdOrder(previousId, status.readId, statusFile);
 			}
+
+			int end1Start, end2Start;
+			if (unalignedEnd == -1)
+				end1Start = 36, end2Start = 36;
+			else if (unalignedEnd == 1)
+				end1Start = 36, end2Start = 0;
+			else if (unalignedEnd == 2)
+				end1Start = 0, end2Start = 36;
 			else
 				continue;
 
 			iteration1_unaligned++;
-			end1FqOut.write(buf1, strlen(buf1));
-			end2FqOut.write(buf2, strlen(buf2));
+			end1FqOut.WriteSubstring(pr.FirstRead, 36, end1Start);
+			end2FqOut.WriteSubstring(pr.SecondRead, 36, end2Start);
 		}
-		end1FqOut.close(), end2FqOut.close();
+		fclose(statusFp);
+		end1FqOut.Close(), end2FqOut.Close();
 
 		// Iteration 2
 		if (iteration1_unaligned > 100)  {
 			BOOST_LOG_CHANNEL(logger::get(), chan) 
 				<< "Starting alignments for iteration 2 ";
-			FindDiscordantReads_ByIteration(splitPrefix, thread, tCores, chan);
+			FindDiscordantReads_ByIteration(splitPrefix, thread, tCores, chan,
+				&discPairs, discSam, NULL);
 			BOOST_LOG_CHANNEL(logger::get(), chan) 
 				<< "Completed alignments for iteration 2 ";
 		}
@@ -529,122 +677,34 @@ namespace MOJO
 			BOOST_LOG_CHANNEL(logger::get(), chan) 
 				<< "Skipping iteration 2 (too few unaligned)";
 		}
+		discPairs.Flush();
+		if (discSam != NULL)
+			fclose(discSam);
 
-		// Generate discordant.bam and discordant.flat
-		BamAlignment feAl, seAl;
-		BamWriter discWriter, alnWriter;
-		splitPrefix = c->workingDir + "split_" + thread + "/" + "split_" + thread;
-		discWriter.Open((splitPrefix + ".discordant.bam").c_str(), 
-			reader.GetHeaderText(), reader.GetReferenceData());
-		//alnWriter.Open((splitPrefix + ".alignments.bam").c_str(),
-		//	reader.GetHeaderText(), reader.GetReferenceData());
-		ofstream discFlat((splitPrefix + ".discordant.flat").c_str(), ios::out);
-		FastqParser *unalFp = new FastqParser(unalFq1, unalFq2, unalFqIndex);
-		
-		for (auto iteration : { "1", "2" }){
-			string pairedBam = splitPrefix + "_iteration" + iteration + 
-				".paired.sorted.bam";
-			if (!Utils::FileExists(pairedBam)) continue;
-
-			BamReader iterAlnReader;
-			iterAlnReader.Open(pairedBam.c_str());
-			RefVector headerVect = iterAlnReader.GetReferenceData();
-			unordered_map<string, int> refNameToId;
-			for (int rv = 0; rv < headerVect.size(); rv++)
-				refNameToId[headerVect[rv].RefName] = rv;
-
-			bool skip = false;
-			while (1) {
-				if (!skip && !iterAlnReader.GetNextAlignment(feAl)) break;
-				skip = false;
-				if (!iterAlnReader.GetNextAlignment(seAl)) break;
-
-				if (feAl.Name != seAl.Name) {
-					skip = true;
-					feAl = seAl;
-					continue;
-				}
-				string readname = Read::TrimReadName(feAl.Name);
-				//int readId = stoi(readname);
-				//PairedRead pr = unalFp->GetReadById(readId);
-				//string tagValue = thread + "," + readname + "," 
-				//	+ pr.FirstRead.Sequence + "," + pr.SecondRead.Sequence ;
-				//feAl.AddTag("XJ", "Z", tagValue);
-				//seAl.AddTag("XJ", "Z", tagValue);
-
-				vector<BamAlignment> fAligns = GetBwaAlignsFromXA(feAl, &refNameToId);
-				vector<BamAlignment> sAligns = GetBwaAlignsFromXA(seAl, &refNameToId);
-
-				if (feAl.RefID == seAl.RefID && 
-					(fAligns.size() > 2 || sAligns.size() > 2))
-					continue;
-
-				string uniqueFlag = "0";
-				if (fAligns.size() == 1 && sAligns.size() == 1)
-					uniqueFlag = "1";
-				
-				int readcount = 0;
-				unordered_map<string, bool> genesWritten;  //avoid duplicating the XA tag pairs
-				typedef vector<BamAlignment>::size_type ba_type;
-				for (ba_type f = 0; f < fAligns.size(); f++) {
-					for (ba_type s = 0; s < sAligns.size(); s++) {
-						BamAlignment fe = fAligns[f], se = sAligns[s];
-						if (fe.RefID == se.RefID) {
-							if (f == 0 && s == 0) {
-								discWriter.SaveAlignment(fe);
-								discWriter.SaveAlignment(se);
-							}
-						}
-						else {
-							if (readcount > 0) {
-								fAligns[f].Name = readname + "_" + 
-									lexical_cast<string>(readcount);
-								sAligns[s].Name = readname + "_" + 
-									lexical_cast<string>(readcount);
-							}
-							stringstream key, revKey;
-							key << fAligns[f].RefID << "_" << sAligns[s].RefID;
-							revKey << sAligns[s].RefID << "_" << fAligns[f].RefID;
-
-							if (genesWritten.find(key.str()) != genesWritten.end() || 
-								genesWritten.find(revKey.str()) != genesWritten.end())
-								continue;
-							genesWritten[key.str()] = "";
-							genesWritten[revKey.str()] = "";
-							discWriter.SaveAlignment(fAligns[f]);
-							discWriter.SaveAlignment(sAligns[s]);
-
-							discFlat << BuildFlatReadString(fAligns[f], sAligns[s], 
-								&headerVect);
-							discFlat << "\t" << uniqueFlag << endl;
-							readcount++;
-							if ((fAligns.size() > 3 && sAligns.size() > 3) 
-								|| fAligns.size() > 10 || sAligns.size() > 10)
-								s = sAligns.size(), f = fAligns.size();
-						}
-						//alnWriter.SaveAlignment(feAl);
-						//alnWriter.SaveAlignment(seAl);
-					}
-				}
-			}
-		}
-		discWriter.Close();
-		alnWriter.Close();
-		discFlat.close();
-
+		splitPrefix = c->workingDir + "chunk_" + thread + "/" + "chunk_" + thread;
 		if (c->removeTemporaryFiles) {
 			Utils::DeleteFile(splitPrefix + "_iteration*fastq");
-			Utils::DeleteFile(splitPrefix + "_iteration*sorted.bam");
-			Utils::DeleteFile(splitPrefix + ".discordant.bam");
+			Utils::DeleteFile(statusFile);
+			Utils::DeleteFile(unalReads);
 		}
 
-		int readCount = (Utils::LineCount(splitPrefix + ".discordant.flat")) / 4;
+		int readCount = discPairs.GetNumPairs() / 4;
 		UpdateDiscordantReadCount(readCount);
-		BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tFinished split # " << thread ;
+		manifest->AddOutput(splitPairs);
+		manifest->Count = discPairs.GetNumPairs();
+		manifest->Save();
+		BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tFinished chunk # " << thread;
 	}
 
+	// Aligns the ends of an iteration and pairs the sampe output as it is
+	// produced; pairs with both ends mapped are appended to discPairs, and
+	// when given, statusOut receives the alignment status of every pair with
+	// a mapped end.  discSam, when given, receives the primary records of each
+	// pair that was written or whose primaries map to one gene, after the
+	// header if this is the iteration with a statusOut.
 	void DiscordantReadFinder::FindDiscordantReads_ByIteration(string prefix, 
-		string thread, int tCores, string chan)
+		string thread, int tCores, string chan, DiscordantPairWriter *discPairs,
+		FILE *discSam, FILE *statusOut)
 	{
 		Config *c = Config::GetConfig();
 
@@ -666,36 +726,84 @@ namespace MOJO
 		if (Utils::ExecuteCommand(cmd, chan).exit_code != 0) exit(1);
 		BOOST_LOG_CHANNEL(logger::get(), DChannel) << "Completed aligning second end ";
 
+		//sampe writes both ends of a pair on adjacent lines in input order, so
+		//pairs are consumed straight from its output without a name sort
 		sprintf(cmd, "%s sampe -A -a 1000 -N 25 -c 0.0001 -P %s %s_aln_1.sai %s_aln_2.sai"
-				" %s %s 2> %s_sampe_output.log | %s view -b -S - -o %s.bam",
+				" %s %s 2> %s_sampe_output.log",
 				c->bwaPath.c_str(), c->bwaTranscriptomeIndex.c_str(),  prefix.c_str(), 
-				prefix.c_str(), end1Fq.c_str(), end2Fq.c_str(), prefix.c_str(), 
-				c->samtoolsPath.c_str(), prefix.c_str());
-		if (Utils::ExecuteCommand(cmd, chan).exit_code != 0) exit(1);
-		BOOST_LOG_CHANNEL(logger::get(), DChannel) << "Completed 'bwa sampe' step.";
+				prefix.c_str(), end1Fq.c_str(), end2Fq.c_str(), prefix.c_str());
+
+		XAExpander expander;
+		vector<AlignmentView> fAligns, sAligns;
+		unordered_set<int64_t> genesWritten;	//avoid duplicating the XA tag pairs
+		ReadId previousId = 0;
+		SystemCall sc = SamStream::RunPairs(cmd, chan, 
+			[&](const SamRecord *feAl, const SamRecord *seAl) {
+			ReadId readId = Read::ParseReadId((feAl ? feAl : seAl)->qname.data(),
+				(feAl ? feAl : seAl)->qname.size());
+			if (statusOut != NULL) {
+				CheckReadIdOrder(previousId, readId, prefix + " sampe output");
+				previousId = readId;
+				IterationStatus status;
+				memset(&status, 0, sizeof(status));
+				status.readId = readId;
+				status.unalignedEnd = (feAl && seAl) ? 0 : (feAl ? 2 : 1);
+				if (fwrite(&status, sizeof(status), 1, statusOut) != 1) {
+					BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot "
+						<< "write alignment status of " << prefix << ". Exiting.";
+					exit(1);
+				}
+			}
+			if (feAl == NULL || seAl == NULL)
+				return;
 
-		ComputePerTask cpt = ComputePerTask::CalculateComputePerTask(c->maxCores, 1, 1);
-		sprintf(cmd, "%s view -F 4 -b %s.bam | %s sort -n -@ %d - %s.sorted",
-			c->samtoolsPath.c_str(), prefix.c_str(), c->samtoolsPath.c_str(), 
-			cpt.numSplits, prefix.c_str());
-		if (Utils::ExecuteCommand(cmd, chan).exit_code != 0) exit(1);
+			expander.Expand(*feAl, &fAligns);
+			expander.Expand(*seAl, &sAligns);
+
+			if (feAl->rname == seAl->rname && 
+				(fAligns.size() > 2 || sAligns.size() > 2))
+				return;
+
+			bool isUnique = (fAligns.size() == 1 && sAligns.size() == 1);
+			
+			int readcount = 0;
+			bool primariesOnOneGene = false;
+			genesWritten.clear();
+			typedef vector<AlignmentView>::size_type av_type;
+			for (av_type f = 0; f < fAligns.size(); f++) {
+				for (av_type s = 0; s < sAligns.size(); s++) {
+					const AlignmentView &fe = fAligns[f], &se = sAligns[s];
+					if (fe.refId == se.refId) {
+						primariesOnOneGene |= (f == 0 && s == 0);
+						continue;
+					}
+					int64_t key = ((int64_t)min(fe.refId, se.refId) << 32) | 
+						(uint32_t)max(fe.refId, se.refId);
+					if (!genesWritten.insert(key).second)
+						continue;
+					//RunPairs reports the first end as feAl
+					discPairs->Write(BuildDiscordantPair(fe, 1, se, 2, readId, 
+						readcount, isUnique));
+					readcount++;
+					if ((fAligns.size() > 3 && sAligns.size() > 3) 
+						|| fAligns.size() > 10 || sAligns.size() > 10)
+						s = sAligns.size(), f = fAligns.size();
+				}
+			}
+			if (discSam != NULL && (readcount > 0 || primariesOnOneGene))
+				fprintf(discSam, "%.*s\n%.*s\n", 
+					(int)feAl->line.size(), feAl->line.data(),
+					(int)seAl->line.size(), seAl->line.data());
+		}, [&](boost::string_ref header) {
+			//Both iterations align to the same index; one header is enough
+			if (discSam != NULL && statusOut != NULL)
+				fprintf(discSam, "%.*s\n", (int)header.size(), header.data());
+		});
+		if (sc.exit_code != 0) exit(1);
+		BOOST_LOG_CHANNEL(logger::get(), DChannel) << "Completed 'bwa sampe' step.";
 
 		if (c->removeTemporaryFiles)
-			Utils::DeleteFiles(std::vector < string > { prefix + "*sai", 
-				prefix + ".bam", prefix + ".bam" });
-
-		BamReader reader;
-		BamWriter writer;
-		BamAlignment aln;
-
-		reader.Open((prefix + ".sorted.bam").c_str());
-		writer.Open((prefix + ".paired.sorted.bam").c_str(), 
-			reader.GetHeaderText(), reader.GetReferenceData());
-		while (reader.GetNextAlignment(aln)) 
-			//For some reason, some alignments have flag 7 set (which doesn't make sense) -- exclude those
-			if (!(aln.IsPaired() && !aln.IsMapped() && aln.IsProperPair())) 
-				writer.SaveAlignment(aln);
-		reader.Close(), writer.Close();
+			Utils::DeleteFiles(std::vector < string > { prefix + "*sai" });
 	}
 
 	void DiscordantReadFinder::UpdateUnalignedReadCount(int cnt) 
@@ -710,82 +818,59 @@ namespace MOJO
 		TotalDiscordantReads += cnt;
 	}
 
-
-	//BWA stores alternate alignments in the XA tag, this function retrieve them
-	vector<BamAlignment> DiscordantReadFinder::GetBwaAlignsFromXA(
-		BamAlignment al, unordered_map<string, int> *geneToNameMap) 
+	// discordant.pairs holds all discordant reads identified in the previous
+	// steps, with end A on the gene with the lower id.  Reference ids of the
+	// alignments are gene ids.
+	DiscordantPair DiscordantReadFinder::BuildDiscordantPair(
+		const AlignmentView &fAl, int fMate, const AlignmentView &sAl, int sMate,
+		ReadId readId, int copy, bool isUnique)
 	{
-		struct XASplit 
-		{
-			public:
-				string gene, cigar;
-				int position, nm;
-				XASplit(string alignment) {
-					vector<string> sp = Utils::SplitToVector(alignment, ",");
-					gene = sp[0], cigar = sp[2];
-					// offset by -1 to convert to 0-based offset for bam
-					position = abs(stoi(sp[1])) - 1;
-					nm = stoi(sp[3]);
-			}
-		};
-
-		vector<BamAlignment> aligns;
-		aligns.push_back(al);
-		string xa = "";
-		int nm = 0;
-		al.GetTag("NM", nm);
-		if (al.GetTag("XA", xa)) {
-			vector<string> splits = Utils::SplitToVector(xa, ";");
-			for (vector<string>::size_type i = 0; i < splits.size(); i++) {
-				BamAlignment tmpAl = al;
-				if (splits[i].length() < 2) continue;
-				XASplit s(splits[i]);
-				if (nm < s.nm) continue;
-				tmpAl.RefID = (*geneToNameMap)[s.gene];
-				tmpAl.Position = s.position;
-				aligns.push_back(tmpAl);
-			}
+		const AlignmentView *a = &fAl, *b = &sAl;
+		if (sAl.refId < fAl.refId) {
+			std::swap(a, b);
+			std::swap(fMate, sMate);
 		}
-		return aligns;
+		DiscordantPair p;
+		memset(&p, 0, sizeof(p));
+		p.readId = readId;
+		p.copy = (uint16_t)copy;
+		p.isUnique = isUnique;
+		p.geneA = a->refId;
+		p.positionA = a->position;
+		p.lengthA = a->matchedLength;
+		p.strandA = a->reverseStrand;
+		p.mateA = (uint8_t)fMate;
+		p.geneB = b->refId;
+		p.positionB = b->position;
+		p.lengthB = b->matchedLength;
+		p.strandB = b->reverseStrand;
+		p.mateB = (uint8_t)sMate;
+		return p;
 	}
 
-	// A .flat file contains all discordant reads identified in the previous steps
-	string DiscordantReadFinder::BuildFlatReadString(BamAlignment fAl, 
-		BamAlignment sAl, RefVector *refVect) 
+	string DiscordantReadFinder::GetPairsFilename()
 	{
-		string gA = (*refVect)[fAl.RefID].RefName;
-		string gB = (*refVect)[sAl.RefID].RefName;
-		string posA = lexical_cast<string>(fAl.Position);
-		string posB = lexical_cast<string>(sAl.Position);
-		int lenA = 0, lenB = 0;
-		for (int i = 0; i < fAl.CigarData.size(); i++)
-			if (fAl.CigarData[i].Type == 'M')
-				lenA += fAl.CigarData[i].Length;
-
-		for (int i = 0; i < sAl.CigarData.size(); i++)
-			if (sAl.CigarData[i].Type == 'M')
-				lenB += sAl.CigarData[i].Length;
-		string lenAstr = lexical_cast<string>(lenA);
-		string lenBstr = lexical_cast<string>(lenB);
-		string orientA = "+", orientB = "+";
-
-		if (fAl.IsReverseStrand()) orientA = "-";
-		if (sAl.IsReverseStrand()) orientB = "-";
-
-		string flatA = gA + "\t" + posA + "\t" + lenAstr + "\t" + orientA + "\t" + 
-			lexical_cast<string> (lexical_cast<int> (fAl.IsSecondMate()) + 1);
-		string flatB = gB + "\t" + posB + "\t" + lenBstr + "\t" + orientB + "\t" + 
-			lexical_cast<string> (lexical_cast<int> (sAl.IsSecondMate()) + 1);
-
-		if (gA.compare(gB) < 0)
-			return flatA + "\t" + flatB + "\t" + fAl.Name;
-		else
-			return flatB + "\t" + flatA + "\t" + fAl.Name;
+		Config *c = Config::GetConfig();
+		return c->workingDir + "discordant.pairs";
+	}
+
+	string DiscordantReadFinder::GetChunkPairsFilename(int chunk)
+	{
+		Config *c = Config::GetConfig();
+		return c->workingDir + "chunk_" + to_string(chunk) + "/chunk_" + 
+			to_string(chunk) + ".discordant.pairs";
+	}
+
+	string DiscordantReadFinder::GetChunkReadsFilename(int chunk)
+	{
+		Config *c = Config::GetConfig();
+		return c->workingDir + "chunks/chunk_" + to_string(chunk) + ".reads";
 	}
 
-	string DiscordantReadFinder::GetFlatFilename()
+	string DiscordantReadFinder::GetUnalignedReadsFilename(int split)
 	{
 		Config *c = Config::GetConfig();
-		return c->workingDir + "discordant.flat";
+		return c->workingDir + "fastqs/split_" + to_string(split) + 
+			"_unaligned.reads";
 	}
 };
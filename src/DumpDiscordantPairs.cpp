@@ -0,0 +1,22 @@
+#include <cstdio>
+#include <string>
+#include <iostream>
+
+#include "DiscordantPairs.h"
+
+using namespace std;
+using namespace MOJO;
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		cout << endl << "DumpDiscordantPairs - print a discordant.pairs file as text" << endl << endl;
+		cout << "  Usage: DumpDiscordantPairs <discordant.pairs>" << endl << endl;
+		cout << "  Columns: geneA posA lenA strandA mateA geneB posB lenB strandB mateB read unique" << endl << endl;
+		return 0;
+	}
+	DiscordantPairReader reader(argv[1]);
+	for (const DiscordantPair &pair : reader)
+		printf("%s\n", DiscordantPairReader::ToText(pair).c_str());
+	return 0;
+}
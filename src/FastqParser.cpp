@@ -1,58 +1,144 @@
 
 #include "FastqParser.h"
+#include "Config.h"
 
 namespace MOJO 
 {
 	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
 		(keywords::channel = "Main"));
 
-	// Gets the next read in the fastq file. The new read is returned
-	// in the input argument.  If either the fastqParser is uninitialized or if 
-	// the end of the file is reached, returns false;
-	bool FastqFile::GetNextRead(Read *read)
+	FastqBatchReader::FastqBatchReader(string file, int threads) : 
+		sourceDone(false)
+	{
+		source = new GzipReader(file, threads);
+	}
+
+	FastqBatchReader::~FastqBatchReader()
+	{
+		delete source;
+	}
+
+	// Refills <batch> with the next block of whole records.  The partial
+	// record at the end of a block is carried over to the next one.
+	bool FastqBatchReader::FillBatch(FastqRecordBatch *batch)
+	{
+		string &buf = batch->buffer;
+		batch->records.clear();
+		buf.assign(carry);
+		carry.clear();
+
+		size_t pos = 0;
+		while (batch->records.empty() && !sourceDone) {
+			size_t filled = buf.size();
+			buf.resize(filled + BATCH_BYTES);
+			size_t n = source->Read(&buf[filled], BATCH_BYTES);
+			buf.resize(filled + n);
+			if (n == 0) {
+				if (source->HasFailed()) {
+					BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error reading "
+						<< "fastq: " << source->GetError();
+					exit(1);
+				}
+				sourceDone = true;
+				if (!buf.empty() && buf[buf.size() - 1] != '\n')
+					buf.push_back('\n');
+			}
+
+			const char *data = buf.data();
+			size_t len = buf.size();
+			pos = 0;
+			while (pos < len) {
+				const char *l1 = data + pos;
+				const char *e1 = (const char *)memchr(l1, '\n', len - pos);
+				if (e1 == 0) break;
+				const char *l2 = e1 + 1;
+				const char *e2 = (const char *)memchr(l2, '\n', data + len - l2);
+				if (e2 == 0) break;
+				const char *l3 = e2 + 1;
+				const char *e3 = (const char *)memchr(l3, '\n', data + len - l3);
+				if (e3 == 0) break;
+				const char *l4 = e3 + 1;
+				const char *e4 = (const char *)memchr(l4, '\n', data + len - l4);
+				if (e4 == 0) break;
+
+				if (*l1 == '@')
+					l1++;
+				FastqRecord rec;
+				rec.name = boost::string_ref(l1, e1 - l1);
+				rec.sequence = boost::string_ref(l2, e2 - l2);
+				rec.quality = boost::string_ref(l4, e4 - l4);
+				batch->records.push_back(rec);
+				pos = (e4 + 1) - data;
+			}
+		}
+		//A truncated record at the end of the file is dropped
+		if (!sourceDone)
+			carry.assign(buf, pos, string::npos);
+		return !batch->records.empty();
+	}
+
+	const FastqRecordBatch *FastqBatchReader::GetNextBatch()
+	{
+		return FillBatch(&current) ? &current : 0;
+	}
+
+	FastqFile::~FastqFile()
+	{
+		delete reader;
+		delete fileStreamByPos;
+	}
+
+	// Gets the next record in the fastq file without copying it.  The views in 
+	// <record> stay valid until the next call.  If the end of the file is 
+	// reached, returns false;
+	bool FastqFile::GetNextRecord(FastqRecord *record)
 	{
-		if (fileStream != 0 && EndOfFile()) 
+		if (atEnd)
 			return false;
 
-		if (fileStream == 0) {
+		if (reader == 0) {
 			if (!Utils::FileExists(fileName)) {
 				BOOST_LOG_CHANNEL(logger::get(), "Main")
 					<< "Error occured in FastqFile::GetNextRead(). File '"
 					<< fileName << "' not found";
 				exit(1);
 			}
-			fileStream = new boost::iostreams::filtering_istream();
-			if (fileName.substr(fileName.length() - 2, 2) == "gz") {
-				std::ifstream *ifs = new std::ifstream(fileName.c_str(),
-					std::ios_base::in | std::ios_base::binary);
-				fileStream->push(boost::iostreams::gzip_decompressor());
-				fileStream->push((*ifs));
-			}
-			else {
-				std::ifstream *ifs = new std::ifstream(fileName.c_str());
-				fileStream->push((*ifs));
+			//BGZF input is inflated block-parallel; plain gzip is inflated 
+			//on a background thread ahead of the parser
+			reader = new FastqBatchReader(fileName, 
+				Config::GetConfig()->maxCores);
+		}
+		if (batch == 0 || recordIdx == batch->records.size()) {
+			batch = reader->GetNextBatch();
+			recordIdx = 0;
+			if (batch == 0) {
+				atEnd = true;
+				return false;
 			}
-			fileOpened = true;
 		}
-		string s;
-		if (!std::getline((*fileStream), read->ReadName))
-			return false;
-		if (!std::getline((*fileStream), read->Sequence))
-			return false;
-		if (!std::getline((*fileStream), s))
-			return false;
-		if (!std::getline((*fileStream), read->Quality))
-			return false;
+		(*record) = batch->records[recordIdx++];
+		return true;
+	}
 
-		if ((read->ReadName.c_str())[0] == '@')
-			read->ReadName = read->ReadName.substr(1, read->ReadName.length() - 1);
+	// Gets the next read in the fastq file. The new read is returned
+	// in the input argument.  If either the fastqParser is uninitialized or if 
+	// the end of the file is reached, returns false;
+	bool FastqFile::GetNextRead(Read *read)
+	{
+		FastqRecord rec;
+		if (!GetNextRecord(&rec))
+			return false;
+		read->ReadName.assign(rec.name.data(), rec.name.size());
+		read->Id = Read::ParseReadId(rec.name.data(), rec.name.size());
+		read->Sequence.assign(rec.sequence.data(), rec.sequence.size());
+		read->Quality.assign(rec.quality.data(), rec.quality.size());
 		return true;
 	}
 
-	//Return true if file is opened and is at eof.
+	//Return true if the end of the file has been reached.
 	bool FastqFile::EndOfFile() 
 	{
-		return !(fileStream==0) && fileStream->eof();
+		return atEnd;
 	}
 
 	//Get a paired-end read starting at a specific position in the index file
@@ -76,16 +162,125 @@ namespace MOJO
 		std::getline((*fileStreamByPos), read->Quality);
 		if ((read->ReadName.c_str())[0] == '@')
 			read->ReadName = read->ReadName.substr(1, read->ReadName.length() - 1);
+		read->Id = Read::ParseReadId(read->ReadName);
 		return true;
 	}
 
+	FastqWriter::FastqWriter(string file, bool append) : 
+		fileName(file), buffer(BUFFER_SIZE), used(0)
+	{
+		fp = fopen(file.c_str(), append ? "ab" : "wb");
+		if (fp == NULL) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot open " 
+				<< file << " for writing";
+			exit(1);
+		}
+	}
+
+	FastqWriter::~FastqWriter()
+	{
+		Close();
+	}
+
+	void FastqWriter::Flush()
+	{
+		if (used > 0 && fwrite(&buffer[0], 1, used, fp) != used) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error writing to "
+				<< fileName;
+			exit(1);
+		}
+		used = 0;
+	}
+
+	void FastqWriter::Close()
+	{
+		if (fp != 0) {
+			Flush();
+			fclose(fp);
+			fp = 0;
+		}
+	}
+
+	void FastqWriter::Append(const char *s, size_t len)
+	{
+		if (used + len > buffer.size()) {
+			Flush();
+			if (len > buffer.size())
+				buffer.resize(len);
+		}
+		memcpy(&buffer[used], s, len);
+		used += len;
+	}
+
+	void FastqWriter::Write(const Read &read, int rtrim, int ltrim, 
+		bool convertToSanger)
+	{
+		const string &name = read.ReadName;
+		if (name.length() == 0)
+			return;
+
+		size_t full = read.Sequence.length();
+		size_t start = min<size_t>(ltrim, full);
+		size_t len = full - start;
+		len = (size_t)rtrim >= len ? 0 : len - rtrim;
+		size_t qualLen = read.Quality.length() > start ? 
+			min(len, read.Quality.length() - start) : 0;
+
+		size_t recordLen = 2 * name.length() + len + qualLen + 6;
+		if (used + recordLen > buffer.size()) {
+			Flush();
+			if (recordLen > buffer.size())
+				buffer.resize(recordLen);
+		}
+		char *p = &buffer[used];
+		*p++ = '@';
+		memcpy(p, name.data(), name.length()), p += name.length();
+		*p++ = '\n';
+		memcpy(p, read.Sequence.data() + start, len), p += len;
+		*p++ = '\n';
+		*p++ = '+';
+		memcpy(p, name.data(), name.length()), p += name.length();
+		*p++ = '\n';
+		memcpy(p, read.Quality.data() + start, qualLen);
+		if (convertToSanger)
+			for (size_t i = 0; i < qualLen; i++)
+				p[i] = (char)((int)p[i] - 31);
+		p += qualLen;
+		*p++ = '\n';
+		used = p - &buffer[0];
+	}
+
+	void FastqWriter::WriteSubstring(const Read &read, int maxLength, 
+		int startAt)
+	{
+		auto read_length = read.Sequence.length();
+		string::size_type ltrim, rtrim;
+		if (maxLength > read_length)
+			ltrim = 0, rtrim = 0;
+		else if ((startAt + maxLength) > read_length)
+			ltrim = read_length - maxLength, rtrim = 0;
+		else
+			ltrim = startAt, rtrim = read_length - maxLength - startAt;
+		Write(read, rtrim, ltrim);
+	}
+
 	FastqParser::FastqParser(string firstFile, string secondFile) 
 	{
 		end1File = new FastqFile(firstFile);
 		end2File = new FastqFile(secondFile);
+		packedReads = 0, packedAtEnd = false;
+		if (secondFile == "" && PackedReadReader::IsPackedReadFile(firstFile))
+			packedReads = new PackedReadReader(firstFile);
 		numReads = -1;
 	}
 
+	FastqParser::~FastqParser()
+	{
+		delete end1File;
+		delete end2File;
+		delete packedReads;
+	}
+
 	// Paired-end fastq parser.  Index file contains read id and the SEEK position 
 	// in the index file.  Index file is optional.
 	FastqParser::FastqParser(string firstFile, string secondFile, string indexFile)
@@ -98,6 +293,7 @@ namespace MOJO
 		}
 		end1File = new FastqFile(firstFile);
 		end2File = new FastqFile(secondFile);
+		packedReads = 0, packedAtEnd = false;
 
 		typedef fstream::pos_type fposType;
 		ifstream fqIndFile(indexFile.c_str());
@@ -128,12 +324,11 @@ namespace MOJO
 	void FastqParser::CreateTrimmedFiles(string firstEndOutFile, 
 		string secondEndOutFile,  int maxLength, int startAt)
 	{
-		ofstream firstOut(firstEndOutFile.c_str(), ios::out | ios::app);
-		ofstream secondOut(secondEndOutFile.c_str(), ios::out | ios::app);
+		FastqWriter firstOut(firstEndOutFile, true);
+		FastqWriter secondOut(secondEndOutFile, true);
 
 		PairedRead pr;
 		while (GetNextPairedRead(&pr)) {
-			char firstBuf[2000], secondBuf[2000];
 			auto read_length = pr.FirstRead.Sequence.length();
 			string::size_type ltrim, rtrim;
 
@@ -143,7 +338,7 @@ namespace MOJO
 				ltrim = read_length - maxLength, rtrim = 0;
 			else
 				ltrim = startAt, rtrim = read_length - maxLength - startAt;
-			pr.FirstRead.GetFastqString(firstBuf, rtrim, ltrim, false);
+			firstOut.Write(pr.FirstRead, rtrim, ltrim, false);
 
 			read_length = pr.SecondRead.Sequence.length();
 			if (maxLength > read_length)
@@ -152,10 +347,7 @@ namespace MOJO
 				ltrim = read_length - maxLength, rtrim = 0;
 			else
 				ltrim = startAt, rtrim = read_length - maxLength - startAt;
-
-			pr.SecondRead.GetFastqString(secondBuf, rtrim, ltrim, false);
-			firstOut.write(firstBuf, strlen(firstBuf));
-			secondOut.write(secondBuf, strlen(secondBuf));
+			secondOut.Write(pr.SecondRead, rtrim, ltrim, false);
 		}
 	}
 	
@@ -173,17 +365,58 @@ namespace MOJO
 	// read in the fastq file
 	bool FastqParser::GetNextPairedRead(PairedRead *pr) 
 	{
+		if (packedReads != 0) {
+			packedAtEnd = !packedReads->GetNextPairedRead(pr);
+			return !packedAtEnd;
+		}
+		FastqRecord first, second;
+		pr->FirstRead.alignments.clear();
+		pr->SecondRead.alignments.clear();
+		if (!GetNextPairedRecord(&first, &second)) {
+			pr->Initialize();
+			return false;
+		}
+		pr->FirstRead.ReadName.assign(first.name.data(), first.name.size());
+		pr->FirstRead.Id = Read::ParseReadId(first.name.data(), first.name.size());
+		pr->FirstRead.Sequence.assign(first.sequence.data(), first.sequence.size());
+		pr->FirstRead.Quality.assign(first.quality.data(), first.quality.size());
+		pr->SecondRead.ReadName.assign(second.name.data(), second.name.size());
+		pr->SecondRead.Id = pr->FirstRead.Id;
+		pr->SecondRead.Sequence.assign(second.sequence.data(), 
+			second.sequence.size());
+		pr->SecondRead.Quality.assign(second.quality.data(), 
+			second.quality.size());
+		return true;
+	}
+
+	// Zero-copy variant of GetNextPairedRead; views stay valid until the next
+	// call
+	bool FastqParser::GetNextPairedRecord(FastqRecord *first, 
+		FastqRecord *second)
+	{
+		if (packedReads != 0) {
+			if (!GetNextPairedRead(&packedPair))
+				return false;
+			first->name = packedPair.FirstRead.ReadName;
+			first->sequence = packedPair.FirstRead.Sequence;
+			first->quality = packedPair.FirstRead.Quality;
+			second->name = packedPair.SecondRead.ReadName;
+			second->sequence = packedPair.SecondRead.Sequence;
+			second->quality = packedPair.SecondRead.Quality;
+			return true;
+		}
 		//Expectation is that first and second end files exist;
-		pr->Initialize();
-		if (!end1File->GetNextRead(&pr->FirstRead))
+		if (!end1File->GetNextRecord(first))
 			return false;
-		if (!end2File->GetNextRead(&pr->SecondRead))
+		if (!end2File->GetNextRecord(second))
 			return false;
 		return true;
 	}
 
 	bool FastqParser::EndOfFile() 
 	{
+		if (packedReads != 0)
+			return packedAtEnd;
 		if (end1File->EndOfFile() || end2File->EndOfFile())
 			return true;
 		return false;
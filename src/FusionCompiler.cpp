@@ -59,7 +59,8 @@ namespace MOJO
 					j->GetTotalARCount(true) == 0)
 					continue;
 
-				string s5 = j->ex5p->sequence, s3 = j->ex3p->sequence;
+				string s5 = j->ex5p->sequence.to_string(), 
+					s3 = j->ex3p->sequence.to_string();
 				if (s5.size() > 20 && s3.size() > 20) {
 					double entropy5p =
 						GetDinucleotideEntropy(s5.substr(s5.length() - 20, 20));
@@ -92,13 +93,12 @@ namespace MOJO
 		//junction with highest number of unqiue discordant reads, # of high 
 		//conf anchor reads or just # of anchor reads
 		try {
-			unordered_map<string, vector<Junction *> > arToJ;
+			unordered_map<ReadId, vector<Junction *> > arToJ;
 			for (auto j : resultsJunctions) {
 				for (auto a : j->anchorReads) {
 					if (a->isSpurious)
 						continue;
-					string rnm = a->splitRead.GetTrimmedReadName();
-					arToJ[a->splitRead.GetTrimmedReadName()].push_back(j);
+					arToJ[a->splitRead.Id].push_back(j);
 				}
 			}
 			for (auto arj : arToJ){
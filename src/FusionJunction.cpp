@@ -160,10 +160,10 @@ namespace MOJO
 			ar->isSpurious = true;
 	}
 
-	void Junction::MarkARspurious(string trimmedReadName)
+	void Junction::MarkARspurious(ReadId readId)
 	{
 		for (auto ar : anchorReads)
-			if (ar->splitRead.GetTrimmedReadName() == trimmedReadName)
+			if (ar->splitRead.Id == readId)
 				ar->isSpurious = true;
 	}
 
@@ -382,8 +382,9 @@ namespace MOJO
 
 		bool fExonFound = false;
 		for (auto ex : fIsoform->exons){
-			string exSeq = (ex->gene->strand == "+" ? ex->sequence : 
-				Utils::ReverseComplement(ex->sequence));
+			string exSeq = ex->sequence.to_string();
+			if (ex->gene->strand != "+")
+				exSeq = Utils::ReverseComplement(exSeq);
 			fragment += exSeq;
 			if (ex == fExon) {
 				if (ex->gene->strand == "+" && fragType == FIVE_P)
@@ -1,5 +1,6 @@
 
 #include "FusionQuant.h"
+#include "TaskScheduler.h"
 
 namespace MOJO 
 {
@@ -8,23 +9,21 @@ namespace MOJO
 
 	FusionQuant FusionQuant::FQ;
 
-	PairedBamAlignment::PairedBamAlignment(BamAlignment a1, BamAlignment a2)
+	BamAlignmentEnd BamAlignmentEnd::FromRecord(const BamAlignment &aln)
 	{
-		fAln.position = a1.Position;
-		fAln.alignedLength = a1.Qualities.size();
-		fAln.readId = stoi(Read::TrimReadName(a1.Name));
-		fAln.end = 0;
-		if (a1.Name[a1.Name.length() - 2] == '/')
-			fAln.end = (a1.Name.back() == '1') ? 1 : 2;
-
-		sAln.position = a2.Position;
-		sAln.alignedLength = a2.Qualities.size();
-		sAln.readId = stoi(Read::TrimReadName(a2.Name));
-		sAln.end = 0;
-		if (a2.Name[a2.Name.length() - 2] == '/')
-			sAln.end = (a2.Name.back() == '1') ? 1 : 2;
+		BamAlignmentEnd e;
+		e.position = aln.Position;
+		e.alignedLength = aln.Qualities.size();
+		e.readId = Read::ParseReadId(aln.Name);
+		e.end = 0;
+		if (aln.Name[aln.Name.length() - 2] == '/')
+			e.end = (aln.Name.back() == '1') ? 1 : 2;
+		return e;
 	}
 
+	PairedBamAlignment::PairedBamAlignment(BamAlignmentEnd a1, BamAlignmentEnd a2)
+		: fAln(a1), sAln(a2) {}
+
 	FusionQuant::FusionQuant()
 	{
 		
@@ -60,7 +59,6 @@ namespace MOJO
 				Gene *g5p = j->ex5p->gene, *g3p = j->ex3p->gene;
 				if (processed.find(g5p->geneId) == processed.end()) {
 					for (auto iso : g5p->isoforms){
-						iso->GetTranscript();
 						faStream << ">" << iso->isoformIdStr << endl;
 						faStream << GetPaddingSeq();
 						faStream << iso->GetTranscript();
@@ -70,7 +68,6 @@ namespace MOJO
 
 				if (processed.find(g3p->geneId) == processed.end()) {
 					for (auto iso : g3p->isoforms){
-						iso->GetTranscript();
 						faStream << ">" << iso->isoformIdStr << endl;
 						faStream << GetPaddingSeq();
 						faStream << iso->GetTranscript();
@@ -89,21 +86,50 @@ namespace MOJO
 			}
 
 			//Run alignments in max of n-splits;
-			vector<boost::thread *> threads;
 			string alignmentFiles;
 			try {
 				ComputePerTask cpt = 
 					ComputePerTask::CalculateComputePerTask(6, 2, 2);
-				for (int threadId = 0; threadId < cpt.numSplits; threadId++) {
-					threads.push_back(
-						new boost::thread(FindFusionGeneMappingReads_worker,
-						threadId, cpt, mapFa));
+				for (int threadId = 0; threadId < cpt.numSplits; threadId++)
 					alignmentFiles += mapFa + "_" + to_string(threadId) + ".bam ";
+				//Steps: aln end 1, aln end 2, sampe.  Each step reads the fastqs
+				// once through a fan-out shared by all splits of that step, so
+				// the splits of a step must run together; cpt guarantees they
+				// fit in the budget at once.
+				TaskScheduler scheduler;
+				vector<TaskScheduler::TaskId> prevStep;
+				for (int step = 1; step <= 3; step++) {
+					auto fanOutTask = scheduler.AddTask(
+						"FusionQuant.fanout." + to_string(step), 0, 0, [=]() {
+						for (int end = 1; end <= 2; end++) {
+							if (step != 3 && step != end)
+								continue;
+							string fanOut = Config::GenerateFanOutCmdsForSplits(end,
+								cpt.numSplits, true);
+							Utils::ExecuteCommand(fanOut.c_str(), "Main", true, 
+								EXIT_ON_FAIL);
+						}
+					}, prevStep);
+					//Runs beside the readers; fails the run if a splitter did
+					auto fanOutWait = scheduler.AddTask(
+						"FusionQuant.fanout.wait." + to_string(step), 0, 0, [=]() {
+						for (int end = 1; end <= 2; end++) {
+							if (step != 3 && step != end)
+								continue;
+							if (!Config::WaitForFanOut(end))
+								exit(1);
+						}
+					}, vector<TaskScheduler::TaskId>{ fanOutTask });
+					prevStep.assign(1, fanOutWait);
+					for (int threadId = 0; threadId < cpt.numSplits; threadId++) {
+						prevStep.push_back(scheduler.AddTask("FusionQuant.step." +
+							to_string(step) + "." + to_string(threadId),
+							cpt.numCoresPerSplit, 2, [=]() {
+							FindFusionGeneMappingReads_worker(threadId, step, cpt, mapFa);
+						}, vector<TaskScheduler::TaskId>{ fanOutTask }));
+					}
 				}
-				for (auto thread : threads) {
-					thread->join();
-					delete thread;
-				}
+				scheduler.Run();
 				//Merge all alignments;
 				if (cpt.numSplits == 1) {
 					//just rename the file
@@ -155,49 +181,49 @@ namespace MOJO
 		BamAlignment aln1, aln2;
 		reader.Open((mapFa + ".sorted.bam").c_str());
 		RefVector headerVect = reader.GetReferenceData();
-		unordered_map<string, int> refNameToId;
-		for (int rv = 0; rv < headerVect.size(); rv++)
-			refNameToId[headerVect[rv].RefName] = rv;
+		XAExpander expander(headerVect);
+		vector<AlignmentView> aln1_vect, aln2_vect;
 
 		while (reader.GetNextAlignment(aln1)) {
 			reader.GetNextAlignment(aln2);
-			while (Read::TrimReadName(aln1.Name) != Read::TrimReadName(aln2.Name))
+			while (Read::ParseReadId(aln1.Name) != Read::ParseReadId(aln2.Name))
 			{
 				aln1 = aln2;
 				reader.GetNextAlignment(aln2);
 			}
 			bool isConcordant = (aln1.RefID == aln2.RefID) ? true : false;
-			string readname = Read::TrimReadName(aln1.Name);
-			auto aln1_vect =
-				DiscordantReadFinder::GetBwaAlignsFromXA(aln1, &refNameToId);
-			auto aln2_vect =
-				DiscordantReadFinder::GetBwaAlignsFromXA(aln2, &refNameToId);
+			expander.Expand(aln1, &aln1_vect);
+			expander.Expand(aln2, &aln2_vect);
+			//Alternatives only move the read, so each end is built once
+			BamAlignmentEnd end1 = BamAlignmentEnd::FromRecord(aln1);
+			BamAlignmentEnd end2 = BamAlignmentEnd::FromRecord(aln2);
 			
 			unordered_map<string, bool> doneLoading;
-			for (auto a : aln1_vect) {
-				for (auto b : aln2_vect){
-					if (isConcordant && a.RefID != b.RefID)
+			for (auto &a : aln1_vect) {
+				for (auto &b : aln2_vect){
+					if (isConcordant && a.refId != b.refId)
 						continue;
 
-					string a_id_str = to_string(a.RefID);
-					string b_id_str = to_string(b.RefID);
+					string a_id_str = to_string(a.refId);
+					string b_id_str = to_string(b.refId);
 					string key = a_id_str + "_" + b_id_str;
-					if (a.RefID > b.RefID)
+					if (a.refId > b.refId)
 						key = b_id_str + "_" + a_id_str;
 					if (doneLoading.find(key) != doneLoading.end())
 						continue;
 					doneLoading[key] = true;
 
-					BamAlnPair p(a, b);
-					PairedBamAlignment *pa = new PairedBamAlignment(a, b);
-					pa->fExon = FindExonsMappedByRead(a, headerVect[a.RefID].RefName);
-					pa->sExon = FindExonsMappedByRead(b, headerVect[b.RefID].RefName);
-					pa->fIso = gm->IsoformsMap[headerVect[a.RefID].RefName];
-					pa->sIso = gm->IsoformsMap[headerVect[a.RefID].RefName];
+					end1.position = a.position;
+					end2.position = b.position;
+					PairedBamAlignment *pa = new PairedBamAlignment(end1, end2);
+					pa->fExon = FindExonsMappedByRead(end1, headerVect[a.refId].RefName);
+					pa->sExon = FindExonsMappedByRead(end2, headerVect[b.refId].RefName);
+					pa->fIso = gm->IsoformsMap[headerVect[a.refId].RefName];
+					pa->sIso = gm->IsoformsMap[headerVect[a.refId].RefName];
 					if (pa->fExon == 0 || pa->sExon == 0)
 						continue;
-					Isoform *isoA = gm->IsoformsMap[headerVect[a.RefID].RefName];
-					Isoform *isoB = gm->IsoformsMap[headerVect[b.RefID].RefName];
+					Isoform *isoA = gm->IsoformsMap[headerVect[a.refId].RefName];
+					Isoform *isoB = gm->IsoformsMap[headerVect[b.refId].RefName];
 
 					string gKey = to_string(isoA->gene->geneId) + "_" +
 						to_string(isoB->gene->geneId);
@@ -216,15 +242,11 @@ namespace MOJO
 	}
 
 	void FusionQuant::FindFusionGeneMappingReads_worker(int threadId,
-		ComputePerTask cpt, string mapFa)
+		int step, ComputePerTask cpt, string mapFa)
 	{
 		Config *c = Config::GetConfig();
 		try
 		{
-			string end1Fifo = Config::GenerateCatCmdsForSplit(1, threadId, 
-				cpt.numSplits, true);
-			string end2Fifo = Config::GenerateCatCmdsForSplit(2, threadId, 
-				cpt.numSplits, true);
 			string end1Fq = c->workingDir + "/fastqs/split_" + 
 				to_string(threadId) + "_1.fastq";
 			string end2Fq = c->workingDir + "/fastqs/split_" + 
@@ -232,26 +254,30 @@ namespace MOJO
 
 			char cmd[25000];
 			//Align all reads to this 'fusion' transcriptome
-			sprintf(cmd, "%s \n %s aln -q 15 -R 100 -t %d %s %s > " 
-				"%s_%d_aln_1.sai 2> %s_%d_aln_1_output.log ",
-				end1Fifo.c_str(), c->bwaPath.c_str(), c->maxCores, mapFa.c_str(), 
-				end1Fq.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId);
-			Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
-
-			sprintf(cmd, "%s \n %s aln -q 15 -R 100 -t %d %s %s > "
-				"%s_%d_aln_2.sai 2> %s_%d_aln_2_output.log ",
-				end2Fifo.c_str(), c->bwaPath.c_str(), c->maxCores, mapFa.c_str(), 
-				end2Fq.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId);
-			Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
-
-			sprintf(cmd, "%s \n%s \n%s sampe -A -a 1000 -n 250 -N 250 -c 0.0001" 
-				" -P %s %s_%d_aln_1.sai %s_%d_aln_2.sai %s %s 2> "
-				" %s_%d_sampe_output.log |  %s view -F 12 -b -S - -o %s_%d.bam ",
-				end1Fifo.c_str(), end2Fifo.c_str(), c->bwaPath.c_str(), 
-				mapFa.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId, 
-				end1Fq.c_str(), end2Fq.c_str(), mapFa.c_str(), threadId, 
-				c->samtoolsPath.c_str(), mapFa.c_str(), threadId);
-			Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
+			if (step == 1) {
+				sprintf(cmd, "%s aln -q 15 -R 100 -t %d %s %s > "
+					"%s_%d_aln_1.sai 2> %s_%d_aln_1_output.log ",
+					c->bwaPath.c_str(), cpt.numCoresPerSplit, mapFa.c_str(), 
+					end1Fq.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId);
+				Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
+			}
+			else if (step == 2) {
+				sprintf(cmd, "%s aln -q 15 -R 100 -t %d %s %s > "
+					"%s_%d_aln_2.sai 2> %s_%d_aln_2_output.log ",
+					c->bwaPath.c_str(), cpt.numCoresPerSplit, mapFa.c_str(), 
+					end2Fq.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId);
+				Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
+			}
+			else {
+				sprintf(cmd, "%s sampe -A -a 1000 -n 250 -N 250 -c 0.0001" 
+					" -P %s %s_%d_aln_1.sai %s_%d_aln_2.sai %s %s 2> "
+					" %s_%d_sampe_output.log |  %s view -F 12 -b -S - -o %s_%d.bam ",
+					c->bwaPath.c_str(), 
+					mapFa.c_str(), mapFa.c_str(), threadId, mapFa.c_str(), threadId, 
+					end1Fq.c_str(), end2Fq.c_str(), mapFa.c_str(), threadId, 
+					c->samtoolsPath.c_str(), mapFa.c_str(), threadId);
+				Utils::ExecuteCommand(cmd, "Main", true, EXIT_ON_FAIL);
+			}
 		}
 		catch (std::exception &e)
 		{
@@ -262,11 +288,12 @@ namespace MOJO
 		}
 	}
 
-	Exon* FusionQuant::FindExonsMappedByRead(BamAlignment aln, string name)
+	Exon* FusionQuant::FindExonsMappedByRead(const BamAlignmentEnd &aln,
+		const string &name)
 	{
 		GeneModel *gm = GeneModel::GetGeneModel();
-		int start = aln.Position - PAD_LENGTH;
-		int end = aln.Position + aln.Qualities.size() - PAD_LENGTH;
+		int start = aln.position - PAD_LENGTH;
+		int end = aln.position + aln.alignedLength - PAD_LENGTH;
 
 		Isoform *iso = gm->IsoformsMap[name];
 		if (iso->GetStrand() == "-") {
@@ -321,9 +348,9 @@ namespace MOJO
 		downExonsA.erase(j->ex5p->exonId);
 		upExonsB.erase(j->ex3p->exonId);
 
-		unordered_map<int, unordered_map<int, bool> > exonToRead;
-		unordered_map<int, bool> concordAA_JunctReads, concordBB_JunctReads;
-		unordered_map<int, bool> concordAA_SpanReads, concordBB_SpanReads;
+		unordered_map<int, unordered_map<ReadId, bool> > exonToRead;
+		unordered_map<ReadId, bool> concordAA_JunctReads, concordBB_JunctReads;
+		unordered_map<ReadId, bool> concordAA_SpanReads, concordBB_SpanReads;
 		for (auto pba : geneAlnsConcordant[to_string(gA->geneId)]){
 			exonToRead[pba->fExon->exonId][pba->GetReadId()] = true;
 			exonToRead[pba->sExon->exonId][pba->GetReadId()] = true;
@@ -379,7 +406,7 @@ namespace MOJO
 			exonToRead[pba->sExon->exonId][pba->GetReadId()] = true;
 		}
 
-		unordered_map<int, bool> upReadsA, downReadsA, upReadsB, downReadsB;
+		unordered_map<ReadId, bool> upReadsA, downReadsA, upReadsB, downReadsB;
 		for (auto eTR : exonToRead) {
 			for (auto read : eTR.second) {
 				if (upExonsA.find(eTR.first) != upExonsA.end())
@@ -431,10 +458,10 @@ namespace MOJO
 			}
 		}
 
-		int gA_5p_len = gA->GetPartialTranscript(j->ex5p, FRAG_TYPE::FIVE_P).length();
-		int gA_3p_len = gA->GetPartialTranscript(j->ex5p, FRAG_TYPE::THREE_P).length();
-		int gB_5p_len = gB->GetPartialTranscript(j->ex3p, FRAG_TYPE::FIVE_P).length();
-		int gB_3p_len = gB->GetPartialTranscript(j->ex3p, FRAG_TYPE::THREE_P).length();
+		int gA_5p_len = gA->GetPartialTranscriptLength(j->ex5p, FRAG_TYPE::FIVE_P);
+		int gA_3p_len = gA->GetPartialTranscriptLength(j->ex5p, FRAG_TYPE::THREE_P);
+		int gB_5p_len = gB->GetPartialTranscriptLength(j->ex3p, FRAG_TYPE::FIVE_P);
+		int gB_3p_len = gB->GetPartialTranscriptLength(j->ex3p, FRAG_TYPE::THREE_P);
 		int gA_len = gA_5p_len + gA_3p_len;
 		int gB_len = gB_5p_len + gB_3p_len;
 
@@ -7,14 +7,26 @@ namespace MOJO
 		(keywords::channel = ""));
 
 	GeneModel GeneModel::gm;
-	map<string, map<int, Gene*> > GeneModel::chromGenesRefSeq;
+	unordered_map<string, IntervalIndex> GeneModel::chromGeneIndex;
+	boost::once_flag GeneModel::chromGeneIndexOnce = BOOST_ONCE_INIT;
 	
 	//Loads the transcriptome model into memory.
 	void GeneModel::LoadGeneModel(){
-		Config *c = Config::GetConfig();
-
 		BOOST_LOG_CHANNEL(logger::get(), "Main") 
 			<< "Loading transcriptome annotation...";
+		if (!LoadGeneModelFromBundle())
+			LoadGeneModelFromText();
+		ValidateGeneModelsIntegrity();
+		for (auto iter = GenesMap.begin(); iter != GenesMap.end(); iter++) {
+			(*iter).second->BuildExonIndex();
+			(*iter).second->repeatRegions.Build();
+		}
+		IsGeneModelLoaded = true;
+	}
+
+	void GeneModel::LoadGeneModelFromText(){
+		Config *c = Config::GetConfig();
+
 		//Load Genes;
 		try {
 			ifstream geneFile(c->masterGeneFile.c_str());
@@ -64,9 +76,16 @@ namespace MOJO
 		}
 		BOOST_LOG_CHANNEL(logger::get(), "Main") 
 			<< "\t" << IsoformsMap.size() << " isoforms";
-		//Load Exons;
+		//Load Exons; their sequences are appended to exonSequences and
+		//pointed to once it no longer moves
+		vector<Exon *> exons;
+		vector<size_t> sequenceStarts;
 		try {
 			ifstream exonFile(c->masterExonFile.c_str());
+			exonSequences.clear();
+			if (Utils::FileExists(c->masterExonFile))
+				exonSequences.reserve(
+					boost::filesystem::file_size(c->masterExonFile));
 			for (std::string str; getline(exonFile, str);) {
 				auto sp = Utils::SplitToVector(str, "\r\t");
 				Gene *gene = GetGeneFromMap(sp[1]);
@@ -82,9 +101,15 @@ namespace MOJO
 				ex->exEnd = stoi(sp[3]);
 				ex->exStart_genomic = stoi(sp[4]);
 				ex->exEnd_genomic = stoi(sp[5]);
-				ex->sequence = sp[6];
+				exons.push_back(ex);
+				sequenceStarts.push_back(exonSequences.size());
+				exonSequences += sp[6];
 				ExonsMap[ex->exonId] = ex;
 			}
+			sequenceStarts.push_back(exonSequences.size());
+			for (size_t i = 0; i < exons.size(); i++)
+				exons[i]->sequence = boost::string_ref(exonSequences.data() + 
+					sequenceStarts[i], sequenceStarts[i + 1] - sequenceStarts[i]);
 		}
 		catch (std::exception &e) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main") 
@@ -117,6 +142,11 @@ namespace MOJO
 				std::sort(gene->allExons.begin(), gene->allExons.end(), 
 					Exon::compareExons);
 			}
+			//the id lists are only needed for linking
+			for (auto iter = GenesMap.begin(); iter != GenesMap.end(); iter++)
+				vector<string>().swap((*iter).second->isoformsStrVect);
+			for (auto iter = IsoformsMap.begin(); iter != IsoformsMap.end(); iter++)
+				vector<string>().swap((*iter).second->exonsStrVect);
 		}
 		catch (std::exception &e) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error building GeneModels "
@@ -161,13 +191,10 @@ namespace MOJO
 					gB_str = sp[1];
 					gB = GetGeneFromMap(gB_str);
 				}
-				CoordinatePair cpA(stoi(sp[2]), stoi(sp[3]),
-					stoi(sp[4]), stoi(sp[5]));
-				gA->blastHits[gB->geneId].push_back(cpA);
-				CoordinatePair cpB(stoi(sp[4]), stoi(sp[5]),
-					stoi(sp[2]), stoi(sp[3]));
-				gB->blastHits[gA->geneId].push_back(cpB);
+				homology.Add(gA->geneId, stoi(sp[2]), stoi(sp[3]),
+					gB->geneId, stoi(sp[4]), stoi(sp[5]));
 			}
+			homology.Build();
 		}
 		catch (std::exception &e) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main") 
@@ -186,8 +213,7 @@ namespace MOJO
 				// this happens because of an inconsistency in MOJORefBuilder -- to fix
 				if (g == 0) 
 					continue;
-				pair<int, int> p(stoi(sp[2]) - 18, stoi(sp[3]) + 18);
-				g->repeatRegions.push_back(p);
+				g->repeatRegions.Add(stoi(sp[2]) - 18, stoi(sp[3]) + 18);
 			}
 		}
 		catch (std::exception &e) {
@@ -196,10 +222,136 @@ namespace MOJO
 				<< endl << "Error: " << e.what();
 			exit(1);
 		}
-		ValidateGeneModelsIntegrity();
-		IsGeneModelLoaded = true;
 	} 
 
+	bool GeneModel::LoadGeneModelFromBundle(){
+		Config *c = Config::GetConfig();
+		vector<string> sources(NUM_BUNDLE_SOURCES);
+		sources[GENE_SOURCE] = c->masterGeneFile;
+		sources[ISOFORM_SOURCE] = c->masterIsoformFile;
+		sources[EXON_SOURCE] = c->masterExonFile;
+		sources[MEGABLAST_SOURCE] = c->megablastOutputFile;
+		sources[REPEAT_SOURCE] = c->repeatMaskerFile;
+
+		//A missing or out of date bundle is rewritten from the text files,
+		//so that only the first run on a reference parses them twice
+		string error;
+		bool exists = Utils::FileExists(c->referenceBundleFile);
+		if (!exists || !bundle.Open(c->referenceBundleFile, sources, &error,
+			c->verifyReferenceBundle))
+		{
+			bundle.Close();
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tWriting reference "
+				<< "bundle " << c->referenceBundleFile << " (" 
+				<< (exists ? error : "missing") << ")";
+			if (!ReferenceBundle::Write(c->referenceBundleFile, sources, &error) ||
+				!bundle.Open(c->referenceBundleFile, sources, &error))
+			{
+				bundle.Close();
+				BOOST_LOG_CHANNEL(logger::get(), "Main") << "\tNot using "
+					<< "reference bundle " << c->referenceBundleFile << ": " 
+					<< error << "; loading text files";
+				return false;
+			}
+		}
+		BOOST_LOG_CHANNEL(logger::get(), "Main") 
+			<< "\tLoading reference bundle " << c->referenceBundleFile;
+
+		//Records are in file order, so later records replace earlier ones 
+		//with the same id in the maps, as they do when loading text
+		const BundleGene *bGenes = bundle.Genes();
+		vector<Gene *> genes(bundle.Count(GENES_SECTION));
+		for (size_t i = 0; i < genes.size(); i++) {
+			Gene *g = new Gene();
+			g->geneId = bGenes[i].geneId;
+			g->name = bundle.GetString(bGenes[i].name);
+			g->chr = bundle.GetString(bGenes[i].chr);
+			g->strand = bundle.GetString(bGenes[i].strand);
+			g->txStart_genomic = bGenes[i].txStart_genomic;
+			g->txEnd_genomic = bGenes[i].txEnd_genomic;
+			g->txStart_transcriptomic = bGenes[i].txStart_transcriptomic;
+			g->txEnd_transcriptomic = bGenes[i].txEnd_transcriptomic;
+			GenesMap[g->geneId] = g;
+			genes[i] = g;
+		}
+		BOOST_LOG_CHANNEL(logger::get(), "Main") 
+			<< "\t" << GenesMap.size() << " genes";
+
+		const BundleIsoform *bIsoforms = bundle.Isoforms();
+		vector<Isoform *> isoforms(bundle.Count(ISOFORMS_SECTION));
+		for (size_t i = 0; i < isoforms.size(); i++) {
+			Isoform *iso = new Isoform();
+			iso->gene = GenesMap[bIsoforms[i].geneId];
+			iso->isoformIdStr = bundle.GetString(bIsoforms[i].isoformId);
+			iso->txStart = bIsoforms[i].txStart;
+			iso->txEnd = bIsoforms[i].txEnd;
+			iso->cdsStartDistFromTxStart = bIsoforms[i].cdsStart - 1;
+			iso->cdsEndDistFromTxEnd = bIsoforms[i].cdsEnd;
+			IsoformsMap[iso->isoformIdStr] = iso;
+			isoforms[i] = iso;
+		}
+		BOOST_LOG_CHANNEL(logger::get(), "Main") 
+			<< "\t" << IsoformsMap.size() << " isoforms";
+
+		const BundleExon *bExons = bundle.Exons();
+		vector<Exon *> exons(bundle.Count(EXONS_SECTION));
+		for (size_t i = 0; i < exons.size(); i++) {
+			Exon *ex = new Exon();
+			ex->gene = GenesMap[bExons[i].geneId];
+			ex->exonId = bExons[i].exonId;
+			ex->exStart = bExons[i].exStart;
+			ex->exEnd = bExons[i].exEnd;
+			ex->exStart_genomic = bExons[i].exStart_genomic;
+			ex->exEnd_genomic = bExons[i].exEnd_genomic;
+			ex->sequence = boost::string_ref(
+				bundle.GetSequence(bExons[i].sequence), bExons[i].sequenceLength);
+			ExonsMap[ex->exonId] = ex;
+			exons[i] = ex;
+		}
+		BOOST_LOG_CHANNEL(logger::get(), "Main") 
+			<< "\t" << ExonsMap.size() << " exons";
+
+		//Link nested references; isoform and exon lists are record indexes
+		const uint32_t *geneIsoforms = bundle.GeneIsoforms();
+		const uint32_t *isoformExons = bundle.IsoformExons();
+		for (size_t i = 0; i < genes.size(); i++) {
+			Gene *gene = genes[i];
+			if (GenesMap[gene->geneId] != gene)
+				continue;
+			unordered_map<int, Exon*> geneExons;
+			for (uint32_t gi = 0; gi < bGenes[i].numIsoforms; gi++) {
+				uint32_t isoIdx = geneIsoforms[bGenes[i].firstIsoform + gi];
+				Isoform *iso = isoforms[isoIdx];
+				gene->isoforms.push_back(iso);
+				for (uint32_t ie = 0; ie < bIsoforms[isoIdx].numExons; ie++) {
+					Exon *ex = exons[isoformExons[bIsoforms[isoIdx].firstExon + ie]];
+					iso->exons.push_back(ex);
+					geneExons[ex->exonId] = ex;
+					ex->exonIsoforms.push_back(iso);
+				}
+				std::sort(iso->exons.begin(), iso->exons.end(), Exon::compareExons);
+			}
+			for (auto iter = geneExons.begin(); iter != geneExons.end(); ++iter)
+				gene->allExons.push_back((*iter).second);
+			std::sort(gene->allExons.begin(), gene->allExons.end(), 
+				Exon::compareExons);
+		}
+
+		const BundleHomology *hits = bundle.Homology();
+		for (size_t i = 0; i < bundle.Count(HOMOLOGY_SECTION); i++) {
+			const BundleHomology &h = hits[i];
+			homology.Add(h.geneA, h.startA, h.endA, h.geneB, h.startB, h.endB);
+		}
+		homology.Build();
+
+		const BundleRepeat *repeats = bundle.Repeats();
+		for (size_t i = 0; i < bundle.Count(REPEATS_SECTION); i++) {
+			GenesMap[repeats[i].geneId]->repeatRegions.Add(
+				repeats[i].start - 18, repeats[i].end + 18);
+		}
+		return true;
+	}
+
 	//This function is mainly for debugging purposes
 	bool GeneModel::ValidateGeneModelsIntegrity() {
 		Config *c = Config::GetConfig();
@@ -272,24 +424,48 @@ namespace MOJO
 		return 0;
 	}
 
+	void GeneModel::BuildChromGeneIndex()
+	{
+		GeneModel *gm = GeneModel::GetGeneModel();
+		vector<Gene *> genes;
+		for (auto g : gm->GenesMap)
+			genes.push_back(g.second);
+		std::sort(genes.begin(), genes.end(), Gene::compareGenes);
+		for (auto g : genes)
+			chromGeneIndex[g->chr].Add(g->txStart_genomic, g->txEnd_genomic, 
+				g->geneId);
+		for (auto &iter : chromGeneIndex)
+			iter.second.Build();
+	}
+
+	//Safe to call from concurrent threads: the index is built exactly once
+	//and is read-only afterwards
+	const IntervalIndex *GeneModel::GetChromGeneIndex(const string &chr)
+	{
+		boost::call_once(chromGeneIndexOnce, BuildChromGeneIndex);
+		auto iter = chromGeneIndex.find(chr);
+		return iter == chromGeneIndex.end() ? NULL : &iter->second;
+	}
+
+	int GeneModel::GetGeneIdForCoordinates(const string &chr, int pos)
+	{
+		const IntervalIndex *index = GetChromGeneIndex(chr);
+		return index == NULL ? -1 : index->Find(pos);
+	}
+
+	void GeneModel::GetGeneIdsForCoordinates(const string &chr, 
+		const vector<int> &positions, vector<int> *geneIds)
+	{
+		const IntervalIndex *index = GetChromGeneIndex(chr);
+		geneIds->resize(positions.size());
+		for (size_t i = 0; i < positions.size(); i++)
+			(*geneIds)[i] = index == NULL ? -1 : index->Find(positions[i]);
+	}
+
 	string GeneModel::GetGeneNameForCoordinates(string chr, int pos)
 	{
-		if (chromGenesRefSeq.size() == 0) {
-			GeneModel *gm = GeneModel::GetGeneModel();
-			vector<Gene *> genes;
-			for (auto g : gm->GenesMap)
-				genes.push_back(g.second);
-			std::sort(genes.begin(), genes.end(), Gene::compareGenes);
-			for (auto g : genes)
-				chromGenesRefSeq[g->chr][g->txStart_genomic] = g;
-		}
-		// Change this algo-- use hash or binary search to make it fast.
-		for (auto iter : chromGenesRefSeq[chr]) {
-			Gene *g = iter.second;
-			if ((pos > g->txStart_genomic && pos < g->txEnd_genomic) || 
-				(pos > g->txEnd_genomic && pos < g->txStart_genomic))
-				return g->name;
-		}
-		return "-";
+		int geneId = GetGeneIdForCoordinates(chr, pos);
+		return geneId == -1 ? "-" : 
+			GetGeneModel()->GenesMap.find(geneId)->second->name;
 	}
 };
\ No newline at end of file
@@ -1,4 +1,6 @@
 
+#include <climits>
+
 #include "GeneModelObjs.h"
 
 namespace MOJO 
@@ -6,6 +8,82 @@ namespace MOJO
 	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
 		(keywords::channel = ""));
 
+	//isoform exons below which a gene is scanned rather than indexed
+	static const size_t MIN_INDEXED_EXONS = 256;
+	
+	//allow mapping coordinate to be at most 20bp from the exon end;
+	static const int EXON_END_PAD = 20;
+
+	void Gene::BuildExonIndex()
+	{
+		exonIndex = isoformExonIndex = IntervalIndex();
+		lengthSumByStart.clear(), lengthSumByEnd.clear();
+		exonStarts.clear(), exonEnds.clear();
+		isoformOffsets.clear(), isoformExonStarts.clear();
+		isoformExons.clear();
+		boost::call_once(exonUnionOnce, [this]() { IndexExonUnion(); });
+		size_t numIsoformExons = 0;
+		for (auto iso : isoforms) {
+			numIsoformExons += iso->exons.size();
+			if (iso->transcriptLength < 0)
+				iso->transcriptLength = iso->GetTranscriptLength();
+		}
+		if (numIsoformExons < MIN_INDEXED_EXONS)
+			return;
+
+		for (auto iso : isoforms) {
+			isoformOffsets.push_back((int)isoformExons.size());
+			for (auto ex : iso->exons) {
+				isoformExonIndex.Add(ex->exStart, ex->exEnd, 
+					(int)isoformExons.size());
+				isoformExonStarts.push_back(ex->exStart);
+				isoformExons.push_back(ex);
+			}
+		}
+		isoformExonIndex.Build();
+
+		lengthSumByStart.push_back(0);
+		vector< std::pair<int, int> > endsAndLengths;
+		for (size_t i = 0; i < allExons.size(); i++) {
+			Exon *ex = allExons[i];
+			exonIndex.Add(ex->exStart, ex->exEnd, (int)i);
+			exonStarts.push_back(ex->exStart);
+			lengthSumByStart.push_back(lengthSumByStart.back() + 
+				ex->GetExonLength());
+			endsAndLengths.push_back(std::make_pair(ex->exEnd, 
+				ex->GetExonLength()));
+		}
+		exonIndex.Build();
+		std::sort(endsAndLengths.begin(), endsAndLengths.end());
+		lengthSumByEnd.push_back(0);
+		for (auto &endAndLength : endsAndLengths) {
+			exonEnds.push_back(endAndLength.first);
+			lengthSumByEnd.push_back(lengthSumByEnd.back() + endAndLength.second);
+		}
+	}
+
+	//Adds the exonic length of ex between the two coordinates, noting 
+	//whether it holds either of them
+	static void AddExonicDistance(Exon *ex, int coordA, int coordB, 
+		long long *distance, bool *coordAexonic, bool *coordBexonic)
+	{
+		const int PAD = EXON_END_PAD;
+		//if exon between two coords
+		if (coordA < ex->exStart && coordB > ex->exEnd) { 
+			*distance += ex->GetExonLength();
+		}
+		else if ((ex->exStart - PAD) < coordA && (ex->exEnd + PAD) > coordA) {
+			//else if exon has coordA
+			*distance += abs(ex->exEnd - coordA);
+			*coordAexonic = true;
+		}
+		else if ((ex->exStart - PAD) < coordB && (ex->exEnd + PAD) > coordB) {
+			//else if exon has coordB
+			*distance += abs(coordB - ex->exStart);
+			*coordBexonic = true;
+		}
+	}
+
 	// Computes the distance between the two coordinates of a gene that is 
 	// spanned only by exons.  Considers all possible isoforms.
 	int Gene::GetExonicDistanceBetweenCoords(int coordA, int coordB)
@@ -13,42 +91,50 @@ namespace MOJO
 		if (coordA > coordB)
 			std::swap(coordA, coordB);
 
-		if (coordA > coordB) {
-			cerr << "coordA is greater than coordB, error." << endl;
-			exit(1);
-		}
-
 		bool coordAexonic = false, coordBexonic = false;
-		//allow mapping coordinate to be at most 20bp from the exon end;
-		const int PAD = 20; 
-
-		int distance = 0;
-		for (auto ex : allExons){
-			//if exon between two coords
-			if (coordA < ex->exStart && coordB > ex->exEnd) { 
-				distance += ex->GetExonLength();
-			}
-			else if ((ex->exStart - PAD) < coordA && (ex->exEnd + PAD) > coordA) {
-				//else if exon has coordA
-				distance += abs(ex->exEnd - coordA);
-				coordAexonic = true;
-			}
-			else if ((ex->exStart - PAD) < coordB && (ex->exEnd + PAD) > coordB) {
-				//else if exon has coordB
-				distance += abs(coordB - ex->exStart);
-				coordBexonic = true;
+		const int PAD = EXON_END_PAD;
+		long long distance = 0;
+		if (lengthSumByStart.empty()) {
+			for (auto ex : allExons)
+				AddExonicDistance(ex, coordA, coordB, &distance, 
+					&coordAexonic, &coordBexonic);
+		}
+		else {
+			//exons between the two coords count in full: those ending before
+			//coordB, less those starting at or before coordA, plus those of 
+			//the latter ending at or after coordB (which hold coordA)
+			size_t startsUpToA = std::upper_bound(exonStarts.begin(), 
+				exonStarts.end(), coordA) - exonStarts.begin();
+			size_t endsBeforeB = std::lower_bound(exonEnds.begin(), 
+				exonEnds.end(), coordB) - exonEnds.begin();
+			distance = lengthSumByEnd[endsBeforeB] - 
+				lengthSumByStart[startsUpToA];
+
+			//the other exons add to the distance only within PAD of a coord
+			vector<int> ids;
+			exonIndex.FindAll(coordA - PAD + 1, coordA + PAD - 1, &ids);
+			size_t nearA = ids.size();
+			exonIndex.FindAll(coordB - PAD + 1, coordB + PAD - 1, &ids);
+			for (size_t i = 0; i < ids.size(); i++) {
+				Exon *ex = allExons[ids[i]];
+				if (i < nearA && ex->exStart <= coordA && ex->exEnd >= coordB)
+					distance += ex->GetExonLength();
+				if ((coordA < ex->exStart && coordB > ex->exEnd) ||
+					(i >= nearA && (ex->exStart - PAD) < coordA && 
+					(ex->exEnd + PAD) > coordA))
+					continue;
+				AddExonicDistance(ex, coordA, coordB, &distance, 
+					&coordAexonic, &coordBexonic);
 			}
 		}
 		if (coordAexonic && coordBexonic)
-			return distance;
+			return (int)distance;
 		return 1000000;
 	}
 
 	bool Gene::DoesRegionContainRepeat(int readStart, int readEnd)
 	{
-		for (auto repeat : repeatRegions)
-			return (repeat.first < readStart && repeat.second > readEnd);
-		return false;
+		return repeatRegions.Contains(readStart, readEnd);
 	};
 
 	// For a given gene, generates all possible back-spliced exon junctions to 
@@ -68,7 +154,7 @@ namespace MOJO
 				Exon *exon1 = isoforms[i]->exons[j];
 				string exon1Str = lexical_cast<string>(exon1->exonId);
 				if (seq_added.find(exon1Str) == seq_added.end()) {
-					string seq = exon1->sequence;
+					string seq = exon1->sequence.to_string();
 					string seqA = seq, seqB = seq;
 					if (seq.length() > 90) {
 						seqA = seq.substr(seq.length() - 90, 90);
@@ -86,9 +172,11 @@ namespace MOJO
 						continue;
 					string s1, s2;
 					if (strand == "+")
-						s1 = exon1->sequence, s2 = exon2->sequence;
+						s1 = exon1->sequence.to_string(), 
+						s2 = exon2->sequence.to_string();
 					else
-						s1 = exon2->sequence, s2 = exon1->sequence;
+						s1 = exon2->sequence.to_string(), 
+						s2 = exon1->sequence.to_string();
 
 					string s1_scram = s1.length() > 90 ? s1.substr(0, 90) : s1;
 					string s2_scram =
@@ -106,70 +194,152 @@ namespace MOJO
 		return scrambledExonSequence;
 	}
 
-	string Gene::GetTranscribedSequence()
+	// allExons is sorted by start, so the union of the exons up to one holds
+	// every exonic base before the furthest end reached so far: it is a 
+	// prefix of the exonic sequence.  The union from an exon onwards is 
+	// built from the last exon back, merging blocks as their starts drop.
+	void Gene::IndexExonUnion()
+	{
+		size_t n = allExons.size();
+		upstreamLengths.assign(n, 0);
+		downstreamLengths.assign(n, 0);
+		int covered = 0, maxEnd = INT_MIN;
+		for (size_t i = 0; i < n; i++) {
+			Exon *ex = allExons[i];
+			ex->allExonsIndex = (int)i;
+			int from = max(ex->exStart, maxEnd);
+			if (ex->exEnd > from)
+				covered += ex->exEnd - from;
+			maxEnd = max(maxEnd, ex->exEnd);
+			upstreamLengths[i] = covered;
+		}
+
+		//blocks with the lowest starts at the back
+		vector< std::pair<int, int> > blocks;
+		covered = 0;
+		for (size_t i = n; i-- > 0;) {
+			Exon *ex = allExons[i];
+			if (ex->exStart < ex->exEnd) {
+				int end = ex->exEnd;
+				while (!blocks.empty() && blocks.back().first <= end) {
+					end = max(end, blocks.back().second);
+					covered -= blocks.back().second - blocks.back().first;
+					blocks.pop_back();
+				}
+				covered += end - ex->exStart;
+				blocks.push_back(std::make_pair(ex->exStart, end));
+			}
+			downstreamLengths[i] = covered;
+		}
+
+		exonicBlocks.clear();
+		exonicLength = 0;
+		for (auto block = blocks.rbegin(); block != blocks.rend(); ++block) {
+			ExonicBlock eb = { block->first, block->second, exonicLength };
+			exonicBlocks.push_back(eb);
+			exonicLength += block->second - block->first;
+		}
+	}
+
+	void Gene::BuildExonicSequence()
 	{
-		std::map<int, char> seqMap;
-		for (auto e : allExons){
-			const char *s = e->sequence.c_str();
-			for (int i = e->exStart; i < e->exEnd; i++)
-				seqMap[i] = s[i - e->exStart];
+		boost::call_once(exonUnionOnce, [this]() { IndexExonUnion(); });
+		exonicSequence.assign(exonicLength, 'N');
+		//overlapping exons are written in order, the last one's bases kept
+		for (auto e : allExons) {
+			int offset = GetExonicOffset(e->exStart);
+			int length = min(e->exEnd - e->exStart, (int)e->sequence.length());
+			if (length > 0)
+				exonicSequence.replace(offset, length, e->sequence.data(), length);
 		}
-		char *cc = new char[seqMap.size() + 1];
-		int i = 0;
-		for (auto c : seqMap)
-			cc[i++] = c.second; 
-		cc[i] = '\0';
-		string fullSeq(cc);
-		delete[] cc;
+	}
+
+	int Gene::GetExonicOffset(int pos)
+	{
+		auto next = std::upper_bound(exonicBlocks.begin(), exonicBlocks.end(), 
+			pos, [](int p, const ExonicBlock &b) { return p < b.start; });
+		if (next == exonicBlocks.begin())
+			return 0;
+		auto block = next - 1;
+		return block->offset + min(pos, block->end) - block->start;
+	}
+
+	// -1 for an exon with no bases, which the partial transcripts treat as
+	// missing from the gene
+	int Gene::GetAllExonsIndex(Exon *ex)
+	{
+		if (ex->exStart >= ex->exEnd)
+			return -1;
+		int index = ex->allExonsIndex;
+		if (index >= 0 && index < (int)allExons.size() && allExons[index] == ex)
+			return index;
+		for (size_t i = 0; i < allExons.size(); i++)
+			if (allExons[i] == ex)
+				return (int)i;
+		return -1;
+	}
+
+	string Gene::GetTranscribedSequence()
+	{
+		boost::call_once(exonicSequenceOnce, [this]() { BuildExonicSequence(); });
 		if (strand == "+")
-			return fullSeq;
+			return exonicSequence;
 		else
-			return Utils::ReverseComplement(fullSeq);
+			return Utils::ReverseComplement(exonicSequence);
 	}
 
 	// Generate the 5' or 3' transcript ending/beginning with the targetExon.
 	string Gene::GetPartialTranscript(Exon *targetExon, FRAG_TYPE frag) {
+		boost::call_once(exonicSequenceOnce, [this]() { BuildExonicSequence(); });
+		bool upstream = ((frag == FRAG_TYPE::FIVE_P) == (strand == "+"));
+		int target = GetAllExonsIndex(targetExon);
+
 		string seq;
-		std::map<int, char> upstreamMap, downstreamMap;
-		bool found = false;
-		for (auto e : allExons){
-			const char *s = e->sequence.c_str();
-
-			for (int i = e->exStart; i < e->exEnd; i++) {
-				if (!found)
-					upstreamMap[i] = s[i - e->exStart];
-				else
-					downstreamMap[i] = s[i - e->exStart];
-
-				if (e == targetExon) {
-					found = true;
-					upstreamMap[i] = s[i - e->exStart];
-					downstreamMap[i] = s[i - e->exStart];
+		if (target < 0) {
+			if (upstream)
+				seq = exonicSequence;
+		}
+		else if (upstream) {
+			seq = exonicSequence.substr(0, upstreamLengths[target]);
+		}
+		else {
+			int from = GetExonicOffset(allExons[target]->exStart);
+			if (downstreamLengths[target] == exonicLength - from) {
+				seq = exonicSequence.substr(from);
+			}
+			else {
+				//exons before the target reach past gaps between the ones 
+				//after it; take the union of the latter block by block
+				int start = 0, end = INT_MIN;
+				for (size_t i = target; i <= allExons.size(); i++) {
+					Exon *ex = (i < allExons.size()) ? allExons[i] : 0;
+					if (ex != 0 && ex->exStart >= ex->exEnd)
+						continue;
+					if (ex != 0 && ex->exStart <= end) {
+						end = max(end, ex->exEnd);
+						continue;
+					}
+					if (end > start)
+						seq.append(exonicSequence, GetExonicOffset(start), 
+							end - start);
+					if (ex != 0)
+						start = ex->exStart, end = ex->exEnd;
 				}
 			}
 		}
-
-		std::map<int, char> *seqMap;
-		if ((frag == FRAG_TYPE::FIVE_P && strand == "+") ||
-			(frag == FRAG_TYPE::THREE_P && strand == "-"))
-			seqMap = &upstreamMap;
-		else if ((frag == FRAG_TYPE::FIVE_P && strand == "-") ||
-			(frag == FRAG_TYPE::THREE_P && strand == "+"))
-			seqMap = &downstreamMap;
-
-		char *cc = new char[(*seqMap).size() + 1];
-		int i = 0;
-		for (auto c : (*seqMap)) 
-			cc[i++] = c.second;
-		cc[i] = '\0';
-		string fullSeq(cc);
-		delete[] cc;
 		if (strand == "+")
-			return fullSeq;
+			return seq;
 		else
-			return Utils::ReverseComplement(fullSeq);
+			return Utils::ReverseComplement(seq);
+	}
 
-		return seq;
+	int Gene::GetPartialTranscriptLength(Exon *targetExon, FRAG_TYPE frag) {
+		boost::call_once(exonUnionOnce, [this]() { IndexExonUnion(); });
+		bool upstream = ((frag == FRAG_TYPE::FIVE_P) == (strand == "+"));
+		int target = GetAllExonsIndex(targetExon);
+		if (target < 0)
+			return upstream ? exonicLength : 0;
+		return upstream ? upstreamLengths[target] : downstreamLengths[target];
 	}
 
 	//Returns all exons spanned by the coordinates start/end;
@@ -177,19 +347,46 @@ namespace MOJO
 		bool considerIntronic)
 	{
 		vector<Exon *> exons;
-		for (auto iso : isoforms) {
-			Exon *prevExon = 0;
-			for (auto ex : iso->exons) {
-				if ((ex->exStart <= start && ex->exEnd >= start) ||
-					(ex->exStart <= end && ex->exEnd >= end) ||
-					(considerIntronic && prevExon != 0 &&
-					prevExon->exEnd <= start && ex->exStart >= end))
-				{
-					exons.push_back(ex);
+		if (isoformExons.empty() || start >= end) {
+			for (auto iso : isoforms) {
+				Exon *prevExon = 0;
+				for (auto ex : iso->exons) {
+					if ((ex->exStart <= start && ex->exEnd >= start) ||
+						(ex->exStart <= end && ex->exEnd >= end) ||
+						(considerIntronic && prevExon != 0 &&
+						prevExon->exEnd <= start && ex->exStart >= end))
+					{
+						exons.push_back(ex);
+					}
+					prevExon = ex;
 				}
-				prevExon = ex;
+			}
+			return exons;
+		}
+
+		//isoform exons holding either point, numbered in isoform order
+		vector<int> ids;
+		isoformExonIndex.FindAll(start, start, &ids);
+		isoformExonIndex.FindAll(end, end, &ids);
+		if (considerIntronic) {
+			//in an isoform, the points can only be in the intron before the 
+			//first exon starting at or after end
+			for (size_t k = 0; k < isoformOffsets.size(); k++) {
+				int first = isoformOffsets[k];
+				int last = (k + 1 < isoformOffsets.size()) ? 
+					isoformOffsets[k + 1] : (int)isoformExons.size();
+				int next = (int)(std::lower_bound(isoformExonStarts.begin() + 
+					first, isoformExonStarts.begin() + last, end) - 
+					isoformExonStarts.begin());
+				if (next > first && next < last && 
+					isoformExons[next - 1]->exEnd <= start)
+					ids.push_back(next);
 			}
 		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		for (auto id : ids)
+			exons.push_back(isoformExons[id]);
 		return exons;
 	}
 
@@ -246,22 +443,29 @@ namespace MOJO
 		return false;
 	}
 
+	// On the - strand the transcript was the reverse complement of the 
+	// reverse complemented exons, which is the exons in reverse order
 	string Isoform::GetTranscript()
 	{
-		stringstream ss;
-		for (auto ex : exons){
-			if (GetStrand() == "+")
-				ss << ex->sequence;
-			else
-				ss << Utils::ReverseComplement(ex->sequence);
+		size_t length = 0;
+		for (auto ex : exons)
+			length += ex->sequence.length();
+		string transcript;
+		transcript.reserve(length);
+		if (GetStrand() == "+") {
+			for (auto ex : exons)
+				transcript.append(ex->sequence.data(), ex->sequence.size());
 		}
-		if (GetStrand() == "+")
-			return ss.str();
-		else
-			return Utils::ReverseComplement(ss.str());
+		else {
+			for (auto ex = exons.rbegin(); ex != exons.rend(); ++ex)
+				transcript.append((*ex)->sequence.data(), (*ex)->sequence.size());
+		}
+		return transcript;
 	}
 
 	int Isoform::GetTranscriptLength() {
+		if (transcriptLength >= 0)
+			return transcriptLength;
 		int len = 0;
 		for (auto ex : exons)
 			len += abs(ex->exStart - ex->exEnd);
@@ -276,14 +480,14 @@ namespace MOJO
 	{
 		if (sequence.length() >= minLength)
 			return vector < string > {
-			sequence.substr(sequence.length() - minLength, minLength)};
+			sequence.substr(sequence.length() - minLength, minLength).to_string()};
 
 		unordered_map<string, bool> allPossibleSeqsMap;
 		for (auto iso : gene->isoforms) {
 			string seq = "";
 			bool exonFound = false;
 			for (auto exon : iso->exons) {
-				seq = seq + exon->sequence;
+				seq.append(exon->sequence.data(), exon->sequence.size());
 				if (this == exon) {
 					exonFound = true;
 					break;
@@ -309,7 +513,7 @@ namespace MOJO
 	vector<string> Exon::GetJunctionSeqAs3pExon(int minLength)
 	{
 		if (sequence.length() >= minLength)
-			return vector < string > {sequence.substr(0, minLength)};
+			return vector < string > {sequence.substr(0, minLength).to_string()};
 
 		unordered_map<string, bool> allPossibleSeqsMap;
 		for (auto iso : gene->isoforms) {
@@ -319,7 +523,7 @@ namespace MOJO
 				if (this == exon)
 					exonFound = true;
 				if (exonFound)
-					seq = seq + exon->sequence;
+					seq.append(exon->sequence.data(), exon->sequence.size());
 			}
 			if (!exonFound)
 				continue;
@@ -0,0 +1,410 @@
+
+#include <cstdlib>
+#include <cstring>
+
+#include "GzipReader.h"
+
+namespace MOJO
+{
+	GzipReader::GzipReader(string file, int threads) :
+		fileName(file), current(0), currentPos(0), producerDone(false), 
+		stopRequested(false), failed(false), producer(0), batchNumber(0), 
+		batchThreads(0), workersBusy(0), poolStop(false), inflateFailed(false)
+	{
+		numThreads = threads < 1 ? 1 : threads;
+		format = DetectFormat(file);
+		fp = fopen(file.c_str(), "rb");
+		if (fp == NULL) {
+			Fail("cannot open file " + file);
+			producerDone = true;
+			return;
+		}
+		producer = new boost::thread(&GzipReader::Produce, this);
+	}
+
+	GzipReader::~GzipReader()
+	{
+		{
+			boost::mutex::scoped_lock lock(queueMutex);
+			stopRequested = true;
+		}
+		queueNotFull.notify_all();
+		if (producer != 0) {
+			producer->join();
+			delete producer;
+		}
+		for (auto chunk : chunks)
+			delete chunk;
+		delete current;
+		if (fp != NULL)
+			fclose(fp);
+	}
+
+	//Records the first error; the producer stops after reporting it
+	void GzipReader::Fail(string message)
+	{
+		boost::mutex::scoped_lock lock(queueMutex);
+		if (!failed)
+			failed = true, error = message;
+	}
+
+	bool GzipReader::HasFailed()
+	{
+		boost::mutex::scoped_lock lock(queueMutex);
+		return failed;
+	}
+
+	string GzipReader::GetError()
+	{
+		boost::mutex::scoped_lock lock(queueMutex);
+		return error;
+	}
+
+	//Gzip members start with 1f 8b; BGZF members additionally carry a 'BC'
+	// extra subfield holding the compressed block size
+	GZIP_FORMAT GzipReader::DetectFormat(string file)
+	{
+		unsigned char h[18];
+		FILE *f = fopen(file.c_str(), "rb");
+		if (f == NULL)
+			return PLAIN_TEXT;
+		size_t n = fread(h, 1, sizeof(h), f);
+		fclose(f);
+		if (n < 2 || h[0] != 0x1f || h[1] != 0x8b)
+			return PLAIN_TEXT;
+		if (n == 18 && (h[3] & 4) && (h[10] | (h[11] << 8)) >= 6 &&
+			h[12] == 'B' && h[13] == 'C' && (h[14] | (h[15] << 8)) == 2)
+			return BGZF_BLOCKS;
+		return GZIP_STREAM;
+	}
+
+	void GzipReader::Produce()
+	{
+		if (format == BGZF_BLOCKS)
+			ProduceBgzf();
+		else if (format == GZIP_STREAM)
+			ProduceGzip();
+		else
+			ProducePlain();
+
+		boost::mutex::scoped_lock lock(queueMutex);
+		producerDone = true;
+		queueNotEmpty.notify_all();
+	}
+
+	//Blocks until there is room in the queue.  Returns false if the reader
+	// is being destroyed.
+	bool GzipReader::PushChunk(string *chunk)
+	{
+		boost::mutex::scoped_lock lock(queueMutex);
+		while (chunks.size() >= MAX_QUEUED_CHUNKS && !stopRequested)
+			queueNotFull.wait(lock);
+		if (stopRequested) {
+			delete chunk;
+			return false;
+		}
+		chunks.push_back(chunk);
+		queueNotEmpty.notify_one();
+		return true;
+	}
+
+	void GzipReader::ProducePlain()
+	{
+		while (true) {
+			string *chunk = new string(CHUNK_SIZE, '\0');
+			size_t n = fread(&(*chunk)[0], 1, CHUNK_SIZE, fp);
+			if (n == 0) {
+				delete chunk;
+				if (ferror(fp))
+					Fail("cannot read " + fileName);
+				return;
+			}
+			chunk->resize(n);
+			if (!PushChunk(chunk))
+				return;
+		}
+	}
+
+	//Serial inflate of a (possibly multi-member) gzip stream
+	void GzipReader::ProduceGzip()
+	{
+		z_stream strm;
+		memset(&strm, 0, sizeof(strm));
+		if (inflateInit2(&strm, 15 + 32) != Z_OK) {
+			Fail("could not initialize zlib for " + fileName);
+			return;
+		}
+		vector<unsigned char> in(CHUNK_SIZE);
+		//inMember: input of a member has been inflated, but not its trailer
+		bool eof = false, corrupt = false, inMember = false;
+		while (!corrupt) {
+			string *chunk = new string(CHUNK_SIZE, '\0');
+			strm.next_out = (Bytef *)&(*chunk)[0];
+			strm.avail_out = CHUNK_SIZE;
+			while (strm.avail_out > 0) {
+				if (strm.avail_in == 0 && !eof) {
+					strm.avail_in = fread(&in[0], 1, in.size(), fp);
+					strm.next_in = &in[0];
+					eof = strm.avail_in == 0;
+				}
+				if (strm.avail_in == 0 && eof)
+					break;
+				inMember = true;
+				int ret = inflate(&strm, Z_NO_FLUSH);
+				if (ret == Z_STREAM_END) {
+					//Concatenated gzip members are read as one stream
+					inflateReset(&strm);
+					inMember = false;
+				}
+				else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+					Fail("corrupt gzip stream in " + fileName);
+					corrupt = true;
+					break;
+				}
+			}
+			chunk->resize(CHUNK_SIZE - strm.avail_out);
+			if (chunk->empty() || corrupt) {
+				delete chunk;
+				break;
+			}
+			if (!PushChunk(chunk))
+				break;
+		}
+		inflateEnd(&strm);
+		//A stream cut between records would otherwise read as a shorter file
+		if (!corrupt && ferror(fp))
+			Fail("cannot read " + fileName);
+		else if (!corrupt && eof && inMember)
+			Fail("truncated gzip stream in " + fileName);
+	}
+
+	//Reads one complete BGZF block (header through ISIZE) into <block>; 
+	// false at end of file or, with Fail(), on a malformed block
+	bool GzipReader::ReadBgzfBlock(string *block)
+	{
+		unsigned char h[12];
+		size_t n = fread(h, 1, sizeof(h), fp);
+		if (n == 0) {
+			if (ferror(fp))
+				Fail("cannot read " + fileName);
+			return false;
+		}
+		int xlen = h[10] | (h[11] << 8);
+		if (n != sizeof(h) || h[0] != 0x1f || h[1] != 0x8b || !(h[3] & 4)) {
+			Fail("invalid BGZF block in " + fileName);
+			return false;
+		}
+		string extra(xlen, '\0');
+		if (fread(&extra[0], 1, xlen, fp) != (size_t)xlen) {
+			Fail("truncated BGZF block in " + fileName);
+			return false;
+		}
+		int bsize = -1;
+		for (int p = 0; p + 4 <= xlen;) {
+			int slen = (unsigned char)extra[p + 2] | ((unsigned char)extra[p + 3] << 8);
+			if (extra[p] == 'B' && extra[p + 1] == 'C' && slen == 2)
+				bsize = (unsigned char)extra[p + 4] | ((unsigned char)extra[p + 5] << 8);
+			p += 4 + slen;
+		}
+		size_t blockSize = (size_t)bsize + 1;
+		if (bsize < 0 || blockSize < sizeof(h) + xlen + 8) {
+			Fail("gzip member without a valid BGZF block size in " + fileName);
+			return false;
+		}
+		block->resize(blockSize);
+		memcpy(&(*block)[0], h, sizeof(h));
+		memcpy(&(*block)[sizeof(h)], extra.data(), xlen);
+		size_t rest = blockSize - sizeof(h) - xlen;
+		if (fread(&(*block)[sizeof(h) + xlen], 1, rest, fp) != rest) {
+			Fail("truncated BGZF block in " + fileName);
+			return false;
+		}
+		return true;
+	}
+
+	//Inflates blocks[first], blocks[first + step], ... into the matching out
+	// slots.  Each block is an independent raw deflate stream.  Returns false
+	// if a block is corrupt.
+	bool GzipReader::InflateBgzfBlocks(const vector<string> &blocks,
+		vector<string> *out, int first, int step)
+	{
+		for (size_t i = first; i < blocks.size(); i += step) {
+			const unsigned char *b = (const unsigned char *)blocks[i].data();
+			size_t len = blocks[i].size();
+			int xlen = b[10] | (b[11] << 8);
+			uLong crc = b[len - 8] | (b[len - 7] << 8) | (b[len - 6] << 16) |
+				((uLong)b[len - 5] << 24);
+			size_t isize = b[len - 4] | (b[len - 3] << 8) | (b[len - 2] << 16) |
+				((size_t)b[len - 1] << 24);
+
+			string &o = (*out)[i];
+			o.resize(isize);
+			if (isize == 0)
+				continue;
+			z_stream strm;
+			memset(&strm, 0, sizeof(strm));
+			if (inflateInit2(&strm, -15) != Z_OK)
+				return false;
+			strm.next_in = (Bytef *)(b + 12 + xlen);
+			strm.avail_in = len - 12 - xlen - 8;
+			strm.next_out = (Bytef *)&o[0];
+			strm.avail_out = isize;
+			int ret = inflate(&strm, Z_FINISH);
+			inflateEnd(&strm);
+			if (ret != Z_STREAM_END ||
+				crc32(crc32(0L, Z_NULL, 0), (Bytef *)o.data(), isize) != crc)
+				return false;
+		}
+		return true;
+	}
+
+	//Inflate thread <worker> of the pool: takes its share of each batch
+	void GzipReader::InflateWorker(int worker)
+	{
+		int seen = 0;
+		while (true) {
+			int step;
+			{
+				boost::mutex::scoped_lock lock(poolMutex);
+				while (batchNumber == seen && !poolStop)
+					batchReady.wait(lock);
+				if (poolStop)
+					return;
+				seen = batchNumber;
+				step = batchThreads;
+			}
+			bool ok = worker >= step || 
+				InflateBgzfBlocks(blocks, &inflated, worker, step);
+			boost::mutex::scoped_lock lock(poolMutex);
+			if (!ok)
+				inflateFailed = true;
+			if (--workersBusy == 0)
+				batchDone.notify_all();
+		}
+	}
+
+	//Reads batches of BGZF blocks and inflates each batch across numThreads:
+	// this thread and a pool of numThreads - 1 workers
+	void GzipReader::ProduceBgzf()
+	{
+		vector<boost::thread *> workers;
+		for (int i = 1; i < numThreads; i++)
+			workers.push_back(new boost::thread(&GzipReader::InflateWorker, 
+				this, i));
+		size_t batchSize = numThreads * BLOCKS_PER_THREAD;
+		while (true) {
+			blocks.resize(batchSize);
+			size_t n = 0;
+			while (n < batchSize && ReadBgzfBlock(&blocks[n]))
+				n++;
+			if (n == 0)
+				break;
+			blocks.resize(n);
+			inflated.assign(n, string());
+
+			int t = numThreads < (int)n ? numThreads : (int)n;
+			{
+				boost::mutex::scoped_lock lock(poolMutex);
+				batchThreads = t;
+				workersBusy = (int)workers.size();
+				batchNumber++;
+			}
+			batchReady.notify_all();
+			bool ok = InflateBgzfBlocks(blocks, &inflated, 0, t);
+			{
+				boost::mutex::scoped_lock lock(poolMutex);
+				while (workersBusy > 0)
+					batchDone.wait(lock);
+				ok = ok && !inflateFailed;
+			}
+			if (!ok) {
+				Fail("corrupt BGZF block in " + fileName);
+				break;
+			}
+
+			string *chunk = new string();
+			size_t total = 0;
+			for (auto &o : inflated)
+				total += o.size();
+			chunk->reserve(total);
+			for (auto &o : inflated)
+				chunk->append(o);
+			if (chunk->empty())
+				delete chunk;
+			else if (!PushChunk(chunk))
+				break;
+			//a short batch ends at the end of the file or a bad block
+			if (n < batchSize)
+				break;
+		}
+		{
+			boost::mutex::scoped_lock lock(poolMutex);
+			poolStop = true;
+		}
+		batchReady.notify_all();
+		for (auto w : workers) {
+			w->join();
+			delete w;
+		}
+	}
+
+	//Moves to the next decompressed chunk; false at end of input
+	bool GzipReader::NextChunk()
+	{
+		boost::mutex::scoped_lock lock(queueMutex);
+		while (chunks.empty() && !producerDone)
+			queueNotEmpty.wait(lock);
+		delete current;
+		current = 0;
+		currentPos = 0;
+		if (chunks.empty())
+			return false;
+		current = chunks.front();
+		chunks.pop_front();
+		queueNotFull.notify_one();
+		return true;
+	}
+
+	//Copies up to n decompressed bytes into buf; returns 0 at end of input
+	size_t GzipReader::Read(char *buf, size_t n)
+	{
+		size_t copied = 0;
+		while (copied < n) {
+			if (current == 0 || currentPos == current->size())
+				if (!NextChunk())
+					break;
+			size_t len = current->size() - currentPos;
+			if (len > n - copied)
+				len = n - copied;
+			memcpy(buf + copied, current->data() + currentPos, len);
+			currentPos += len;
+			copied += len;
+		}
+		return copied;
+	}
+
+	//fgets() equivalent: reads up to and including the next '\n', storing at
+	// most maxLen - 1 characters.  Returns false if nothing was read.
+	bool GzipReader::ReadLine(char *buf, int maxLen)
+	{
+		int len = 0;
+		while (len < maxLen - 1) {
+			if (current == 0 || currentPos == current->size())
+				if (!NextChunk())
+					break;
+			const char *start = current->data() + currentPos;
+			size_t avail = current->size() - currentPos;
+			if (avail > (size_t)(maxLen - 1 - len))
+				avail = maxLen - 1 - len;
+			const char *nl = (const char *)memchr(start, '\n', avail);
+			size_t take = nl == 0 ? avail : (nl - start) + 1;
+			memcpy(buf + len, start, take);
+			currentPos += take;
+			len += take;
+			if (nl != 0)
+				break;
+		}
+		buf[len] = '\0';
+		return len > 0;
+	}
+}
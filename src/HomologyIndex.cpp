@@ -0,0 +1,95 @@
+#include <algorithm>
+
+#include "HomologyIndex.h"
+
+namespace MOJO
+{
+	void HomologyIndex::Add(int geneA, int startA, int endA, int geneB, 
+		int startB, int endB)
+	{
+		Hit h = { geneA, geneB, startA, endA, startB, endB };
+		if (geneA > geneB) {
+			Hit swapped = { geneB, geneA, startB, endB, startA, endA };
+			h = swapped;
+		}
+		hits.push_back(h);
+	}
+
+	void HomologyIndex::Build()
+	{
+		std::sort(hits.begin(), hits.end(), 
+			[](const Hit &a, const Hit &b) { 
+				return a.geneLow < b.geneLow || 
+					(a.geneLow == b.geneLow && a.geneHigh < b.geneHigh); 
+			});
+		rowGenes.clear(), rowFirst.clear();
+		columnGenes.clear(), columnFirst.clear();
+		lowExtents.resize(hits.size());
+		highExtents.resize(hits.size());
+		for (size_t i = 0; i < hits.size(); i++) {
+			const Hit &h = hits[i];
+			bool newRow = i == 0 || h.geneLow != hits[i - 1].geneLow;
+			if (newRow) {
+				rowGenes.push_back(h.geneLow);
+				rowFirst.push_back((unsigned)columnGenes.size());
+			}
+			if (newRow || h.geneHigh != hits[i - 1].geneHigh) {
+				columnGenes.push_back(h.geneHigh);
+				columnFirst.push_back((unsigned)i);
+			}
+			Extent low = { h.startLow, h.endLow };
+			Extent high = { h.startHigh, h.endHigh };
+			lowExtents[i] = low, highExtents[i] = high;
+		}
+		rowFirst.push_back((unsigned)columnGenes.size());
+		columnFirst.push_back((unsigned)hits.size());
+		for (size_t c = 0; c + 1 < columnFirst.size(); c++) {
+			SortExtents(lowExtents, columnFirst[c], columnFirst[c + 1]);
+			SortExtents(highExtents, columnFirst[c], columnFirst[c + 1]);
+		}
+		vector<Hit>().swap(hits);
+	}
+
+	//Sorts extents[first, last) by start and sets their running maximum ends
+	void HomologyIndex::SortExtents(vector<Extent> &extents, size_t first, 
+		size_t last)
+	{
+		std::sort(extents.begin() + first, extents.begin() + last, 
+			[](const Extent &a, const Extent &b) { return a.start < b.start; });
+		for (size_t i = first + 1; i < last; i++)
+			extents[i].maxEnd = max(extents[i].maxEnd, extents[i - 1].maxEnd);
+	}
+
+	bool HomologyIndex::Spans(const Extent *first, const Extent *last, 
+		int start, int end)
+	{
+		//extents before the first starting at or after start
+		const Extent *it = std::lower_bound(first, last, start,
+			[](const Extent &e, int s) { return e.start < s; });
+		return it != first && (it - 1)->maxEnd > end;
+	}
+
+	bool HomologyIndex::IsHomologous(int geneA, int startA, int endA, int geneB,
+		int startB, int endB) const
+	{
+		if (geneA > geneB) {
+			std::swap(geneA, geneB);
+			std::swap(startA, startB), std::swap(endA, endB);
+		}
+		auto row = std::lower_bound(rowGenes.begin(), rowGenes.end(), geneA);
+		if (row == rowGenes.end() || *row != geneA)
+			return false;
+		size_t r = row - rowGenes.begin();
+		auto columnsBegin = columnGenes.begin() + rowFirst[r];
+		auto columnsEnd = columnGenes.begin() + rowFirst[r + 1];
+		auto column = std::lower_bound(columnsBegin, columnsEnd, geneB);
+		if (column == columnsEnd || *column != geneB)
+			return false;
+		size_t c = column - columnGenes.begin();
+		size_t first = columnFirst[c], last = columnFirst[c + 1];
+		return Spans(&lowExtents[0] + first, &lowExtents[0] + last, 
+			startA, endA) ||
+			Spans(&highExtents[0] + first, &highExtents[0] + last, 
+			startB, endB);
+	}
+};
@@ -0,0 +1,53 @@
+
+#include <algorithm>
+
+#include "IntervalIndex.h"
+
+namespace MOJO
+{
+	void IntervalIndex::Add(int start, int end, int id)
+	{
+		Interval iv = { min(start, end), max(start, end), id };
+		intervals.push_back(iv);
+	}
+
+	void IntervalIndex::Build()
+	{
+		std::stable_sort(intervals.begin(), intervals.end(), 
+			[](const Interval &a, const Interval &b) { return a.start < b.start; });
+		maxEnd.resize(intervals.size());
+		for (size_t i = 0; i < intervals.size(); i++)
+			maxEnd[i] = i == 0 ? intervals[i].end : 
+				max(maxEnd[i - 1], intervals[i].end);
+	}
+
+	int IntervalIndex::Find(int pos) const
+	{
+		//first interval with start >= pos; none of those can contain pos
+		auto it = std::lower_bound(intervals.begin(), intervals.end(), pos,
+			[](const Interval &iv, int p) { return iv.start < p; });
+		int found = -1, foundStart = 0;
+		for (int i = (int)(it - intervals.begin()) - 1; i >= 0 && maxEnd[i] > pos; 
+			i--) 
+		{
+			const Interval &iv = intervals[i];
+			//walking back, a later match has a lower start, or the same start
+			//and was added earlier
+			if (iv.end > pos && (found == -1 || iv.start < foundStart))
+				found = iv.id, foundStart = iv.start;
+		}
+		return found;
+	}
+
+	void IntervalIndex::FindAll(int lo, int hi, vector<int> *ids) const
+	{
+		auto it = std::upper_bound(intervals.begin(), intervals.end(), hi,
+			[](int p, const Interval &iv) { return p < iv.start; });
+		for (int i = (int)(it - intervals.begin()) - 1; i >= 0 && maxEnd[i] >= lo; 
+			i--) 
+		{
+			if (intervals[i].end >= lo)
+				ids->push_back(intervals[i].id);
+		}
+	}
+};
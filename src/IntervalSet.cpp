@@ -0,0 +1,35 @@
+#include <algorithm>
+
+#include "IntervalSet.h"
+
+namespace MOJO
+{
+	void IntervalSet::Add(int start, int end)
+	{
+		if (start < end)
+			regions.push_back(make_pair(start, end));
+	}
+
+	void IntervalSet::Build()
+	{
+		std::sort(regions.begin(), regions.end());
+		size_t merged = 0;
+		for (size_t i = 0; i < regions.size(); i++) {
+			if (merged > 0 && regions[i].first <= regions[merged - 1].second)
+				regions[merged - 1].second = 
+					max(regions[merged - 1].second, regions[i].second);
+			else
+				regions[merged++] = regions[i];
+		}
+		regions.resize(merged);
+		regions.shrink_to_fit();
+	}
+
+	bool IntervalSet::Contains(int start, int end) const
+	{
+		//first region starting at or after start
+		auto it = std::lower_bound(regions.begin(), regions.end(), start,
+			[](const pair<int, int> &r, int s) { return r.first < s; });
+		return it != regions.begin() && (it - 1)->second > end;
+	}
+};
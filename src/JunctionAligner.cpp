@@ -1,5 +1,6 @@
 
 #include "JunctionAligner.h"
+#include "TaskScheduler.h"
 
 #define MAX_JUNCTIONS_PER_SPLIT 2000000
 
@@ -296,6 +297,13 @@ namespace MOJO
 			: (c->workingDir + "junctions.alignments.reads.2.fastq"));
 	}
 
+	string JunctionAligner::GetUnalignedReadsFqFilename(int end)
+	{
+		Config *c = Config::GetConfig();
+		return c->workingDir + "junct_aligns/unaligned_" + to_string(end) + 
+			".fastq";
+	}
+
 	string JunctionAligner::GetJunctionAlignmentsFilename()
 	{
 		Config *c = Config::GetConfig();
@@ -336,41 +344,36 @@ namespace MOJO
 			exit(1);
 		}
 		
+		//bowtie2 needs fastqs; unpack the unaligned reads once for all splits
+		bool append = false;
+		for (auto reads : c->ExtractUnaligned_reads) {
+			PackedReadReader unal(reads);
+			unal.ExportFastq(GetUnalignedReadsFqFilename(1), 
+				GetUnalignedReadsFqFilename(2), append);
+			append = true;
+		}
+
 		ComputePerTask cpt = ComputePerTask::CalculateComputePerTask(6, 2, 4);
 
 		BOOST_LOG_CHANNEL(logger::get(), "Main") << "Mapping initially unaligned "
 			<< "reads in " << mod->NumSplits << " splits to candidate junctions";
 
-		vector<boost::thread *> threads;
-		vector<bool> thread_finished;
-		int finishedJobs = 0;
-		bool queueFull = false;
+		TaskScheduler scheduler;
 		for (int i = 0; i < mod->NumSplits; i++) {
 			string threadIdStr = lexical_cast<string>(i);
 			string chan = channel + ".JunctionAligner.split." + threadIdStr;
 			Logger::RegisterChannel(c->sampleOutputLogDir + chan + ".log", chan);
 
-			threads.push_back(new boost::thread(AlignToJunctions_worker, 
-				threadIdStr, cpt.numCoresPerSplit, chan));
-			thread_finished.push_back(false);
-
-			if ((i + 1) == cpt.numSplits)
-				queueFull = true;
-			for (int j = 0; queueFull && j <= i; j++) {
-				if (!thread_finished[j] 
-					&& threads[j]->try_join_for(boost::chrono::seconds(1))) {					
-					thread_finished[j] = true;
-					break;
-				}
-				if (j == i) j = 0;				
-				boost::this_thread::sleep(boost::posix_time::seconds(1));	
-			}
+			int cores = cpt.numCoresPerSplit;
+			scheduler.AddTask(chan, cores, 4, [=]() {
+				AlignToJunctions_worker(threadIdStr, cores, chan);
+			});
 		}
+		scheduler.Run();
 
-		for (int j = 0; j < mod->NumSplits; j++) {
-			threads[j]->join();
-			delete threads[j];
-		}
+		if (c->removeTemporaryFiles)
+			Utils::DeleteFiles(std::vector<string> {
+				GetUnalignedReadsFqFilename(1), GetUnalignedReadsFqFilename(2)});
 	}
 
 	void JunctionAligner::AlignToJunctions_worker(string thread, int cores, 
@@ -395,11 +398,8 @@ namespace MOJO
 			exit(1);
 		}
 
-		string fqCsv = "";
-		for (auto fq : c->ExtractUnaligned_fq1)
-			fqCsv += fq + ",";
-		for (auto fq : c->ExtractUnaligned_fq2)
-			fqCsv += fq + ",";
+		string fqCsv = GetUnalignedReadsFqFilename(1) + "," + 
+			GetUnalignedReadsFqFilename(2);
 
 		sprintf(buf, "%s -p %d --local --score-min G,25,11 -k 20 --no-unal -x %s "
 			"-U %s | %s %s.alignments 10 %f 1 ", c->bowtie2Path.c_str(), cores,
@@ -432,40 +432,32 @@ namespace MOJO
 			exit(1);
 		}
 
-		unordered_map<string, bool> readNames;
+		ReadIdSet junctionReads;
 		ifstream junctFileStream(
 			(GetJunctionAlignmentsFilename() + ".tmp").c_str());
 		for (std::string str; getline(junctFileStream, str);) {
 			auto sp = Utils::SplitToVector(str, "\t");
-			string readName = Read::TrimReadName(sp[7]);
-			if (readNames.find(readName) != readNames.end())
-				continue;
-			readNames[readName] = true;
+			junctionReads.Insert(Read::ParseReadId(sp[7]));
 		}
 
 		unordered_map<string, vector<PairedRead> > pcrCheck;
-		for (vector<string>::size_type i = 0; 
-			i < c->ExtractUnaligned_fq1.size(); i++) 
+		for (auto reads : c->ExtractUnaligned_reads)
 		{
-			string fq1 = c->ExtractUnaligned_fq1[i];
-			string fq2 = c->ExtractUnaligned_fq2[i];
-
-			if (!Utils::FileExists(fq1) || !Utils::FileExists(fq2))
+			if (!Utils::FileExists(reads))
 				break;
 
-			FastqParser *unalignedFP = new FastqParser(fq1, fq2);
+			FastqParser unalignedFP(reads);
 			PairedRead pr;
-			while (unalignedFP->GetNextPairedRead(&pr)) {
-				string readName = Read::TrimReadName(pr.FirstRead.ReadName);
-				if (readNames.find(readName) != readNames.end()) 
+			while (unalignedFP.GetNextPairedRead(&pr)) {
+				if (junctionReads.Contains(pr.GetReadId())) 
 					pcrCheck[pr.FirstRead.Sequence.substr(0, 36) + "_" +
 						pr.SecondRead.Sequence.substr(0, 36)].push_back(pr);
 			}
 		}
 
-		unordered_map<string, bool> uniqueReads;
-		ofstream fq1Out(GetJunctionReadsFqFilename(1).c_str(), ios::out);
-		ofstream fq2Out(GetJunctionReadsFqFilename(2).c_str(), ios::out);
+		ReadIdSet uniqueReads;
+		FastqWriter fq1Out(GetJunctionReadsFqFilename(1));
+		FastqWriter fq2Out(GetJunctionReadsFqFilename(2));
 		for (auto iter : pcrCheck) {
 			auto prs = iter.second;
 			vector<int> keepReads;
@@ -487,14 +479,12 @@ namespace MOJO
 			}
 			for (auto keep : keepReads) {
 				PairedRead pr = prs[keep];
-				char b1[500], b2[500];
-				pr.FirstRead.GetFastqString(b1), pr.SecondRead.GetFastqString(b2);
-				fq1Out.write(b1, strlen(b1)), fq2Out.write(b2, strlen(b2));
-				uniqueReads[Read::TrimReadName(pr.FirstRead.ReadName)] = true;
+				fq1Out.Write(pr.FirstRead), fq2Out.Write(pr.SecondRead);
+				uniqueReads.Insert(pr.GetReadId());
 			}
 		}
-		fq1Out.close();
-		fq2Out.close();
+		fq1Out.Close();
+		fq2Out.Close();
 
 		//now filter out duplicate alignments in the junctionAlignments File
 		ofstream junctsDupsRemOut(
@@ -503,7 +493,7 @@ namespace MOJO
 		junctFileStream.seekg(0, ios::beg);
 		for (std::string str; getline(junctFileStream, str);){
 			auto sp = Utils::SplitToVector(str, "\t");
-			if (uniqueReads.find(Read::TrimReadName(sp[7])) != uniqueReads.end())
+			if (uniqueReads.Contains(Read::ParseReadId(sp[7])))
 				junctsDupsRemOut << str << endl;
 		}
 
@@ -530,13 +520,13 @@ namespace MOJO
 		GeneModel *gm = GeneModel::GetGeneModel();
 
 		int anchorCount = 0;
-		unordered_map<int, PairedRead > readsFqByName;
-		FastqParser *fp = new FastqParser(GetJunctionReadsFqFilename(1),
+		unordered_map<ReadId, PairedRead > readsFqById;
+		FastqParser fp(GetJunctionReadsFqFilename(1),
 			GetJunctionReadsFqFilename(2));
 
 		PairedRead pr;
-		while (fp->GetNextPairedRead(&pr)) 
-			readsFqByName[stoi(pr.GetTrimmedReadName())] = pr;
+		while (fp.GetNextPairedRead(&pr)) 
+			readsFqById[pr.GetReadId()] = pr;
 
 		unordered_map<string, Junction *> junctionsMap;
 		for (auto cluster : clusters)
@@ -544,18 +534,19 @@ namespace MOJO
 				junctionsMap[junct->GetJunctionName()] = junct;
 
 		//Load alignments
-		unordered_map<string, vector<AnchorRead *> > anchorReadsByReadName;
+		unordered_map<ReadId, vector<AnchorRead *> > anchorReadsById;
 		ifstream alignStream(GetJunctionAlignmentsFilename().c_str());
 		for (std::string str; getline(alignStream, str);){
 			auto sp = Utils::SplitToVector(str, "\t");
-			string readname = sp[7], readname_trimmed = Read::TrimReadName(sp[7]);
-			if (readsFqByName.find(stoi(readname_trimmed)) == readsFqByName.end()){
+			string readname = sp[7];
+			ReadId readId = Read::ParseReadId(readname);
+			if (readsFqById.find(readId) == readsFqById.end()){
 				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error occurred while "
 					<< "compiling anchor reads. .alignments and .reads.[1/2].fastq "
 					<< "are out of sync. Exiting";
 				exit(1);
 			}
-			PairedRead pr = readsFqByName[stoi(Read::TrimReadName(readname))];
+			PairedRead pr = readsFqById[readId];
 			Junction *junct = junctionsMap[sp[0]];
 			AnchorRead *ar = new AnchorRead(junct);
 			if (pr.FirstRead.ReadName == readname) 
@@ -579,7 +570,7 @@ namespace MOJO
 			sr->overhang3p = sr->alignedSequence.length() - sr->overhang5p;
 			sr->mismatchInAnchor = (sp[15] == "1" ? true : false);
 			junct->anchorReads.push_back(ar);
-			anchorReadsByReadName[readname_trimmed].push_back(ar);
+			anchorReadsById[readId].push_back(ar);
 			anchorCount++;
 		}
 
@@ -589,8 +580,7 @@ namespace MOJO
 		reader.Open(GetJunctionAlignmentsBamFilename());
 		BamTools::RefVector refvect = reader.GetReferenceData();
 		while (reader.GetNextAlignment(al)){
-			string readname_trimmed = Read::TrimReadName(al.Name);
-			vector<AnchorRead *> *ars = &anchorReadsByReadName[readname_trimmed];
+			vector<AnchorRead *> *ars = &anchorReadsById[Read::ParseReadId(al.Name)];
 			
 			for (auto ar : (*ars)) {
 				ReadAlignment readAlign;
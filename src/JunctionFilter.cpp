@@ -1,5 +1,6 @@
 
 #include "JunctionFilter.h"
+#include "TaskScheduler.h"
 
 #define MAX_EXOME_SPLITS 12
 
@@ -257,43 +258,20 @@ namespace MOJO
 			return;
 		}
 
-		ComputePerTask cpt = ComputePerTask::CalculateComputePerTask(12, 1, 2);
-		vector<boost::thread *> threads;
-		vector<bool> thread_finished;
-		int finishedJobs = 0;
-		bool queueFull = false;
+		//One blat per contig; psls are applied to arMap as each one finishes
+		TaskScheduler scheduler;
 		for (vector<string>::size_type i = 0; 
 			i < c->blatFilterChromsVect.size(); 
 			i++) 
 		{
-			string threadIdStr = lexical_cast<string>(i);
-			GenerateFastaForAnchorReads(arMap, contigFaFiles[i]);
-			threads.push_back(new boost::thread(FilterSplitReadsByGenome_worker,
-				contigFaFiles[i], c->blatFilterChromsVect[i], stringency));
-			thread_finished.push_back(false);
-
-			if ((i + 1) == cpt.numSplits)
-				queueFull = true;
-			for (int j = 0; queueFull && j <= i; j++) {
-				if (!thread_finished[j]
-					&& threads[j]->try_join_for(boost::chrono::milliseconds(10))) 
-				{
-					thread_finished[j] = true;
-					FilterSplitReadsByGenome_post(contigFaFiles[j] + ".psl", arMap);
-					break;
-				}
-				if (j == i) j = 0;
-				boost::this_thread::sleep(boost::posix_time::milliseconds(10));
-			}
-		}
-
-		for (vector<string>::size_type j = 0; 
-			j < c->blatFilterChromsVect.size(); j++) 
-		{
-			threads[j]->join();
-			delete threads[j];
-			FilterSplitReadsByGenome_post(contigFaFiles[j] + ".psl", arMap);
+			string faFile = contigFaFiles[i], contig = c->blatFilterChromsVect[i];
+			GenerateFastaForAnchorReads(arMap, faFile);
+			scheduler.AddTask("blat." + contig, 1, 2, 
+				[=]() { FilterSplitReadsByGenome_worker(faFile, contig, stringency); },
+				vector<TaskScheduler::TaskId>(),
+				[=]() { FilterSplitReadsByGenome_post(faFile + ".psl", arMap); });
 		}
+		scheduler.Run();
 	}
 	
 	void JunctionFilter::FilterSplitReadsByGenome_worker(string faFile, 
@@ -318,22 +296,27 @@ namespace MOJO
 	{
 		GeneModel *gm = GeneModel::GetGeneModel(); PSLParser pslParser(pslFile);
 		AnchorReadPSLLine psl;
+		vector<int> blockMids, fetchedGenes;
 		while (pslParser.GetNextLine(psl)) {
 			if ((psl.break_at - psl.qStart > 20 && psl.qEnd - psl.break_at > 20)
 				|| (psl.qSize - psl.matches) < psl.qSize * 0.15)
 			{
 				bool gAfound = false, gBfound = false;
-				for (int d = 0; d < psl.blockCount; d++) {
-					string fetched_gene = GeneModel::GetGeneNameForCoordinates(
-						psl.tName, 
-						(int)(psl.tStarts[d] + (psl.blockSizes[d] / 2)));
-
-					if (fetched_gene != "-") {
+				blockMids.clear();
+				for (int d = 0; d < psl.blockCount; d++)
+					blockMids.push_back(psl.tStarts[d] + (psl.blockSizes[d] / 2));
+				GeneModel::GetGeneIdsForCoordinates(psl.tName, blockMids, 
+					&fetchedGenes);
+				for (int fetched_gene : fetchedGenes) {
+					if (fetched_gene != -1) {
+						//By name: genes of different clusters may share a symbol
+						const string &fetchedName = 
+							gm->GenesMap.find(fetched_gene)->second->name;
 						auto sp = Utils::SplitToVector(psl.qName, "_");
 						Exon *exA = gm->ExonsMap[stoi(sp[1])];
 						Exon *exB = gm->ExonsMap[stoi(sp[2])];
-						if (fetched_gene == exA->gene->name) gAfound = true;
-						if (fetched_gene == exB->gene->name) gBfound = true;
+						if (fetchedName == exA->gene->name) gAfound = true;
+						if (fetchedName == exB->gene->name) gBfound = true;
 					}
 				}
 				if (!(gAfound && gBfound) && psl.misMatches <= 2)
@@ -392,42 +375,19 @@ namespace MOJO
 			}
 			return;
 		}
-		ComputePerTask cpt = ComputePerTask::CalculateComputePerTask(12, 1, 2);
-		vector<boost::thread *> threads;
-		vector<bool> thread_finished;
-		int finishedJobs = 0;
-		bool queueFull = false;
-
+		TaskScheduler scheduler;
 		for (vector<string>::size_type i = 0; 
 			i < c->blatFilterChromsVect.size(); i++) 
 		{
-			string threadIdStr = lexical_cast<string>(i);
-			GenerateFastaForJunctions(arMap, contigFaFiles[i]);
-			threads.push_back(new boost::thread(FilterSplitReadsByGenome_worker,
-				contigFaFiles[i], c->blatFilterChromsVect[i], 
-				FilterStringency::HIGH));
-			thread_finished.push_back(false);
-
-			if ((i + 1) == cpt.numSplits)
-				queueFull = true;
-			for (int j = 0; queueFull && j <= i; j++) {
-				if (!thread_finished[j] && 
-					threads[j]->try_join_for(boost::chrono::milliseconds(10))) {
-					thread_finished[j] = true;
-					FilterSpuriousJunctions_post(contigFaFiles[j] + ".psl", arMap);
-					break;
-				}
-				if (j == i) j = 0;
-				boost::this_thread::sleep(boost::posix_time::milliseconds(10));
-			}
-		}
-		for (vector<string>::size_type j = 0;
-			j < c->blatFilterChromsVect.size(); j++)
-		{
-			threads[j]->join();
-			delete threads[j];
-			FilterSpuriousJunctions_post(contigFaFiles[j] + ".psl", arMap);
+			string faFile = contigFaFiles[i], contig = c->blatFilterChromsVect[i];
+			GenerateFastaForJunctions(arMap, faFile);
+			scheduler.AddTask("blat." + contig, 1, 2, 
+				[=]() { FilterSplitReadsByGenome_worker(faFile, contig,
+					FilterStringency::HIGH); },
+				vector<TaskScheduler::TaskId>(),
+				[=]() { FilterSpuriousJunctions_post(faFile + ".psl", arMap); });
 		}
+		scheduler.Run();
 	}
 	
 	void JunctionFilter::FilterSpuriousJunctions_post(string pslFile,
@@ -25,6 +25,7 @@ pid_t getppid(void);
 #include "JunctionAligner.h"
 #include "JunctionFilter.h"
 #include "FusionCompiler.h"
+#include "Profiler.h"
 #include "JunctionFilter.h"
 
 using namespace std;
@@ -42,7 +43,7 @@ namespace keywords = boost::log::keywords;
 namespace sinks = boost::log::sinks;
 namespace expr = boost::log::expressions;
 
-static int pid = -1, sid = -1, pollingPauseMillisecs = 1000;
+static int pid = -1, pollingPauseMillisecs = 1000;
 static double maxMemoryUsage = 0;
 
 void PollMemory(bool pollOnce = false) 
@@ -58,9 +59,10 @@ void PollMemory(bool pollOnce = false)
 		boost::this_thread::sleep(
 			boost::posix_time::milliseconds(pollingPauseMillisecs));
 
-		auto mem = SystemInfo::GetTotalMemoryUsage(sid, pid);
+		auto mem = SystemInfo::GetTotalMemoryUsage(pid);
 		if (mem.first > maxMemoryUsage) 
 			maxMemoryUsage = mem.first;
+		Profiler::SampleMemory((long)(mem.first * 1024 * 1024));
 		
 		if ( (mem.first/sysmem) > 0.85 || pollOnce ) {
 			double free = SystemInfo::GetTotalFreeMemory();
@@ -80,8 +82,7 @@ int main( int argc, char *argv[] )
 	boost::chrono::system_clock::time_point start = 
 		boost::chrono::system_clock::now();
 
-	pid = (int) getppid();
-	sid = (int)getsid(pid);
+	pid = (int) getpid();
 
 	try {
 		if (!Config::MOJORunConf.LoadConfiguration(argc, argv)) {
@@ -116,26 +117,62 @@ int main( int argc, char *argv[] )
 		<< Config::MOJORunConf.maxCores << " cpus and " 
 		<< Config::MOJORunConf.maxMem << "gb";
 
+	double cgroupCpus = SystemInfo::GetCgroupCpuLimit(), 
+		cgroupMem = SystemInfo::GetCgroupMemoryLimit();
+	if (cgroupCpus > 0 || cgroupMem > 0) {
+		BOOST_LOG(mainLogger) << "Container limits: " 
+			<< (cgroupCpus > 0 ? (boost::format("%.1f") % cgroupCpus).str() : "no")
+			<< " cpu limit, "
+			<< (cgroupMem > 0 ? (boost::format("%.1f") % cgroupMem).str() + "gb" : "no")
+			<< " memory limit";
+	}
+
 	ComputePerTask::MAX_MEM = Config::MOJORunConf.maxMem;
 	ComputePerTask::MAX_CPU = Config::MOJORunConf.maxCores;
 
 	PollMemory(true);
-	GeneModel::gm.LoadGeneModel();
+	{
+		ProfileStage stage("GeneModel::LoadGeneModel");
+		GeneModel::gm.LoadGeneModel();
+	}
 	PollMemory(true);
-	DiscordantReadFinder::Run();
+	{
+		ProfileStage stage("DiscordantReadFinder");
+		DiscordantReadFinder::Run();
+	}
 	PollMemory(true);
-	auto clusters = DiscordantClusterFinder::LoadDiscordantClusters();
+	vector<DiscordantCluster *> clusters;
+	{
+		ProfileStage stage("DiscordantClusterFinder");
+		clusters = DiscordantClusterFinder::LoadDiscordantClusters();
+	}
 	PollMemory(true);
-
-	JunctionAligner::Run(clusters);
+	{
+		ProfileStage stage("JunctionAligner");
+		JunctionAligner::Run(clusters);
+	}
 	PollMemory(true);
-	JunctionFilter::Run(clusters);
+	{
+		ProfileStage stage("JunctionFilter");
+		JunctionFilter::Run(clusters);
+	}
 	PollMemory(true);
-	FusionCompiler::Run(clusters);
+	{
+		ProfileStage stage("FusionCompiler");
+		FusionCompiler::Run(clusters);
+	}
 	PollMemory(true);
 	
 	Config::MOJORunConf.FinalCleanup();
 
+	//Timeline and per-stage resource usage, next to the sample log
+	string profilePfx = Config::MOJORunConf.outputDir + 
+		Config::MOJORunConf.sampleName;
+	Profiler::WriteTrace(profilePfx + ".trace.json");
+	Profiler::WriteSummary(profilePfx + ".profile.txt");
+	BOOST_LOG(mainLogger) << "Resource profile written to " << profilePfx 
+		<< ".profile.txt (timeline: " << profilePfx << ".trace.json)";
+
 	boost::this_thread::sleep(boost::posix_time::milliseconds(10000));
 	memThread->interrupt();
 	BOOST_LOG(mainLogger) << "Run Successfully Completed! ";
@@ -3,6 +3,7 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <deque>
 #include <stdio.h>
 
 #include <boost/unordered_map.hpp>
@@ -14,6 +15,7 @@
 
 #include "GeneModelObjs.h"
 #include "Utils.h"
+#include "ReferenceBundle.h"
 
 using namespace std;
 using namespace boost;
@@ -270,8 +272,10 @@ int main(int argc, char *argv[])
 		fastaFromBed.c_str(), genomeFasta.c_str(), txBed.c_str(), txFa.c_str());
 	Utils::ExecuteCommand(cmd, "", true, true);
 
-	//Create exons.fa
+	//Create exons.fa; exon sequences point into the transcript sequences,
+	//which a deque keeps in place
 	ifstream txFaStream(txFa.c_str());
+	deque<string> transcriptSeqs;
 	for (string str; getline(txFaStream, str);){
 		int geneId = stoi(str.substr(2, str.length() - 2));
 		if (genesMap.find(geneId) == genesMap.end()) {
@@ -283,12 +287,14 @@ int main(int argc, char *argv[])
 			isoformOutStream << line;
 
 		Gene *gene = genesMap[geneId];
-		string fa;
+		transcriptSeqs.push_back("");
+		string &fa = transcriptSeqs.back();
 		getline(txFaStream, fa);
 
 		auto exons = geneToExonVectMap[geneId];
 		for (auto exon : exons){
-			exon->sequence = fa.substr(exon->exStart, exon->exEnd - exon->exStart);
+			exon->sequence = boost::string_ref(fa).substr(exon->exStart, 
+				exon->exEnd - exon->exStart);
 			exonOutStream << "e" << exon->exonId << "\tg" << exon->gene->geneId 
 				<< "\t" << exon->exStart << "\t" << exon->exEnd << "\t"
 				<< exon->exStart_genomic << "\t" << exon->exEnd_genomic
@@ -329,8 +335,8 @@ int main(int argc, char *argv[])
 			std::sort(iso->exons.begin(), iso->exons.end(), Exon::compareExons);
 			for (int i = 0; i < iso->exons.size(); i++) {
 				for (int j = i + 1; j < min( i + 50, (int)iso->exons.size()); j++) {
-					string a = iso->exons[i]->sequence;
-					string b = iso->exons[j]->sequence;
+					string a = iso->exons[i]->sequence.to_string();
+					string b = iso->exons[j]->sequence.to_string();
 					if (a.length() > 100)
 						a = a.substr(a.length() - 100, 100);
 					if (b.length() > 100)
@@ -397,6 +403,13 @@ int main(int argc, char *argv[])
 	}
 	rmskOutStream.close();
 
+	//Binary bundle of the gene model; rebuilt by MegablastOutputCompiler 
+	//once the megablast hits are compiled
+	string bundleError;
+	if (!ReferenceBundle::Write(gene_model_dir + "GeneModel.bundle",
+		ReferenceBundle::GetSourceFiles(gene_model_dir), &bundleError))
+		cout << "Error writing reference bundle: " << bundleError << endl;
+
 	//Generate megablast index
 	// /lustre/beagle/cbandlam/libs/blast-2.2.26/bin/formatdb -i transcriptome.fa -p F
 	// /lustre/beagle/cbandlam/libs/blast-2.2.26/bin/megablast -d transcriptome.fa 
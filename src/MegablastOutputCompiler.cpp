@@ -8,6 +8,7 @@
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem.hpp>
 #include "Utils.h"
+#include "ReferenceBundle.h"
 
 using namespace std;
 using namespace boost;
@@ -58,6 +59,22 @@ int main(int argc, char *argv[])
 			outFile << key << endl;
 		}
 	}
+	outFile.close();
+
+	//Rebuild the reference bundle of the gene model next to the output
+	string geneModelDir = boost::filesystem::path(outputFileName)
+		.parent_path().string();
+	if (geneModelDir == "")
+		geneModelDir = ".";
+	vector<string> sources = ReferenceBundle::GetSourceFiles(geneModelDir);
+	sources[MEGABLAST_SOURCE] = outputFileName;
+	string bundleError;
+	if (Utils::FileExists(sources[GENE_SOURCE])) {
+		cout << "Writing " << geneModelDir << "/GeneModel.bundle" << endl;
+		if (!ReferenceBundle::Write(geneModelDir + "/GeneModel.bundle", 
+			sources, &bundleError))
+			cout << "Error writing reference bundle: " << bundleError << endl;
+	}
 
 	return 1;
 }
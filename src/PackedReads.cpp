@@ -0,0 +1,258 @@
+
+#include "PackedReads.h"
+#include "FastqParser.h"
+
+namespace MOJO
+{
+	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
+		(keywords::channel = "Main"));
+
+	static const char BASES[4] = { 'A', 'C', 'G', 'T' };
+	static const size_t IO_BUFFER_SIZE = 1 << 20;
+	static const size_t END_HEADER_SIZE = 7;
+
+	static inline int BaseCode(char b)
+	{
+		switch (b) {
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			case 'T': return 3;
+			default: return -1;
+		}
+	}
+
+	static inline void PutUInt16(string *s, uint16_t v)
+	{
+		s->push_back((char)(v & 0xff));
+		s->push_back((char)(v >> 8));
+	}
+
+	static inline uint16_t GetUInt16(const unsigned char *p)
+	{
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+
+	PackedReadWriter::PackedReadWriter(string file) : fileName(file), numPairs(0)
+	{
+		fp = fopen(file.c_str(), "wb");
+		if (fp == NULL) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot open "
+				<< file << " for writing";
+			exit(1);
+		}
+		setvbuf(fp, NULL, _IOFBF, IO_BUFFER_SIZE);
+		if (fwrite(PACKED_READS_MAGIC, 1, 8, fp) != 8) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error writing to "
+				<< fileName;
+			exit(1);
+		}
+	}
+
+	PackedReadWriter::~PackedReadWriter()
+	{
+		Close();
+	}
+
+	void PackedReadWriter::Close()
+	{
+		//A file cut short by a full disk must not pass as a complete one
+		if (fp != 0) {
+			int ret = fclose(fp);
+			fp = 0;
+			if (ret != 0) {
+				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error writing to "
+					<< fileName;
+				exit(1);
+			}
+		}
+	}
+
+	void PackedReadWriter::EncodeEnd(const Read &read)
+	{
+		const string &seq = read.Sequence, &qual = read.Quality;
+		if (seq.size() > 0xffff || qual.size() > 0xffff) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: read "
+				<< read.ReadName << " is too long to be packed";
+			exit(1);
+		}
+
+		size_t hdr = record.size();
+		record.append(END_HEADER_SIZE, '\0');
+		uint16_t numExceptions = 0, numRuns = 0;
+
+		size_t packedStart = record.size();
+		record.append((seq.size() + 3) / 4, '\0');
+		string exceptions;
+		for (size_t i = 0; i < seq.size(); i++) {
+			int code = BaseCode(seq[i]);
+			if (code < 0) {
+				PutUInt16(&exceptions, (uint16_t)i);
+				exceptions.push_back(seq[i]);
+				numExceptions++;
+				code = 0;
+			}
+			record[packedStart + i / 4] |= (char)(code << ((i % 4) * 2));
+		}
+		record.append(exceptions);
+
+		runs.clear();
+		for (size_t i = 0; i < qual.size() && runs.size() < qual.size();) {
+			size_t run = 1;
+			while (i + run < qual.size() && qual[i + run] == qual[i] && run < 255)
+				run++;
+			runs.push_back(qual[i]);
+			runs.push_back((char)run);
+			numRuns++;
+			i += run;
+		}
+		QualityEncoding encoding = QUALITY_RUNS;
+		uint16_t qualityCount = numRuns;
+		if (runs.size() >= qual.size()) {
+			encoding = RAW_QUALITIES;
+			qualityCount = (uint16_t)qual.size();
+			record.append(qual);
+		}
+		else
+			record.append(runs);
+
+		record[hdr] = (char)(seq.size() & 0xff);
+		record[hdr + 1] = (char)(seq.size() >> 8);
+		record[hdr + 2] = (char)(numExceptions & 0xff);
+		record[hdr + 3] = (char)(numExceptions >> 8);
+		record[hdr + 4] = (char)(qualityCount & 0xff);
+		record[hdr + 5] = (char)(qualityCount >> 8);
+		record[hdr + 6] = (char)encoding;
+	}
+
+	void PackedReadWriter::Write(PairedRead &pr)
+	{
+		ReadId readId = pr.GetReadId();
+		if (readId == INVALID_READ_ID) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: read name '"
+				<< pr.FirstRead.ReadName << "' is not numeric; cannot pack "
+				<< "into " << fileName;
+			exit(1);
+		}
+		record.clear();
+		for (int b = 0; b < 8; b++)
+			record.push_back((char)((readId >> (8 * b)) & 0xff));
+		EncodeEnd(pr.FirstRead);
+		EncodeEnd(pr.SecondRead);
+		if (fwrite(record.data(), 1, record.size(), fp) != record.size()) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error writing to "
+				<< fileName;
+			exit(1);
+		}
+		numPairs++;
+	}
+
+	PackedReadReader::PackedReadReader(string file) : fileName(file)
+	{
+		fp = fopen(file.c_str(), "rb");
+		char magic[8];
+		if (fp == NULL || fread(magic, 1, 8, fp) != 8 ||
+			memcmp(magic, PACKED_READS_MAGIC, 8) != 0)
+		{
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: " << file
+				<< " is not a packed reads file";
+			exit(1);
+		}
+		setvbuf(fp, NULL, _IOFBF, IO_BUFFER_SIZE);
+	}
+
+	PackedReadReader::~PackedReadReader()
+	{
+		if (fp != 0)
+			fclose(fp);
+	}
+
+	bool PackedReadReader::IsPackedReadFile(string file)
+	{
+		char magic[8];
+		FILE *f = fopen(file.c_str(), "rb");
+		if (f == NULL)
+			return false;
+		bool isPacked = fread(magic, 1, 8, f) == 8 &&
+			memcmp(magic, PACKED_READS_MAGIC, 8) == 0;
+		fclose(f);
+		return isPacked;
+	}
+
+	bool PackedReadReader::DecodeEnd(Read *read)
+	{
+		unsigned char hdr[END_HEADER_SIZE];
+		if (fread(hdr, 1, END_HEADER_SIZE, fp) != END_HEADER_SIZE)
+			return false;
+		uint16_t length = GetUInt16(hdr), numExceptions = GetUInt16(hdr + 2),
+			qualityCount = GetUInt16(hdr + 4);
+		QualityEncoding encoding = (QualityEncoding)hdr[6];
+		if (encoding != RAW_QUALITIES && encoding != QUALITY_RUNS)
+			return false;
+
+		size_t packedLen = (length + 3) / 4, bytes = packedLen + 
+			numExceptions * 3 + 
+			qualityCount * (encoding == QUALITY_RUNS ? 2 : 1);
+		packed.resize(bytes);
+		if (bytes > 0 && fread(&packed[0], 1, bytes, fp) != bytes)
+			return false;
+		const unsigned char *p = (const unsigned char *)packed.data();
+
+		string &seq = read->Sequence;
+		seq.resize(length);
+		for (size_t i = 0; i < length; i++)
+			seq[i] = BASES[(p[i / 4] >> ((i % 4) * 2)) & 3];
+		p += packedLen;
+		for (int e = 0; e < numExceptions; e++, p += 3)
+			seq[GetUInt16(p)] = (char)p[2];
+
+		string &qual = read->Quality;
+		if (encoding == RAW_QUALITIES) {
+			qual.assign((const char *)p, qualityCount);
+			return true;
+		}
+		qual.clear();
+		for (int r = 0; r < qualityCount; r++, p += 2)
+			qual.append(p[1], (char)p[0]);
+		return true;
+	}
+
+	bool PackedReadReader::GetNextPairedRead(PairedRead *pr)
+	{
+		unsigned char idBytes[8];
+		pr->FirstRead.alignments.clear();
+		pr->SecondRead.alignments.clear();
+		if (fread(idBytes, 1, 8, fp) != 8) {
+			pr->Initialize();
+			return false;
+		}
+		if (!DecodeEnd(&pr->FirstRead) || !DecodeEnd(&pr->SecondRead)) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: truncated "
+				<< "packed reads file " << fileName;
+			exit(1);
+		}
+		ReadId readId = 0;
+		for (int b = 7; b >= 0; b--)
+			readId = (readId << 8) | idBytes[b];
+		string id = to_string(readId);
+		pr->FirstRead.ReadName = id + "/1";
+		pr->SecondRead.ReadName = id + "/2";
+		pr->FirstRead.Id = pr->SecondRead.Id = readId;
+		return true;
+	}
+
+	long long PackedReadReader::ExportFastq(string fq1, string fq2, bool append)
+	{
+		FastqWriter out1(fq1, append), out2(fq2, append);
+		long long numPairs = 0;
+		PairedRead pr;
+		while (GetNextPairedRead(&pr)) {
+			out1.Write(pr.FirstRead);
+			out2.Write(pr.SecondRead);
+			numPairs++;
+		}
+		out1.Close();
+		out2.Close();
+		return numPairs;
+	}
+}
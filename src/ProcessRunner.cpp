@@ -0,0 +1,234 @@
+
+#include <spawn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <cerrno>
+#include <chrono>
+
+#include "ProcessRunner.h"
+#include "Profiler.h"
+
+extern char **environ;
+
+namespace MOJO
+{
+	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
+		(keywords::channel = "Main"));
+
+	typedef std::chrono::steady_clock Clock;
+
+	void BoundedBuffer::Append(const char *data, size_t length)
+	{
+		if (head.size() < half) {
+			size_t n = min(length, half - head.size());
+			head.append(data, n);
+			data += n;
+			length -= n;
+		}
+		if (length == 0)
+			return;
+		tail.append(data, length);
+		if (tail.size() > 2 * half) {
+			size_t n = tail.size() - half;
+			tail.erase(0, n);
+			dropped += n;
+		}
+	}
+
+	string BoundedBuffer::Str() const
+	{
+		if (dropped == 0 && tail.size() <= half)
+			return head + tail;
+		size_t skip = tail.size() - half;
+		return head + "\n[... " + to_string(dropped + skip) + " bytes truncated ...]\n"
+			+ tail.substr(skip);
+	}
+
+	ProcessRunner::ProcessRunner(string cmd, int timeoutSeconds,
+		size_t maxOutputBytes) : cmd(cmd), timeoutSeconds(timeoutSeconds),
+		maxOutputBytes(maxOutputBytes), pid(0), cancelled(false) {}
+
+	void ProcessRunner::SetStdoutCallback(OutputCallback onStdout)
+	{
+		this->onStdout = onStdout;
+	}
+
+	void ProcessRunner::Signal(int sig)
+	{
+		boost::mutex::scoped_lock lock(pidMutex);
+		if (pid > 0)
+			kill(-pid, sig);
+	}
+
+	void ProcessRunner::Cancel()
+	{
+		cancelled = true;
+		Signal(SIGTERM);
+	}
+
+	SystemCall ProcessRunner::Run()
+	{
+		SystemCall call(cmd, "", -1);
+		int outPipe[2], errPipe[2];
+		if (pipe2(outPipe, O_CLOEXEC) != 0 || pipe2(errPipe, O_CLOEXEC) != 0) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: cannot create "
+				<< "pipes for command: " << cmd;
+			exit(1);
+		}
+
+		//The child gets its own process group so that cancelling also stops
+		//everything the pipeline started; pipe ends are close-on-exec so that
+		//commands spawned concurrently from other threads do not hold them
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+		posix_spawn_file_actions_adddup2(&actions, outPipe[1], 1);
+		posix_spawn_file_actions_adddup2(&actions, errPipe[1], 2);
+
+		posix_spawnattr_t attr;
+		sigset_t defaults, mask;
+		sigemptyset(&mask);
+		sigemptyset(&defaults);
+		sigaddset(&defaults, SIGPIPE);
+		sigaddset(&defaults, SIGTERM);
+		sigaddset(&defaults, SIGINT);
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+			POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+		posix_spawnattr_setpgroup(&attr, 0);
+		posix_spawnattr_setsigdefault(&attr, &defaults);
+		posix_spawnattr_setsigmask(&attr, &mask);
+
+		int64_t startMicros = Profiler::NowMicros();
+		string script = "set -e; set -o pipefail; " + cmd;
+		char *argv[] = { (char *)"bash", (char *)"-c", (char *)script.c_str(), 0 };
+		pid_t child;
+		int rc = posix_spawnp(&child, "bash", &actions, &attr, argv, environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attr);
+		close(outPipe[1]);
+		close(errPipe[1]);
+		if (rc != 0) {
+			close(outPipe[0]);
+			close(errPipe[0]);
+			call.error = string("posix_spawn failed: ") + strerror(rc);
+			call.exit_code = 127;
+			return call;
+		}
+		{
+			boost::mutex::scoped_lock lock(pidMutex);
+			pid = child;
+		}
+		if (cancelled)
+			Signal(SIGTERM);
+
+		BoundedBuffer out(maxOutputBytes), err(maxOutputBytes);
+		bool termSent = false, killSent = false;
+		Clock::time_point termSentAt, deadline = Clock::now() +
+			std::chrono::seconds(timeoutSeconds);
+		auto checkTimers = [&]() {
+			Clock::time_point now = Clock::now();
+			if (!termSent && (cancelled || (timeoutSeconds > 0 && now >= deadline))) {
+				call.timedOut = !cancelled;
+				Signal(SIGTERM);
+				termSent = true;
+				termSentAt = now;
+			}
+			else if (termSent && !killSent && now - termSentAt >=
+				std::chrono::seconds(PROCESS_KILL_GRACE_SECONDS))
+			{
+				Signal(SIGKILL);
+				killSent = true;
+			}
+		};
+
+		struct pollfd fds[2];
+		fds[0].fd = outPipe[0];
+		fds[1].fd = errPipe[0];
+		fds[0].events = fds[1].events = POLLIN;
+		int numOpen = 2;
+		char buf[65536];
+		while (numOpen > 0) {
+			int n = poll(fds, 2, 200);
+			if (n < 0 && errno != EINTR)
+				break;
+			for (int i = 0; n > 0 && i < 2; i++) {
+				if (fds[i].fd < 0 || fds[i].revents == 0)
+					continue;
+				ssize_t len = read(fds[i].fd, buf, sizeof(buf));
+				if (len > 0) {
+					if (i == 1)
+						err.Append(buf, len);
+					else if (onStdout)
+						onStdout(buf, len);
+					else
+						out.Append(buf, len);
+				}
+				else if (len == 0 || errno != EINTR) {
+					close(fds[i].fd);
+					fds[i].fd = -1;
+					numOpen--;
+				}
+			}
+			checkTimers();
+		}
+		for (int i = 0; i < 2; i++)
+			if (fds[i].fd >= 0)
+				close(fds[i].fd);
+
+		//Wait without reaping first, so that Cancel() never signals a process
+		//group id that could already have been reused
+		siginfo_t info;
+		while (true) {
+			info.si_pid = 0;
+			int options = WEXITED | WNOWAIT | (timeoutSeconds > 0 ? WNOHANG : 0);
+			if (waitid(P_PID, child, &info, options) != 0 && errno != EINTR)
+				break;
+			if (info.si_pid != 0)
+				break;
+			if (timeoutSeconds > 0) {
+				checkTimers();
+				usleep(10000);
+			}
+		}
+		//The exited child still holds the I/O counters of itself and of the
+		//pipeline members it reaped; rusage is collected when reaping it
+		ResourceUsage &usage = call.usage;
+		bool haveIo = Profiler::ReadIoCounters("/proc/" + to_string(child) + 
+			"/io", &usage.readBytes, &usage.writeBytes);
+		int status = 0;
+		struct rusage ru;
+		memset(&ru, 0, sizeof(ru));
+		{
+			boost::mutex::scoped_lock lock(pidMutex);
+			while (wait4(child, &status, 0, &ru) < 0 && errno == EINTR);
+			pid = 0;
+		}
+		usage.wallSeconds = (Profiler::NowMicros() - startMicros) / 1e6;
+		usage.userSeconds = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+		usage.sysSeconds = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+		usage.maxRssKb = ru.ru_maxrss;
+		if (!haveIo) {
+			usage.readBytes = ru.ru_inblock * 512LL;
+			usage.writeBytes = ru.ru_oublock * 512LL;
+		}
+
+		if (WIFSIGNALED(status)) {
+			call.signal = WTERMSIG(status);
+			call.exit_code = 128 + call.signal;
+		}
+		else {
+			call.exit_code = WEXITSTATUS(status);
+		}
+		call.output = out.Str();
+		call.error = err.Str();
+		Profiler::Record(Profiler::GetCommandName(cmd), "command", startMicros,
+			usage, cmd);
+		return call;
+	}
+}
@@ -0,0 +1,288 @@
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+#include "Profiler.h"
+
+namespace MOJO
+{
+	typedef std::chrono::steady_clock Clock;
+
+	static const Clock::time_point runStart = Clock::now();
+
+	boost::mutex Profiler::eventsMutex;
+	vector<ProfileEvent> Profiler::events;
+	set<ProfileStage *> Profiler::openStages;
+
+	int64_t Profiler::NowMicros()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - runStart).count();
+	}
+
+	int Profiler::GetThreadNumber()
+	{
+		static boost::mutex threadsMutex;
+		static map<boost::thread::id, int> threadNumbers;
+		boost::mutex::scoped_lock lock(threadsMutex);
+		auto it = threadNumbers.find(boost::this_thread::get_id());
+		if (it != threadNumbers.end())
+			return it->second;
+		int n = (int)threadNumbers.size() + 1;
+		threadNumbers[boost::this_thread::get_id()] = n;
+		return n;
+	}
+
+	void Profiler::Record(string name, string category, int64_t startMicros,
+		const ResourceUsage &usage, string detail)
+	{
+		ProfileEvent e;
+		e.name = name;
+		e.category = category;
+		e.detail = detail;
+		e.startMicros = startMicros;
+		e.threadNumber = GetThreadNumber();
+		e.usage = usage;
+		boost::mutex::scoped_lock lock(eventsMutex);
+		events.push_back(e);
+	}
+
+	string Profiler::GetCommandName(const string &cmd)
+	{
+		//Scripts such as the fastq fan-out create their fifos first and run
+		//the tool in a subshell, as in "rm ...\nmkfifo ...\n(st=0; tool ..."
+		static const set<string> setupCommands = { "rm", "mkfifo", "ln",
+			"mkdir", "sleep", "cd", "set" };
+		string first;
+		size_t pos = 0;
+		while (pos < cmd.size()) {
+			size_t end = cmd.find_first_of("\n;", pos);
+			if (end == string::npos)
+				end = cmd.size();
+			istringstream ss(cmd.substr(pos, end - pos));
+			pos = end + 1;
+
+			string tool, sub;
+			while (ss >> tool) {
+				tool.erase(0, tool.find_first_not_of('('));
+				size_t eq = tool.find('=');
+				if (!tool.empty() && (eq == string::npos || tool.find('/') < eq))
+					break;
+				tool.clear();
+			}
+			if (tool.empty())
+				continue;
+			ss >> sub;
+			tool = tool.substr(tool.find_last_of('/') + 1);
+			//subcommands, as in "bwa sampe" or "samtools sort"
+			if (!sub.empty() && std::all_of(sub.begin(), sub.end(),
+				[](char ch) { return ch >= 'a' && ch <= 'z'; }))
+				tool += " " + sub;
+			if (setupCommands.find(tool.substr(0, tool.find(' '))) ==
+				setupCommands.end())
+				return tool;
+			if (first.empty())
+				first = tool;
+		}
+		return first;
+	}
+
+	void Profiler::SampleMemory(long rssKb)
+	{
+		boost::mutex::scoped_lock lock(eventsMutex);
+		for (auto stage : openStages)
+			stage->peakRssKb = max(stage->peakRssKb, rssKb);
+	}
+
+	bool Profiler::ReadIoCounters(string ioFile, long long *readBytes,
+		long long *writeBytes)
+	{
+		ifstream io(ioFile.c_str());
+		if (!io.is_open())
+			return false;
+		int found = 0;
+		string key;
+		long long value;
+		while (io >> key >> value) {
+			if (key == "rchar:") { *readBytes = value; found++; }
+			else if (key == "wchar:") { *writeBytes = value; found++; }
+		}
+		return found == 2;
+	}
+
+	static string JsonEscape(const string &s)
+	{
+		string out;
+		for (char ch : s) {
+			switch (ch) {
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\n': out += "\\n"; break;
+				case '\t': out += "\\t"; break;
+				default:
+					if ((unsigned char)ch < 0x20) {
+						char buf[8];
+						sprintf(buf, "\\u%04x", ch);
+						out += buf;
+					}
+					else {
+						out += ch;
+					}
+			}
+		}
+		return out;
+	}
+
+	void Profiler::WriteTrace(string file)
+	{
+		boost::mutex::scoped_lock lock(eventsMutex);
+		ofstream out(file.c_str(), ios::out);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+		out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+			<< "\"args\":{\"name\":\"MOJO\"}}";
+		char buf[400];
+		for (auto &e : events) {
+			const ResourceUsage &u = e.usage;
+			sprintf(buf, "\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,"
+				"\"tid\":%d,\"args\":{\"user_s\":%.3f,\"sys_s\":%.3f,"
+				"\"max_rss_mb\":%.1f,\"read_mb\":%.1f,\"write_mb\":%.1f",
+				(long long)e.startMicros, (long long)(u.wallSeconds * 1e6),
+				e.threadNumber, u.userSeconds, u.sysSeconds, u.maxRssKb / 1024.0,
+				u.readBytes / 1048576.0, u.writeBytes / 1048576.0);
+			out << "," << endl << "{\"name\":\"" << JsonEscape(e.name)
+				<< "\",\"cat\":\"" << JsonEscape(e.category) << "\"," << buf;
+			if (!e.detail.empty())
+				out << ",\"detail\":\"" << JsonEscape(e.detail) << "\"";
+			out << "}}";
+		}
+		out << endl << "]}" << endl;
+	}
+
+	void Profiler::WriteSummary(string file)
+	{
+		struct Row
+		{
+			string category, name;
+			int count;
+			ResourceUsage total;
+		};
+		vector<Row> rows;
+		map<string, size_t> rowIndex;
+		{
+			boost::mutex::scoped_lock lock(eventsMutex);
+			for (auto &e : events) {
+				//splits of the same stage share a row: "x.split.3" -> "x.split"
+				string name = e.name;
+				size_t dot = name.find_last_of('.');
+				if (dot != string::npos && dot + 1 < name.size() &&
+					name.find_first_not_of("0123456789", dot + 1) == string::npos)
+					name = name.substr(0, dot);
+				string key = e.category + "\t" + name;
+				if (rowIndex.find(key) == rowIndex.end()) {
+					rowIndex[key] = rows.size();
+					Row r;
+					r.category = e.category;
+					r.name = name;
+					r.count = 0;
+					rows.push_back(r);
+				}
+				Row &r = rows[rowIndex[key]];
+				r.count++;
+				r.total.wallSeconds += e.usage.wallSeconds;
+				r.total.userSeconds += e.usage.userSeconds;
+				r.total.sysSeconds += e.usage.sysSeconds;
+				r.total.maxRssKb = max(r.total.maxRssKb, e.usage.maxRssKb);
+				r.total.readBytes += e.usage.readBytes;
+				r.total.writeBytes += e.usage.writeBytes;
+			}
+		}
+		//stages first, then scheduler tasks, then external commands
+		auto rank = [](const string &category) {
+			return category == "stage" ? 0 : category == "task" ? 1 :
+				category == "command" ? 2 : 3;
+		};
+		std::stable_sort(rows.begin(), rows.end(), [&](const Row &a, const Row &b) {
+			if (rank(a.category) != rank(b.category))
+				return rank(a.category) < rank(b.category);
+			return a.total.wallSeconds > b.total.wallSeconds;
+		});
+
+		FILE *fp = fopen(file.c_str(), "w");
+		if (fp == NULL)
+			return;
+		fprintf(fp, "%-8s %-40s %6s %10s %10s %10s %10s %10s %10s\n", "type",
+			"name", "count", "wall(s)", "user(s)", "sys(s)", "maxRSS(MB)",
+			"read(MB)", "write(MB)");
+		for (auto &r : rows) {
+			fprintf(fp, "%-8s %-40s %6d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+				r.category.c_str(), r.name.c_str(), r.count, r.total.wallSeconds,
+				r.total.userSeconds, r.total.sysSeconds, r.total.maxRssKb / 1024.0,
+				r.total.readBytes / 1048576.0, r.total.writeBytes / 1048576.0);
+		}
+		fclose(fp);
+	}
+
+	ProfileStage::ProfileStage(string name, string category, bool perThread) :
+		name(name), category(category), perThread(perThread)
+	{
+		startMicros = Profiler::NowMicros();
+		Sample(&startUser, &startSys, &startRead, &startWrite);
+		//ru_maxrss is the peak of the whole run, not of the stage
+		peakRssKb = GetOwnRssKb();
+		boost::mutex::scoped_lock lock(Profiler::eventsMutex);
+		Profiler::openStages.insert(this);
+	}
+
+	long ProfileStage::GetOwnRssKb()
+	{
+		ifstream statm("/proc/self/statm");
+		long pages = 0, residentPages = 0;
+		statm >> pages >> residentPages;
+		return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+	}
+
+	void ProfileStage::Sample(double *user, double *sys, long long *readBytes,
+		long long *writeBytes)
+	{
+		struct rusage ru, children;
+		getrusage(perThread ? RUSAGE_THREAD : RUSAGE_SELF, &ru);
+		*user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+		*sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+		//Process-wide stages include the commands they ran, as /proc/self/io
+		//already does
+		if (!perThread) {
+			getrusage(RUSAGE_CHILDREN, &children);
+			*user += children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6;
+			*sys += children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+		}
+		*readBytes = *writeBytes = 0;
+		Profiler::ReadIoCounters(perThread ? "/proc/thread-self/io" :
+			"/proc/self/io", readBytes, writeBytes);
+	}
+
+	ProfileStage::~ProfileStage()
+	{
+		ResourceUsage usage;
+		double user, sys;
+		long long readBytes, writeBytes;
+		Sample(&user, &sys, &readBytes, &writeBytes);
+		long ownRssKb = GetOwnRssKb();
+		{
+			boost::mutex::scoped_lock lock(Profiler::eventsMutex);
+			Profiler::openStages.erase(this);
+			usage.maxRssKb = max(peakRssKb, ownRssKb);
+		}
+		usage.wallSeconds = (Profiler::NowMicros() - startMicros) / 1e6;
+		usage.userSeconds = user - startUser;
+		usage.sysSeconds = sys - startSys;
+		usage.readBytes = max(0LL, readBytes - startRead);
+		usage.writeBytes = max(0LL, writeBytes - startWrite);
+		Profiler::Record(name, category, startMicros, usage);
+	}
+}
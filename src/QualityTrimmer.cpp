@@ -0,0 +1,54 @@
+
+#include "QualityTrimmer.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace MOJO
+{
+	// bwa trims to the position x maximizing sum_{j>=x}(threshold - q[j]).
+	// The suffix sums are accumulated in one backward pass; on ties the
+	// smallest position wins, and only positive sums are considered.
+	int QualityTrimmer::TrimRead(char *quality, size_t length, int threshold,
+		bool toSanger)
+	{
+		int offset = toSanger ? 64 : 33;
+		if (threshold <= 0 || length == 0 ||
+			(int)quality[length - 1] - offset >= threshold)
+		{
+			if (toSanger)
+				ConvertToSanger(quality, length);
+			return (int)length;
+		}
+
+		int sum = 0, maxval = 0, trim_till = 0;
+		for (size_t i = length - 1; i >= 1; i--) {
+			sum += threshold - ((int)quality[i] - offset);
+			if (sum > 0 && sum >= maxval) {
+				maxval = sum;
+				trim_till = (int)i;
+			}
+		}
+		if (toSanger)
+			ConvertToSanger(quality, length);
+
+		if (trim_till < MIN_TRIMMED_LENGTH)
+			return MIN_TRIMMED_LENGTH;
+		return trim_till;
+	}
+
+	void QualityTrimmer::ConvertToSanger(char *quality, size_t length)
+	{
+		size_t i = 0;
+#ifdef __SSE2__
+		const __m128i delta = _mm_set1_epi8(31);
+		for (; i + 16 <= length; i += 16) {
+			__m128i q = _mm_loadu_si128((const __m128i *)(quality + i));
+			_mm_storeu_si128((__m128i *)(quality + i), _mm_sub_epi8(q, delta));
+		}
+#endif
+		for (; i < length; i++)
+			quality[i] = (char)((int)quality[i] - 31);
+	}
+}
@@ -7,58 +7,6 @@ namespace MOJO
 	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
 		(keywords::channel = "Main"));
 	
-	void Read::GetFastqString(char *buf, int rtrim, int ltrim, 
-		bool convertToSanger)
-	{
-		if (ReadName.length() == 0) {
-			sprintf(buf, "\0");
-			return;
-		}
-
-		auto full_read_len = Sequence.length();
-		auto len = full_read_len - (ltrim + rtrim) + 1;
-		if (len < 0) {
-			BOOST_LOG_CHANNEL(logger::get(), "Main") 
-				<< "Too much trimming occurred, readname: " << ReadName 
-				<< ", sequence: " << Sequence << ", ltrim: " << ltrim
-				<< ", rtrim: " << rtrim << ", seqlength: " << Sequence.length();
-			exit(1);
-		}
-
-		const char *orig_seq = Sequence.c_str(), *orig_qual = Quality.c_str();
-		char *seq = new char[len], *qual = new char[len];
-		for (string::size_type i = 0; i < full_read_len; i++)
-			if (i >= ltrim && i < (full_read_len - rtrim)) {
-			seq[i - ltrim] = orig_seq[i];
-			if (convertToSanger)
-				qual[i - ltrim] = (char)((int)orig_qual[i] - 31);
-			else
-				qual[i - ltrim] = orig_qual[i];
-			}
-
-		seq[len - 1] = '\0';
-		qual[len - 1] = '\0';
-
-		sprintf(buf, "@%s\n%s\n+%s\n%s\n\0", ReadName.c_str(), seq,
-			ReadName.c_str(), qual);
-
-		delete[] seq;
-		delete[] qual;
-	}
-
-	void Read::GetFastqSubstring(char *buf, int maxLength, int startAt)
-	{
-		auto read_length = Sequence.length();
-		string::size_type ltrim, rtrim;
-		if (maxLength > read_length)
-			ltrim = 0, rtrim = 0;
-		else if ((startAt + maxLength) > read_length)
-			ltrim = read_length - maxLength, rtrim = 0;
-		else
-			ltrim = startAt, rtrim = read_length - maxLength - startAt;
-		GetFastqString(buf, rtrim, ltrim);
-	}
-
 	string Read::GetTrimmedReadName()
 	{
 		return Read::TrimReadName(ReadName);
@@ -77,6 +25,22 @@ namespace MOJO
 		return read;
 	}
 
+	ReadId Read::ParseReadId(const char *name, size_t length)
+	{
+		const char *p = name, *end = name + length;
+		if (p < end && *p == '@')
+			p++;
+		const char *digits = p;
+		ReadId id = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			id = id * 10 + (*p - '0');
+		if (p == digits || p - digits > 18)
+			return INVALID_READ_ID;
+		if (p < end && *p != '/' && *p != '_' && *p != ' ' && *p != '\t')
+			return INVALID_READ_ID;
+		return id;
+	}
+
 	bool Read::AddAlignment(ReadAlignment newAln)
 	{
 		Gene *newG = ((Gene *)newAln.gene);
@@ -91,6 +55,7 @@ namespace MOJO
 		ReadName = "";
 		Sequence = "";
 		Quality = "";
+		Id = INVALID_READ_ID;
 		alignments.clear();
 	}
 
@@ -99,4 +64,26 @@ namespace MOJO
 		FirstRead.Initialize();
 		SecondRead.Initialize();
 	}
+
+	void ReadIdSet::Insert(ReadId id)
+	{
+		if (id < READ_ID_BASE) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: read id " << id
+				<< " is not a numeric read name assigned at ingest";
+			exit(1);
+		}
+		uint64_t offset = id - READ_ID_BASE;
+		if (offset / 64 >= bits.size())
+			bits.resize(max<size_t>(offset / 64 + 1, bits.size() * 2), 0);
+		bits[offset / 64] |= 1ULL << (offset % 64);
+	}
+
+	bool ReadIdSet::Contains(ReadId id) const
+	{
+		if (id < READ_ID_BASE)
+			return false;
+		uint64_t offset = id - READ_ID_BASE;
+		return offset / 64 < bits.size() && 
+			(bits[offset / 64] >> (offset % 64)) & 1;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,460 @@
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include "ReferenceBundle.h"
+
+using namespace boost;
+
+namespace MOJO
+{
+	static const size_t MAGIC_LENGTH = 8;
+	static const long long FINGERPRINT_SAMPLE_BYTES = 1 << 20;
+
+	static const size_t SECTION_RECORD_SIZE[NUM_BUNDLE_SECTIONS] = {
+		sizeof(BundleGene), sizeof(BundleIsoform), sizeof(BundleExon),
+		sizeof(uint32_t), sizeof(uint32_t), sizeof(BundleHomology),
+		sizeof(BundleRepeat), 1, 1
+	};
+
+	// crc32 of length bytes, in pieces that fit zlib's 32 bit lengths
+	static unsigned long Checksum(unsigned long crc, const char *data,
+		size_t length)
+	{
+		while (length > 0) {
+			uInt n = (uInt)min<size_t>(length, 1 << 30);
+			crc = crc32(crc, (const Bytef *)data, n);
+			data += n;
+			length -= n;
+		}
+		return crc;
+	}
+
+	// Numeric part of a g<id> or e<id> identifier
+	static int ParseId(const string &id)
+	{
+		return stoi(id.substr(1, id.length() - 1));
+	}
+
+	static vector<string> SplitCsv(const string &csv)
+	{
+		auto sp = Utils::SplitToVector(csv, ",");
+		if (!sp.empty() && sp.back() == "")
+			sp.pop_back();
+		return sp;
+	}
+
+	ReferenceBundle::ReferenceBundle() : map(MAP_FAILED), mapLength(0),
+		header(0) {}
+
+	ReferenceBundle::~ReferenceBundle()
+	{
+		Close();
+	}
+
+	void ReferenceBundle::Close()
+	{
+		if (map != MAP_FAILED)
+			munmap(map, mapLength);
+		map = MAP_FAILED, mapLength = 0, header = 0;
+	}
+
+	vector<string> ReferenceBundle::GetSourceFiles(string geneModelDir)
+	{
+		vector<string> sources(NUM_BUNDLE_SOURCES);
+		sources[GENE_SOURCE] = geneModelDir + "/Gene.txt";
+		sources[ISOFORM_SOURCE] = geneModelDir + "/Isoform.txt";
+		sources[EXON_SOURCE] = geneModelDir + "/Exon.txt";
+		sources[MEGABLAST_SOURCE] = geneModelDir + "/gene2gene.megablast.txt";
+		sources[REPEAT_SOURCE] = geneModelDir + "/rmsk.regions.txt";
+		return sources;
+	}
+
+	BundleFingerprint ReferenceBundle::GetFingerprint(string file)
+	{
+		BundleFingerprint fingerprint;
+		memset(&fingerprint, 0, sizeof(fingerprint));
+		fingerprint.size = -1;
+		unsigned long crc;
+		long long size;
+		if (Utils::FileChecksum(file, &crc, &size, FINGERPRINT_SAMPLE_BYTES)) {
+			fingerprint.size = size;
+			fingerprint.checksum = (uint32_t)crc;
+		}
+		return fingerprint;
+	}
+
+	bool ReferenceBundle::CheckReferences(string *error) const
+	{
+		//Strings are read up to their NUL, so the section must end in one
+		uint64_t numStrings = Count(STRINGS_SECTION);
+		if (numStrings > 0 && GetString(0)[numStrings - 1] != '\0') {
+			*error = "unterminated string section";
+			return false;
+		}
+		auto fail = [&](string what) {
+			*error = what + " out of range";
+			return false;
+		};
+
+		unordered_set<int32_t> geneIds;
+		const BundleGene *genes = Genes();
+		for (size_t i = 0; i < Count(GENES_SECTION); i++) {
+			const BundleGene &g = genes[i];
+			if (g.name >= numStrings || g.chr >= numStrings || 
+				g.strand >= numStrings)
+				return fail("gene name");
+			if ((uint64_t)g.firstIsoform + g.numIsoforms > 
+				Count(GENE_ISOFORMS_SECTION))
+				return fail("gene isoforms");
+			geneIds.insert(g.geneId);
+		}
+		const uint32_t *geneIsoforms = GeneIsoforms();
+		for (size_t i = 0; i < Count(GENE_ISOFORMS_SECTION); i++)
+			if (geneIsoforms[i] >= Count(ISOFORMS_SECTION))
+				return fail("isoform index");
+
+		const BundleIsoform *isoforms = Isoforms();
+		for (size_t i = 0; i < Count(ISOFORMS_SECTION); i++) {
+			const BundleIsoform &iso = isoforms[i];
+			if (geneIds.find(iso.geneId) == geneIds.end())
+				return fail("isoform gene");
+			if (iso.isoformId >= numStrings)
+				return fail("isoform name");
+			if ((uint64_t)iso.firstExon + iso.numExons > 
+				Count(ISOFORM_EXONS_SECTION))
+				return fail("isoform exons");
+		}
+		const uint32_t *isoformExons = IsoformExons();
+		for (size_t i = 0; i < Count(ISOFORM_EXONS_SECTION); i++)
+			if (isoformExons[i] >= Count(EXONS_SECTION))
+				return fail("exon index");
+
+		const BundleExon *exons = Exons();
+		for (size_t i = 0; i < Count(EXONS_SECTION); i++) {
+			const BundleExon &ex = exons[i];
+			if (geneIds.find(ex.geneId) == geneIds.end())
+				return fail("exon gene");
+			if (ex.sequence > Count(SEQUENCE_SECTION) || ex.sequenceLength > 
+				Count(SEQUENCE_SECTION) - ex.sequence)
+				return fail("exon sequence");
+		}
+
+		const BundleRepeat *repeats = Repeats();
+		for (size_t i = 0; i < Count(REPEATS_SECTION); i++)
+			if (geneIds.find(repeats[i].geneId) == geneIds.end())
+				return fail("repeat gene");
+		return true;
+	}
+
+	bool ReferenceBundle::Write(string bundleFile,
+		const vector<string> &sources, string *error)
+	{
+		ReferenceBundleHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, REFERENCE_BUNDLE_MAGIC, MAGIC_LENGTH);
+		header.version = REFERENCE_BUNDLE_VERSION;
+		for (int s = 0; s < NUM_BUNDLE_SOURCES; s++)
+			header.sources[s] = GetFingerprint(sources[s]);
+
+		vector<BundleGene> genes;
+		vector<BundleIsoform> isoforms;
+		vector<BundleExon> exons;
+		vector<uint32_t> geneIsoforms, isoformExons;
+		vector<BundleHomology> homology;
+		vector<BundleRepeat> repeats;
+		string strings, sequence;
+
+		unordered_map<string, uint32_t> stringOffsets;
+		auto addString = [&](const string &str) {
+			auto it = stringOffsets.find(str);
+			if (it != stringOffsets.end())
+				return it->second;
+			uint32_t offset = (uint32_t)strings.size();
+			strings.append(str.c_str(), str.size() + 1);
+			stringOffsets[str] = offset;
+			return offset;
+		};
+
+		// as in the text loader, a later line replaces an earlier one with
+		// the same id
+		unordered_set<int> geneIds;
+		unordered_map<string, uint32_t> isoformIndex;
+		unordered_map<int, uint32_t> exonIndex;
+		vector< vector<string> > geneIsoformIds, isoformExonIds;
+
+		string file, line;
+		auto fail = [&](string reason) {
+			*error = reason + " in " + file + (line.empty() ? "" : ": " + line);
+			return false;
+		};
+		auto openSource = [&](BundleSource source, ifstream &in) {
+			file = sources[source];
+			line = "";
+			in.open(file.c_str());
+			return in.is_open();
+		};
+
+		try {
+			ifstream geneFile;
+			if (!openSource(GENE_SOURCE, geneFile))
+				return fail("Cannot open file");
+			while (getline(geneFile, line)) {
+				auto sp = Utils::SplitToVector(line, "\r\t");
+				if (sp.size() < 9)
+					return fail("Malformed gene");
+				BundleGene g;
+				g.geneId = ParseId(sp[0]);
+				g.name = addString(sp[1]);
+				g.chr = addString(sp[2]);
+				g.strand = addString(sp[3]);
+				g.txStart_genomic = stoi(sp[4]);
+				g.txEnd_genomic = stoi(sp[5]);
+				g.txStart_transcriptomic = stoi(sp[6]);
+				g.txEnd_transcriptomic = stoi(sp[7]);
+				g.firstIsoform = g.numIsoforms = 0;
+				genes.push_back(g);
+				geneIds.insert(g.geneId);
+				geneIsoformIds.push_back(SplitCsv(sp[8]));
+			}
+
+			ifstream isoformFile;
+			if (!openSource(ISOFORM_SOURCE, isoformFile))
+				return fail("Cannot open file");
+			while (getline(isoformFile, line)) {
+				auto sp = Utils::SplitToVector(line, "\r\t");
+				if (sp.size() < 7)
+					return fail("Malformed isoform");
+				BundleIsoform iso;
+				iso.geneId = ParseId(sp[1]);
+				if (geneIds.find(iso.geneId) == geneIds.end())
+					return fail("Unknown gene id " + sp[1]);
+				iso.isoformId = addString(sp[0]);
+				iso.txStart = stoi(sp[2]);
+				iso.txEnd = stoi(sp[3]);
+				iso.cdsStart = stoi(sp[5]);
+				iso.cdsEnd = stoi(sp[6]);
+				iso.firstExon = iso.numExons = 0;
+				isoformIndex[sp[0]] = (uint32_t)isoforms.size();
+				isoforms.push_back(iso);
+				isoformExonIds.push_back(SplitCsv(sp[4]));
+			}
+
+			ifstream exonFile;
+			if (!openSource(EXON_SOURCE, exonFile))
+				return fail("Cannot open file");
+			while (getline(exonFile, line)) {
+				auto sp = Utils::SplitToVector(line, "\r\t");
+				if (sp.size() < 7)
+					return fail("Malformed exon");
+				BundleExon ex;
+				ex.geneId = ParseId(sp[1]);
+				if (geneIds.find(ex.geneId) == geneIds.end())
+					return fail("Unknown gene id " + sp[1]);
+				ex.exonId = ParseId(sp[0]);
+				ex.exStart = stoi(sp[2]);
+				ex.exEnd = stoi(sp[3]);
+				ex.exStart_genomic = stoi(sp[4]);
+				ex.exEnd_genomic = stoi(sp[5]);
+				ex.sequence = sequence.size();
+				ex.sequenceLength = (uint32_t)sp[6].size();
+				ex.reserved = 0;
+				sequence += sp[6];
+				exonIndex[ex.exonId] = (uint32_t)exons.size();
+				exons.push_back(ex);
+			}
+
+			// resolve the isoforms of each gene and the exons of each isoform
+			line = "";
+			file = sources[GENE_SOURCE];
+			for (size_t g = 0; g < genes.size(); g++) {
+				genes[g].firstIsoform = (uint32_t)geneIsoforms.size();
+				genes[g].numIsoforms = (uint32_t)geneIsoformIds[g].size();
+				for (auto &id : geneIsoformIds[g]) {
+					auto it = isoformIndex.find(id);
+					if (it == isoformIndex.end())
+						return fail("Unknown isoform id " + id);
+					geneIsoforms.push_back(it->second);
+				}
+			}
+			file = sources[ISOFORM_SOURCE];
+			for (size_t i = 0; i < isoforms.size(); i++) {
+				isoforms[i].firstExon = (uint32_t)isoformExons.size();
+				isoforms[i].numExons = (uint32_t)isoformExonIds[i].size();
+				for (auto &id : isoformExonIds[i]) {
+					auto it = exonIndex.find(ParseId(id));
+					if (it == exonIndex.end())
+						return fail("Unknown exon id " + id);
+					isoformExons.push_back(it->second);
+				}
+			}
+
+			// megablast hits are compiled after the reference is built, so
+			// the file may not exist yet
+			ifstream megablastFile;
+			if (openSource(MEGABLAST_SOURCE, megablastFile)) {
+				while (getline(megablastFile, line)) {
+					auto sp = Utils::SplitToVector(line, "\t\r");
+					if (sp.size() < 6)
+						return fail("Malformed megablast hit");
+					BundleHomology h;
+					h.geneA = ParseId(sp[0]);
+					h.geneB = ParseId(sp[1]);
+					if (geneIds.find(h.geneA) == geneIds.end() ||
+						geneIds.find(h.geneB) == geneIds.end())
+						return fail("Unknown gene id");
+					h.startA = stoi(sp[2]);
+					h.endA = stoi(sp[3]);
+					h.startB = stoi(sp[4]);
+					h.endB = stoi(sp[5]);
+					homology.push_back(h);
+				}
+			}
+
+			ifstream repeatFile;
+			if (!openSource(REPEAT_SOURCE, repeatFile))
+				return fail("Cannot open file");
+			while (getline(repeatFile, line)) {
+				auto sp = Utils::SplitToVector(line, "\t\r");
+				if (sp.size() < 4)
+					return fail("Malformed repeat");
+				BundleRepeat r;
+				r.geneId = ParseId(sp[0]);
+				// the text loader skips repeats of genes it does not know
+				if (geneIds.find(r.geneId) == geneIds.end())
+					continue;
+				r.start = stoi(sp[2]);
+				r.end = stoi(sp[3]);
+				r.reserved = 0;
+				repeats.push_back(r);
+			}
+		}
+		catch (std::exception &e) {
+			return fail(string("Error: ") + e.what());
+		}
+
+		file = bundleFile;
+		line = "";
+		//Runs sharing a reference may write the bundle at the same time
+		string tmp = bundleFile + ".tmp." + to_string(getpid());
+		FILE *fp = fopen(tmp.c_str(), "wb");
+		if (fp == NULL)
+			return fail("Cannot create file");
+		bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+		uint64_t offset = sizeof(header);
+		unsigned long crc = crc32(0L, Z_NULL, 0);
+		auto writeSection = [&](BundleSectionType type, const void *data,
+			size_t count)
+		{
+			static const char padding[8] = { 0 };
+			size_t pad = (8 - offset % 8) % 8;
+			ok = ok && fwrite(padding, 1, pad, fp) == pad;
+			crc = Checksum(crc, padding, pad);
+			offset += pad;
+			size_t length = count * SECTION_RECORD_SIZE[type];
+			header.sections[type].offset = offset;
+			header.sections[type].count = count;
+			ok = ok && (length == 0 || fwrite(data, 1, length, fp) == length);
+			crc = Checksum(crc, (const char *)data, length);
+			offset += length;
+		};
+		writeSection(GENES_SECTION, genes.data(), genes.size());
+		writeSection(ISOFORMS_SECTION, isoforms.data(), isoforms.size());
+		writeSection(EXONS_SECTION, exons.data(), exons.size());
+		writeSection(GENE_ISOFORMS_SECTION, geneIsoforms.data(),
+			geneIsoforms.size());
+		writeSection(ISOFORM_EXONS_SECTION, isoformExons.data(),
+			isoformExons.size());
+		writeSection(HOMOLOGY_SECTION, homology.data(), homology.size());
+		writeSection(REPEATS_SECTION, repeats.data(), repeats.size());
+		writeSection(STRINGS_SECTION, strings.data(), strings.size());
+		writeSection(SEQUENCE_SECTION, sequence.data(), sequence.size());
+		header.checksum = (uint32_t)crc;
+		header.fileSize = offset;
+
+		ok = ok && fseeko(fp, 0, SEEK_SET) == 0 &&
+			fwrite(&header, sizeof(header), 1, fp) == 1;
+		ok = (fclose(fp) == 0) && ok;
+		if (!ok || rename(tmp.c_str(), bundleFile.c_str()) != 0) {
+			remove(tmp.c_str());
+			return fail("Cannot write file");
+		}
+		return true;
+	}
+
+	bool ReferenceBundle::Open(string bundleFile,
+		const vector<string> &sources, string *error, bool verifyChecksum)
+	{
+		Close();
+		fileName = bundleFile;
+		int fd = open(bundleFile.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd < 0 || fstat(fd, &st) != 0) {
+			if (fd >= 0)
+				close(fd);
+			*error = "cannot open file";
+			return false;
+		}
+		mapLength = st.st_size;
+		if (mapLength >= sizeof(ReferenceBundleHeader))
+			map = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED) {
+			*error = "not a reference bundle or truncated";
+			return false;
+		}
+		header = (const ReferenceBundleHeader *)map;
+		if (memcmp(header->magic, REFERENCE_BUNDLE_MAGIC, MAGIC_LENGTH) != 0 ||
+			header->fileSize != mapLength)
+		{
+			*error = "not a reference bundle or truncated";
+			return false;
+		}
+		if (header->version != REFERENCE_BUNDLE_VERSION) {
+			*error = "built with bundle version " +
+				to_string(header->version) + ", expected " +
+				to_string(REFERENCE_BUNDLE_VERSION);
+			return false;
+		}
+		for (int s = 0; s < NUM_BUNDLE_SECTIONS; s++) {
+			const BundleSection &section = header->sections[s];
+			if (section.offset % 8 != 0 || section.offset > mapLength ||
+				section.count > (mapLength - section.offset) /
+					SECTION_RECORD_SIZE[s])
+			{
+				*error = "section " + to_string(s) + " is out of bounds";
+				return false;
+			}
+		}
+		if (verifyChecksum) {
+			unsigned long crc = Checksum(crc32(0L, Z_NULL, 0),
+				(const char *)map + sizeof(ReferenceBundleHeader),
+				mapLength - sizeof(ReferenceBundleHeader));
+			if ((uint32_t)crc != header->checksum) {
+				*error = "checksum mismatch";
+				return false;
+			}
+		}
+		if (!CheckReferences(error))
+			return false;
+		for (int s = 0; s < NUM_BUNDLE_SOURCES; s++) {
+			BundleFingerprint fingerprint = GetFingerprint(sources[s]);
+			if (fingerprint.size != header->sources[s].size ||
+				fingerprint.checksum != header->sources[s].checksum)
+			{
+				*error = sources[s] + " has changed since the bundle was built";
+				return false;
+			}
+		}
+		return true;
+	}
+}
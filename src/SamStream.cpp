@@ -0,0 +1,169 @@
+
+#include <cstring>
+
+#include "SamStream.h"
+#include "ProcessRunner.h"
+
+namespace MOJO
+{
+	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
+		(keywords::channel = "Main"));
+
+	static int ParseLeadingInt(const char *p, const char *end)
+	{
+		if (p >= end || *p < '0' || *p > '9')
+			return -1;
+		long v = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			v = v * 10 + (*p - '0');
+		return (int)v;
+	}
+
+	ReadId SamRecord::GetReadId() const
+	{
+		return Read::ParseReadId(qname.data(), qname.size());
+	}
+
+	int SamRecord::GetRefNumber(int prefixLength) const
+	{
+		if ((int)rname.size() <= prefixLength)
+			return -1;
+		return ParseLeadingInt(rname.data() + prefixLength,
+			rname.data() + rname.size());
+	}
+
+	bool SamRecord::GetTag(const char *tag, boost::string_ref *value) const
+	{
+		const char *p = tags.data(), *end = tags.data() + tags.size();
+		while (p < end) {
+			const char *next = (const char *)memchr(p, '\t', end - p);
+			if (next == 0)
+				next = end;
+			if (next - p >= 5 && p[0] == tag[0] && p[1] == tag[1] && p[2] == ':') {
+				*value = boost::string_ref(p + 5, next - p - 5);
+				return true;
+			}
+			p = next + 1;
+		}
+		return false;
+	}
+
+	bool SamStream::Parse(const char *p, const char *end, SamRecord *rec)
+	{
+		if (p == end || p[0] == '@')
+			return false;
+		rec->line = boost::string_ref(p, end - p);
+		const char *fields[12];
+		int nf = 0;
+		fields[nf++] = p;
+		for (; p < end && nf < 12; p++)
+			if (*p == '\t')
+				fields[nf++] = p + 1;
+		if (nf < 6)
+			return false;
+		rec->qname = boost::string_ref(fields[0], fields[1] - fields[0] - 1);
+		rec->rname = boost::string_ref(fields[2], fields[3] - fields[2] - 1);
+		const char *cigarEnd = nf > 6 ? fields[6] - 1 : end;
+		rec->cigar = boost::string_ref(fields[5], cigarEnd - fields[5]);
+		rec->tags = nf == 12 ? boost::string_ref(fields[11], end - fields[11]) :
+			boost::string_ref();
+		rec->flag = atoi(fields[1]);
+		rec->position = atoi(fields[3]);
+		rec->mapq = atoi(fields[4]);
+		return true;
+	}
+
+	static void ParseLine(const char *p, const char *end, SamRecord *rec,
+		const SamStream::RecordCallback &onRecord,
+		const SamStream::HeaderCallback &onHeader)
+	{
+		if (SamStream::Parse(p, end, rec))
+			onRecord(*rec);
+		else if (onHeader && p != end && p[0] == '@')
+			onHeader(boost::string_ref(p, end - p));
+	}
+
+	SystemCall SamStream::Run(string cmd, string channelName,
+		RecordCallback onRecord, HeaderCallback onHeader)
+	{
+		SamRecord rec;
+		string partial;
+		ProcessRunner runner(cmd);
+		runner.SetStdoutCallback([&](const char *data, size_t length) {
+			const char *p = data, *end = data + length;
+			while (p < end) {
+				const char *nl = (const char *)memchr(p, '\n', end - p);
+				if (nl == 0) {
+					partial.append(p, end - p);
+					break;
+				}
+				if (partial.empty()) {
+					ParseLine(p, nl, &rec, onRecord, onHeader);
+				}
+				else {
+					partial.append(p, nl - p);
+					ParseLine(partial.data(), partial.data() + partial.size(),
+						&rec, onRecord, onHeader);
+					partial.clear();
+				}
+				p = nl + 1;
+			}
+		});
+		SystemCall call = runner.Run();
+		if (!partial.empty())
+			ParseLine(partial.data(), partial.data() + partial.size(), &rec,
+				onRecord, onHeader);
+
+		Utils::LogSystemCall(call, channelName);
+		return call;
+	}
+
+	SystemCall SamStream::Run(string cmd, string channelName,
+		vector<SamHit> *hits, int refPrefixLength)
+	{
+		return Run(cmd, channelName, [&](const SamRecord &r) {
+			if (!r.IsMapped())
+				return;
+			SamHit h;
+			h.readId = r.GetReadId();
+			h.refNumber = r.GetRefNumber(refPrefixLength);
+			h.flag = r.flag;
+			h.position = r.position;
+			hits->push_back(h);
+		});
+	}
+
+	SystemCall SamStream::RunPairs(string cmd, string channelName,
+		PairCallback onPair, HeaderCallback onHeader)
+	{
+		//The first end is held as a copy of its line until its mate arrives
+		string pendingLine;
+		SamRecord pending;
+		bool havePending = false;
+		auto report = [&](const SamRecord *a, const SamRecord *b) {
+			const SamRecord *ends[2] = { 0, 0 };
+			for (const SamRecord *r : { a, b }) {
+				if (r == 0 || !r->IsMapped())
+					continue;
+				ends[(r->flag & 0x80) ? 1 : 0] = r;
+			}
+			if (ends[0] != 0 || ends[1] != 0)
+				onPair(ends[0], ends[1]);
+		};
+		SystemCall call = Run(cmd, channelName, [&](const SamRecord &r) {
+			if (havePending && pending.qname == r.qname) {
+				report(&pending, &r);
+				havePending = false;
+				return;
+			}
+			if (havePending)
+				report(&pending, 0);
+			pendingLine.assign(r.line.data(), r.line.size());
+			havePending = Parse(pendingLine.data(), 
+				pendingLine.data() + pendingLine.size(), &pending);
+		}, onHeader);
+		if (havePending)
+			report(&pending, 0);
+		return call;
+	}
+}
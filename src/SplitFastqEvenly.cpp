@@ -1,160 +1,177 @@
-
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
 
 #include <vector>
+#include <string>
 #include <iostream>
 #include <fstream>
 
-#include <zlib.h>
+#include "GzipReader.h"
+#include "QualityTrimmer.h"
 
 using namespace std;
+using namespace MOJO;
 
-int TrimRead(char* qual, bool toSanger = false);
-int getQual(char c);
 const int MAX_CHARS_LINE = 1000;
-static int quality_offset = 0, quality_threshold = 0;
-
+const int OUTPUT_BUFFER_SIZE = 1 << 20;
+
+// SplitFastqEvenly decodes each input lane exactly once and distributes the
+// reads round-robin across <num_splits> outputs (regular files or named pipes).
+// Read N (0-based, counted across all lanes) is written to split N % num_splits,
+// which is the same assignment StreamNthFastqSplit makes when it is run once
+// per split.  Input files may be plain, gzipped or BGZF-compressed fastqs;
+// BGZF blocks are decompressed in parallel across <threads> threads.
 int main(int argc, char *argv[])
 {
 	cin.sync_with_stdio(false);
-	if (argc < 6) {
-		cout << endl << "SplitFastqEvenly - splits fastq (stdin) into specified number of files" << endl << endl;
-		cout << "  Usage: cat file.fastq | SplitFastqEvenly <num_splits> <end> <output_file> <trim quality> <to_sanger> <readcount_file>" << endl ;
-		cout << "      <num_splits>     - number of splits to create" << endl;
-		cout << "      <end>            - 1/2 to designate which end of the read pair the input file represents" << endl;
-		cout << "      <output_file>    - /outputdir/outputfile_%d.fastq or /outputdir/outputfile_%d.fastq.gz" << endl;
-		cout << "                         if suffix is .gz, output will be compressed" << endl;
-		cout << "                         Note: It is optimal to split to fastq and then compress using pigz" << endl;
-		cout << "      <trim_quality>   - trim 3' ends of reads to <trim_quality> (bwa trimming algorithm)" << endl;
-		cout << "      <to_sanger>      - 1/0  convert to sanger" << endl;
-		cout << "      <readcount_file> - total number of reads is written to <readcount_file> [optional]" << endl << endl;
+	if (argc < 11) {
+		cout << endl << "SplitFastqEvenly - splits fastq(.gz) lanes into specified number of files in a single pass" << endl << endl;
+		cout << "  Usage: SplitFastqEvenly <num_splits> <end> <output_file> <trim_quality> <to_sanger> <numeric_name> <readcount_file> <save_numeric_readname> <threads> <lane1.fastq[.gz]> [<lane2.fastq[.gz]> ...]" << endl;
+		cout << "      <num_splits>             - number of splits to create" << endl;
+		cout << "      <end>                    - 1/2 to designate which end of the read pair the input files represent" << endl;
+		cout << "      <output_file>            - /outputdir/outputfile_%d.fastq; %d is replaced by the split number (0-based)" << endl;
+		cout << "                                 output files can be named pipes (mkfifo); all splits must be consumed concurrently" << endl;
+		cout << "      <trim_quality>           - trim 3' ends of reads to <trim_quality> (bwa trimming algorithm)" << endl;
+		cout << "      <to_sanger>              - 1/0  convert to sanger" << endl;
+		cout << "      <numeric_name>           - 1/0 1: convert read names to integers" << endl;
+		cout << "      <readcount_file>         - total number of reads is written to <readcount_file>" << endl;
+		cout << "                                 Use '-' to skip writing the readcount_file" << endl;
+		cout << "      <save_numeric_readname>  - if <numeric_name> is 1, readname to ID map of each split is written to" << endl;
+		cout << "                                 this file; %d is replaced by the split number (0-based)" << endl;
+		cout << "                                 Use '-' to skip writing the readname_to_id mapping" << endl;
+		cout << "      <threads>                - number of threads used to decompress BGZF input" << endl;
+		cout << "      <lane.fastq[.gz]>        - input fastqs; lanes are read in the order specified" << endl << endl;
 		return 0;
 	}
 
 	int num_splits = atoi(argv[1]);
 	int end = atoi(argv[2]);
+	string output_pattern = std::string(argv[3]);
+
+	int quality_threshold = atoi(argv[4]);
+	bool toSanger = atoi(argv[5]) == 1 ? true : false;
+	bool numericReadName = atoi(argv[6]) == 1 ? true : false;
+
+	string readcount_filename = std::string(argv[7]);
+	string readmap_pattern = std::string(argv[8]);
+	int num_threads = atoi(argv[9]);
+
+	if (num_splits <= 0) {
+		cerr << "Error: <num_splits> must be greater than 0" << endl;
+		return 1;
+	}
+
+	// Readname maps are opened before the split outputs.  Opening a named pipe for
+	// writing blocks until its reader attaches, so these side files are created
+	// up front and never wait on a consumer.
+	vector<ofstream *> readMapFiles(num_splits, (ofstream *)0);
+	if (numericReadName && readmap_pattern != "-") {
+		for (int i = 0; i < num_splits; i++) {
+			char filename[2000];
+			snprintf(filename, sizeof(filename), readmap_pattern.c_str(), i);
+			readMapFiles[i] = new ofstream(filename, ios::out);
+		}
+	}
 
-	//vector<gzFile> gzFileStreams;
-	//for (int i = 0; i < num_splits; i++) {
-	//	char filename[200];
-	//	sprintf(filename, argv[3], i);
-	//	gzFileStreams.push_back(gzopen(filename, "wb"));
-	//}
-	vector <ostream *> outputStreams;
+	vector<FILE *> outputStreams;
 	for (int i = 0; i < num_splits; i++) {
-		char filename[200];
-		sprintf(filename, argv[3], i);
-		outputStreams.push_back(new ofstream(filename, ios::out));
+		char filename[2000];
+		snprintf(filename, sizeof(filename), output_pattern.c_str(), i);
+		FILE *out = fopen(filename, "w");
+		if (out == NULL) {
+			cerr << "Error: cannot open output file: " << filename << endl;
+			return 1;
+		}
+		setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+		outputStreams.push_back(out);
 	}
 
-	quality_threshold = atoi(argv[4]);
-	bool toSanger = atoi(argv[5]) == 1 ? true : false;
-	quality_offset = toSanger ? 64 : 33;
-	string readcount_filename = ((argc > 6) ? std::string(argv[6]) : "");
-
-	char line[MAX_CHARS_LINE], sequence[MAX_CHARS_LINE], quality[MAX_CHARS_LINE];
-	int file_to = 0, read_count = 0, max_read_length = 0, min_read_length = 0;
-
-	while (fgets(line, MAX_CHARS_LINE, stdin)) {
-		char *rd = new char[100];
-		int i = 1;
-		bool propersuffix = false;
-		for (; i < strlen(line) - 1; i++) {
-			if (line[i] == ' ')
-				break;
-			if (line[i] == '/')
-				propersuffix = true;
-			rd[i - 1] = line[i];
+	char tmpline[MAX_CHARS_LINE], readline[MAX_CHARS_LINE];
+	char sequence[MAX_CHARS_LINE], quality[MAX_CHARS_LINE];
+	char rd[MAX_CHARS_LINE];
+	int file_to = 0, max_read_length = 0, min_read_length = 0;
+	long long read_count = 0;
+	for (int lane = 10; lane < argc; lane++) {
+		GzipReader in(argv[lane], num_threads);
+
+		while (in.ReadLine(readline, MAX_CHARS_LINE)) {
+			if (!in.ReadLine(sequence, MAX_CHARS_LINE) ||
+				!in.ReadLine(tmpline, MAX_CHARS_LINE) ||
+				!in.ReadLine(quality, MAX_CHARS_LINE))
+			{
+				cerr << "Error: truncated fastq record in " << argv[lane] << endl;
+				return 1;
+			}
+			read_count++;
+
+			int i = 1;
+			for (; i < strlen(readline) - 1; i++) {
+				if (readline[i] == ' ')
+					break;
+				if (readline[i] == '/')
+					break;
+				rd[i - 1] = readline[i];
+			}
+			rd[i - 1] = '\0';
+			int read_length = strlen(sequence);
+			sequence[read_length - 1] = '\0';
+			quality[read_length - 1] = '\0';
+
+			int trimTo = QualityTrimmer::TrimRead(quality, strlen(quality),
+				quality_threshold, toSanger);
+			sequence[trimTo] = '\0';
+			quality[trimTo] = '\0';
+
+			const char *readname = rd;
+			char numericName[32];
+			if (numericReadName) {
+				snprintf(numericName, sizeof(numericName), "%lld", 100000000 + read_count);
+				readname = numericName;
+				if (readMapFiles[file_to] != 0)
+					(*readMapFiles[file_to]) << readname << "\t" << rd << "\n";
+			}
+			fprintf(outputStreams[file_to], "@%s/%d\n%s\n+%s/%d\n%s\n",
+				readname, end, sequence, readname, end, quality);
+
+			if (++file_to == num_splits)
+				file_to = 0;
+
+			if (read_length > max_read_length)
+				max_read_length = read_length;
+			if (read_length < min_read_length || min_read_length == 0)
+				min_read_length = read_length;
+		}
+		if (in.HasFailed()) {
+			cerr << "Error: " << in.GetError() << endl;
+			return 1;
 		}
-		rd[i - 1] = '\0';
-
-		fgets(sequence, MAX_CHARS_LINE, stdin);
-		int read_length = strlen(sequence);
-		sequence[read_length - 1] = '\0';
-		fgets(line, MAX_CHARS_LINE, stdin);
-		fgets(quality, MAX_CHARS_LINE, stdin);
-		quality[read_length - 1] = '\0';
-
-		int trimTo = TrimRead(quality, toSanger);
-		sequence[trimTo] = '\0';
-		quality[trimTo] = '\0';
-		char buf[1000];
-		if (propersuffix)
-			sprintf(buf, "@%s\n%s\n+%s\n%s\n", rd, sequence, rd, quality);
-		else
-			sprintf(buf, "@%s/%d\n%s\n+%s/%d\n%s\n", rd, end, sequence, rd, end, quality);
-
-		(*outputStreams[file_to]).write(buf, strlen(buf));
-		//gzprintf(gzFileStreams[file_to], buf);
-
-		if (++file_to == num_splits)
-			file_to = 0;
-		delete [] rd;
-
-		read_count++;
-		if (read_length > max_read_length) max_read_length = read_length;
-		if (read_length < min_read_length || min_read_length == 0) min_read_length = read_length;
 	}
 
+	// Side files are completed before the split outputs are closed; consumers
+	// treat EOF on a split as the signal that its readID map is ready to be read
 	for (int i = 0; i < num_splits; i++)
-		(*outputStreams[i]).~ostream();
-		//gzclose(gzFileStreams[i]);
-	
-	if (readcount_filename != "") {
+		if (readMapFiles[i] != 0) {
+			readMapFiles[i]->close();
+			delete readMapFiles[i];
+		}
+
+	if (readcount_filename != "-") {
 		try {
 			ofstream o(readcount_filename, ios::out);
-			o << "Total read count: " << read_count << ", Min read length: " << min_read_length
-				<< ", Max read length: " << max_read_length << endl;
+			o << "Total read count: " << read_count << ", Min read length: "
+				<< min_read_length << ", Max read length: " << max_read_length << endl;
 			o.close();
 		}
 		catch (std::exception &e) {
-			std::cout << "Warning: could not write readcount (" << read_count 
-				<< ") to '" << readcount_filename << "' with error: " << e.what() << endl;
-		}
-
-	}
-
-	return 0;
-}
-
-int TrimRead(char *quality, bool toSanger) {
-	auto read_length = strlen(quality);
-
-	if (quality_threshold <= 0 || getQual(quality[read_length - 1]) >= quality_threshold) {
-		if (toSanger)
-			for (size_t i = 0; i < read_length; i++)
-				quality[i] = (char)((int)quality[i] - 31);
-		return read_length;
-	}
-
-	int cum_quals[500];
-	for (size_t i = 0; i < read_length; i++) {
-		int x = i + 1;
-		cum_quals[x] = 0;
-		for (size_t j = x; j < read_length; j++)
-			cum_quals[x] += quality_threshold - getQual(quality[j]);
-		if (toSanger)
-			quality[i] = (char)((int)quality[i] - 31);
-	}
-
-	int trim_till = 0, maxval = 0;
-	for (size_t i = 0; i < read_length; i++) {
-		if (maxval < cum_quals[i]) {
-			trim_till = i;
-			maxval = cum_quals[i];
+			std::cerr << "Warning: could not write readcount (" << read_count
+				<< ") to '" << readcount_filename << "' with error: "
+				<< e.what() << endl;
 		}
 	}
 
-	if (trim_till < 36)
-		return 36;
-	else
-		return trim_till;
-}
+	for (int i = 0; i < num_splits; i++)
+		fclose(outputStreams[i]);
 
-int getQual(char c) {
-	return ((int)c - quality_offset);
+	return 0;
 }
-
-
@@ -8,12 +8,12 @@
 #include <cstring>
 #include <string>
 
+#include "QualityTrimmer.h"
+
 using namespace std;
+using namespace MOJO;
 
-int TrimRead(char* qual, bool toSanger = false);
-int getQual(char c);
 const int MAX_CHARS_LINE = 1000;
-static int quality_offset = 0, quality_threshold = 0;
 
 int main(int argc, char *argv[])
 {
@@ -38,9 +38,8 @@ int main(int argc, char *argv[])
 	int n_split = atoi(argv[2]); 
 	int end = atoi(argv[3]);
 	
-	quality_threshold = atoi(argv[4]);
+	int quality_threshold = atoi(argv[4]);
 	bool toSanger = atoi(argv[5]) == 1 ? true : false;
-	quality_offset = toSanger ? 64 : 33;
 	bool numericReadName = atoi(argv[6]) == 1 ? true : false;
 
 	string readcount_filename = std::string(argv[7]);
@@ -52,7 +51,8 @@ int main(int argc, char *argv[])
 
 	char tmpline[MAX_CHARS_LINE], readline[MAX_CHARS_LINE];
 	char sequence[MAX_CHARS_LINE], quality[MAX_CHARS_LINE];
-	int read_count = 0, max_read_length = 0, min_read_length = 0;
+	int max_read_length = 0, min_read_length = 0;
+	long long read_count = 0;
 	while (fgets(readline, MAX_CHARS_LINE, stdin)) {
 		fgets(sequence, MAX_CHARS_LINE, stdin);
 		fgets(tmpline, MAX_CHARS_LINE, stdin);
@@ -75,7 +75,8 @@ int main(int argc, char *argv[])
 		sequence[read_length - 1] = '\0';
 		quality[read_length - 1] = '\0';
 
-		int trimTo = TrimRead(quality, toSanger);
+		int trimTo = QualityTrimmer::TrimRead(quality, strlen(quality),
+			quality_threshold, toSanger);
 		sequence[trimTo] = '\0';
 		quality[trimTo] = '\0';
 		char buf[1000];
@@ -113,45 +114,3 @@ int main(int argc, char *argv[])
 	}
 	return 0;
 }
-
-int TrimRead(char *quality, bool toSanger) {
-	auto read_length = strlen(quality);
-
-	if (quality_threshold <= 0 ||
-		getQual(quality[read_length - 1]) >= quality_threshold)
-	{
-		if (toSanger)
-			for (size_t i = 0; i < read_length; i++)
-				quality[i] = (char)((int)quality[i] - 31);
-		return read_length;
-	}
-
-	int cum_quals[500];
-	for (size_t i = 0; i < read_length; i++) {
-		int x = i + 1;
-		cum_quals[x] = 0;
-		for (size_t j = x; j < read_length; j++)
-			cum_quals[x] += quality_threshold - getQual(quality[j]);
-		if (toSanger)
-			quality[i] = (char)((int)quality[i] - 31);
-	}
-
-	int trim_till = 0, maxval = 0;
-	for (size_t i = 0; i < read_length; i++) {
-		if (maxval < cum_quals[i]) {
-			trim_till = i;
-			maxval = cum_quals[i];
-		}
-	}
-
-	if (trim_till < 36)
-		return 36;
-	else
-		return trim_till;
-}
-
-int getQual(char c) {
-	return ((int)c - quality_offset);
-}
-
-
@@ -0,0 +1,121 @@
+
+#include "TaskScheduler.h"
+#include "Logger.h"
+#include "Profiler.h"
+
+namespace MOJO
+{
+	BOOST_LOG_INLINE_GLOBAL_LOGGER_CTOR_ARGS(logger, src::channel_logger_mt< >,
+		(keywords::channel = "Main"));
+
+	TaskScheduler::TaskScheduler(int max_cores, int max_mem) :
+		maxCores(max(1, max_cores)), maxMem(max(1, max_mem))
+	{
+		freeCores = maxCores;
+		freeMem = maxMem;
+	}
+
+	TaskScheduler::~TaskScheduler()
+	{
+		for (auto &task : tasks) {
+			if (task.thread != 0) {
+				task.thread->join();
+				delete task.thread;
+			}
+		}
+	}
+
+	TaskScheduler::TaskId TaskScheduler::AddTask(string name, int cores, int mem,
+		TaskFunction run, vector<TaskId> dependsOn, TaskFunction onComplete)
+	{
+		TaskId id = (TaskId)tasks.size();
+		for (auto dep : dependsOn) {
+			if (dep < 0 || dep >= id) {
+				BOOST_LOG_CHANNEL(logger::get(), "Main") << "Error: task " << name
+					<< " depends on a task that has not been added";
+				exit(1);
+			}
+		}
+		Task task;
+		task.name = name;
+		task.cores = min(max(0, cores), maxCores);
+		task.mem = min(max(0, mem), maxMem);
+		task.run = run;
+		task.onComplete = onComplete;
+		task.dependsOn = dependsOn;
+		task.state = PENDING;
+		task.thread = 0;
+		tasks.push_back(task);
+		return id;
+	}
+
+	bool TaskScheduler::IsReady(const Task &task)
+	{
+		for (auto dep : task.dependsOn)
+			if (tasks[dep].state != DONE)
+				return false;
+		return task.cores <= freeCores && task.mem <= freeMem;
+	}
+
+	void TaskScheduler::Execute(TaskId id)
+	{
+		try {
+			ProfileStage stage(tasks[id].name, "task", true);
+			tasks[id].run();
+		}
+		catch (std::exception &e) {
+			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Exception occurred in "
+				<< "task " << tasks[id].name << ". Terminating run." << endl
+				<< "Exception: " << e.what();
+			exit(1);
+		}
+		boost::mutex::scoped_lock lock(mtx);
+		tasks[id].state = FINISHED;
+		freeCores += tasks[id].cores;
+		freeMem += tasks[id].mem;
+		finished.push_back(id);
+		taskFinished.notify_one();
+	}
+
+	void TaskScheduler::Run()
+	{
+		boost::mutex::scoped_lock lock(mtx);
+		size_t remaining = 0;
+		for (auto &task : tasks)
+			if (task.state != DONE)
+				remaining++;
+
+		while (remaining > 0) {
+			//Dependencies always precede their dependents, so a single pass
+			//in insertion order starts everything that can start now
+			for (TaskId id = 0; id < (TaskId)tasks.size(); id++) {
+				Task &task = tasks[id];
+				if (task.state != PENDING || !IsReady(task))
+					continue;
+				task.state = RUNNING;
+				freeCores -= task.cores;
+				freeMem -= task.mem;
+				task.thread = new boost::thread(&TaskScheduler::Execute, this, id);
+			}
+
+			while (finished.empty())
+				taskFinished.wait(lock);
+
+			while (!finished.empty()) {
+				TaskId id = finished.front();
+				finished.pop_front();
+
+				lock.unlock();
+				tasks[id].thread->join();
+				delete tasks[id].thread;
+				tasks[id].thread = 0;
+				if (tasks[id].onComplete)
+					tasks[id].onComplete();
+				lock.lock();
+
+				tasks[id].state = DONE;
+				remaining--;
+			}
+		}
+	}
+}
@@ -1,9 +1,16 @@
 
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
 #include <cstdio>
+#include <map>
+#include <fstream>
+#include <zlib.h>
 
 #include "Utils.h"
+#include "ProcessRunner.h"
 
 namespace MOJO 
 {
@@ -93,23 +100,21 @@ namespace MOJO
 
 	string Utils::ReverseComplement(string s) 
 	{
-		if (s.length() == 0)
-			return s;
-
-		boost::unordered_map<char, char> comp({ { 'A', 'T' }, { 'T', 'A' },
-		{ 'C', 'G' }, { 'G', 'C' }, { 'N', 'N' }, { 'a', 't' }, { 't', 'a' },
-		{ 'c', 'g' }, { 'g', 'c' }, { 'n', 'n' } });
-
-		const char* linedata = s.c_str();
-		char* new_s = new char[s.length() + 1];
-
-		for (int i = ((int) s.length()) - 1; i >= 0; i--) {
-			new_s[s.length() - i - 1] = comp[linedata[i]];
-		}
-		new_s[s.length()] = '\0';
-
-		string sequence(new_s);
-		delete new_s;
+		static const vector<char> comp = []() {
+			vector<char> table(256, '\0');
+			const char *bases = "ACGTNacgtn", *complements = "TGCANtgcan";
+			for (int i = 0; bases[i] != '\0'; i++)
+				table[(unsigned char)bases[i]] = complements[i];
+			return table;
+		}();
+
+		string sequence(s.rbegin(), s.rend());
+		for (auto &c : sequence)
+			c = comp[(unsigned char)c];
+		//as before, the sequence ends at the first base with no complement
+		size_t stop = sequence.find('\0');
+		if (stop != string::npos)
+			sequence.resize(stop);
 		return sequence;
 	}
 
@@ -131,6 +136,39 @@ namespace MOJO
 		return success;
 	}
 
+	bool Utils::FileChecksum(string file, unsigned long *crc, long long *size,
+		long long sampleBytes)
+	{
+		FILE *fp = fopen(file.c_str(), "rb");
+		if (fp == NULL)
+			return false;
+		fseeko(fp, 0, SEEK_END);
+		*size = ftello(fp);
+		fseeko(fp, 0, SEEK_SET);
+		*crc = crc32(0L, Z_NULL, 0);
+
+		vector<char> buf(1 << 20);
+		bool sampled = sampleBytes > 0 && *size > 2 * sampleBytes;
+		auto checksum = [&](long long length) {
+			while (length > 0) {
+				size_t n = fread(buf.data(), 1, 
+					(size_t)min<long long>(buf.size(), length), fp);
+				if (n == 0)
+					break;
+				*crc = crc32(*crc, (Bytef *)buf.data(), n);
+				length -= n;
+			}
+		};
+		checksum(sampled ? sampleBytes : *size);
+		if (sampled) {
+			fseeko(fp, *size - sampleBytes, SEEK_SET);
+			checksum(sampleBytes);
+		}
+		bool ok = !ferror(fp);
+		fclose(fp);
+		return ok;
+	}
+
 	bool Utils::DeleteFile(string file) { 
 		string cmdStr = ("rm -rf " + file);
 		auto result = Utils::ExecuteCommand(cmdStr.c_str(), "Main", true);
@@ -150,73 +188,34 @@ namespace MOJO
 		return stoi(call.output);
 	}
 
-	SystemCall Utils::ExecuteCommand(const char* cmd, string channelName,
-		bool doPrintErrors, bool exitOnFail) 
+	void Utils::LogSystemCall(const SystemCall &call, string channelName,
+		bool doPrintErrors)
 	{
-		char *buf = Utils::StringCopy(cmd);
-		SystemCall call = ExecuteCommand(buf, channelName, doPrintErrors);
-		delete[] buf;
-		return call;
-	}
-
-	SystemCall Utils::ExecuteCommand(char* cmd, string channelName, 
-		bool doPrintErrors, bool exitOnFail ) 
-	{
-		/// SEE: http://stackoverflow.com/questions/15058876/how-to-capture-the-exit-code-and-stderr-of-the-command-that-is-run-in-c
-		/// To capture stderr, use three pipes, see: http://jineshkj.wordpress.com/2006/12/22/how-to-capture-stdin-stdout-and-stderr-of-child-program/
-		char bufcmd[50000];
-		sprintf(bufcmd, 
-			"exec bash -c \"set -e; set -o pipefail; (%s) 2>&1\"", cmd);
-
-	#ifdef _WIN32
-		FILE* pipe = _popen(bufcmd, "r");
-	#else
-		FILE* pipe = popen(bufcmd, "r");
-	#endif
-		if (!pipe) {
-			BOOST_LOG_CHANNEL(logger::get(), "Main") 
-				<< "Error: cannot execute shell command (popen failed)" 
-				<< endl << "Command: " << bufcmd;
-			exit(1);
-		}
-		char buffer[128];
-		stringstream ss;
-		while(!feof(pipe)) {
-			if (fgets(buffer, 128, pipe) != NULL)
-				ss << buffer;
-		}
-		int status = -1, exit_code = -1;
-	#ifdef _WIN32
-		_pclose(pipe);
-		return SystemCall(std::string(bufcmd), ss.str(), exit_code);
-	#else
-		status = pclose(pipe);
-		exit_code = WEXITSTATUS(status);
-		SystemCall call(std::string(bufcmd), ss.str(), exit_code);
-		if ( exit_code != 0 && doPrintErrors ) {
+		if ( call.exit_code != 0 && doPrintErrors ) {
 			//write to both "Thread" log and "Main" log
 			BOOST_LOG_CHANNEL( logger::get(), "Main") 
 				<< "Execution failed: "<< endl << call;
-			if ( channelName != "Main")
+			if ( channelName != "Main" && channelName != "" )
 				BOOST_LOG_CHANNEL( logger::get(), channelName) 
 					<< "Execution failed: "<< endl << call;
 		}
 		else if ( channelName != "" ) {
 			BOOST_LOG_CHANNEL( logger::get(), channelName + ".cmds") << endl<< call;
 		}
+	}
 
-		if ( exit_code != 0 && exitOnFail ) {
+	SystemCall Utils::ExecuteCommand(const string &cmd, string channelName,
+		bool doPrintErrors, bool exitOnFail, int timeoutSeconds) 
+	{
+		ProcessRunner runner(cmd, timeoutSeconds);
+		SystemCall call = runner.Run();
+		LogSystemCall(call, channelName, doPrintErrors);
+
+		if ( call.exit_code != 0 && exitOnFail ) {
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Failure occurred. Exiting";
 			exit(1);
 		}
-
-		//DEBUG code
-		//if (WIFEXITED(status)) printf("normal termination, exit status = %d, %d\n", WEXITSTATUS(status), status);
-		//else if (WIFSIGNALED(status)) printf("abnormal termination, exit status = %d%s, %d\n", WTERMSIG(status), status);
-		//else if (WIFSTOPPED(status)) printf("execution stopped, signal number = %d\n", WSTOPSIG(status));
-
 		return call;
-	#endif
 	}
 
 	string Utils::GetTimeStamp(string dtFormat) {
@@ -263,147 +262,221 @@ namespace MOJO
 		return sortedFiles;
 	}
 
-	//	grep -i memtotal /proc/meminfo	// "MemTotal:       16535760 kB" in kb
-	//	dmesg | grep Memory				// "Memory: 16525476k/16908288k available ...." in kb
-	//	vmstat -s | grep 'total memory'	// "     16535760  total memory" in kb
-	//	free | grep -i mem				// "Mem:      16535760   14168300....." in kb 
-	double SystemInfo::GetTotalSystemMemory() {
-		double mem = 0;
-		try {
-			boost::match_results<std::string::const_iterator> results;
-			SystemCall call = Utils::ExecuteCommand(
-				"grep -i memtotal /proc/meminfo", "", false);
-			boost::regex_match(call.output, results,
-				boost::regex("MemTotal:[\\s|\\t]+(\\d+)\\s.*"));
-			try{
-				mem = stof(results[1].str()) / (1024 * 1024);
-			}
-			catch (exception &e){
-			}
-			if (mem > 0) return mem;
+	//Limits are read from cgroup v2 (unified hierarchy) or v1 controllers of
+	//this process; a limit set on any ancestor cgroup applies as well.  When
+	//a cgroup namespace hides the path, the mount root is the container's own
+	static string ReadFirstLine(string file)
+	{
+		ifstream in(file.c_str());
+		string line;
+		getline(in, line);
+		return line;
+	}
 
-			call = Utils::ExecuteCommand("dmesg | grep Memory", "", false);
-			boost::regex_match(call.output, results, 
-				boost::regex(".*Memory:\\s+(\\d+)\\w.*"));
-			try{
-				mem = stof(results[1].str()) / (1024 * 1024);
-			}
-			catch (exception &e){
+	static vector<string> GetCgroupDirs(string controller)
+	{
+		string v2Path, v1Path;
+		ifstream cg("/proc/self/cgroup");
+		for (string line; getline(cg, line);) {
+			size_t c1 = line.find(':'), c2 = line.find(':', c1 + 1);
+			if (c1 == string::npos || c2 == string::npos)
+				continue;
+			string controllers = line.substr(c1 + 1, c2 - c1 - 1);
+			string path = line.substr(c2 + 1);
+			if (line.substr(0, c1) == "0" && controllers.empty())
+				v2Path = path;
+			for (auto ctl : Utils::SplitToVector(controllers, ","))
+				if (ctl == controller)
+					v1Path = path;
+		}
+
+		vector<string> roots;
+		string path;
+		if (!v1Path.empty()) {
+			path = v1Path;
+			roots.push_back("/sys/fs/cgroup/" + controller);
+			if (controller == "cpu")
+				roots.push_back("/sys/fs/cgroup/cpu,cpuacct");
+		}
+		else if (!v2Path.empty()) {
+			path = v2Path;
+			roots.push_back("/sys/fs/cgroup");
+		}
+
+		vector<string> dirs;
+		for (auto root : roots) {
+			for (string p = path;; p = p.substr(0, p.find_last_of('/'))) {
+				string dir = root + (p == "/" ? "" : p);
+				if (boost::filesystem::is_directory(dir))
+					dirs.push_back(dir);
+				if (p.empty() || p == "/")
+					break;
 			}
-			if (mem > 0) return mem;
+		}
+		return dirs;
+	}
 
-			call = Utils::ExecuteCommand("vmstat -s | grep 'total memory'", 
-				"", false);
-			boost::regex_match(call.output, results,
-				boost::regex("[\\s|\\t]+(\\d+)[\\s|\\t]+.*"));
+	//Smallest memory limit in bytes and the usage of the cgroup it is set on
+	static bool GetCgroupMemory(double *limit, double *usage)
+	{
+		const double unlimited = (double)(1LL << 60);
+		*limit = unlimited;
+		*usage = 0;
+		for (auto dir : GetCgroupDirs("memory")) {
+			string value = ReadFirstLine(dir + "/memory.max");
+			string current = dir + "/memory.current";
+			if (value.empty()) {
+				value = ReadFirstLine(dir + "/memory.limit_in_bytes");
+				current = dir + "/memory.usage_in_bytes";
+			}
+			if (value.empty() || value == "max")
+				continue;
 			try {
-			mem = stof(results[1].str()) / (1024 * 1024);
+				double l = stod(value);
+				if (l > 0 && l < *limit) {
+					*limit = l;
+					string u = ReadFirstLine(current);
+					*usage = u.empty() ? 0 : stod(u);
+				}
 			}
-			catch (exception &e){
+			catch (exception &e) {
 			}
-			
-			if (mem > 0) return mem;
-
-			call = Utils::ExecuteCommand("free | grep -i mem", "", false);
-			boost::regex_match(call.output, results,
-				boost::regex("Mem:[\\s|\\t]+(\\d+)[\\s|\\t]+.*"));
-			try{
-				mem = stof(results[1].str()) / (1024 * 1024);
+		}
+		return *limit < unlimited;
+	}
+
+	static std::map<string, double> ReadMeminfo()
+	{
+		std::map<string, double> kb;
+		ifstream in("/proc/meminfo");
+		string key, unit;
+		double value;
+		while (in >> key >> value) {
+			kb[key.substr(0, key.size() - 1)] = value;
+			getline(in, unit);
+		}
+		return kb;
+	}
+
+	double SystemInfo::GetCgroupMemoryLimit()
+	{
+		double limit, usage;
+		if (!GetCgroupMemory(&limit, &usage))
+			return 0;
+		return limit / (1024 * 1024 * 1024);
+	}
+
+	double SystemInfo::GetCgroupCpuLimit()
+	{
+		double cpus = 0;
+		for (auto dir : GetCgroupDirs("cpu")) {
+			double quota = -1, period = 0;
+			try {
+				auto sp = Utils::SplitToVector(ReadFirstLine(dir + "/cpu.max"), " ");
+				if (sp.size() == 2 && sp[0] != "max") {
+					quota = stod(sp[0]);
+					period = stod(sp[1]);
+				}
+				else if (sp.empty() || sp[0] == "") {
+					string q = ReadFirstLine(dir + "/cpu.cfs_quota_us");
+					string p = ReadFirstLine(dir + "/cpu.cfs_period_us");
+					if (!q.empty() && !p.empty()) {
+						quota = stod(q);
+						period = stod(p);
+					}
+				}
 			}
-			catch (exception &e){
+			catch (exception &e) {
 			}
-			if (mem > 0) return mem;
+			if (quota > 0 && period > 0 && (cpus == 0 || quota / period < cpus))
+				cpus = quota / period;
 		}
-		catch (std::exception const& e) {
+		return cpus;
+	}
+
+	double SystemInfo::GetTotalSystemMemory() {
+		double mem = ReadMeminfo()["MemTotal"] / (1024 * 1024);
+		double limit = GetCgroupMemoryLimit();
+		if (limit > 0 && (mem <= 0 || limit < mem))
+			mem = limit;
+		if (mem <= 0)
 			BOOST_LOG_CHANNEL(logger::get(), "Main") 
-				<< "Warning: Unable to get system memory. "  << e.what() << endl;
-		}
+				<< "Warning: Unable to get system memory.";
 		return mem;
 	}
 
 	int SystemInfo::GetSystemCpuCount() {
 		int cpus = 0;
-		try {
+		cpu_set_t set;
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+			cpus = CPU_COUNT(&set);
+		if (cpus <= 0)
 			cpus = boost::thread::hardware_concurrency();
-			if (cpus > 0) return cpus;
-
-			boost::match_results<std::string::const_iterator> results;
-			SystemCall call = Utils::ExecuteCommand(
-				"grep --count processor /proc/cpuinfo", "", false);
-			try{
-			cpus = stoi(call.output);
-			}
-			catch (exception &e){
-			}
-			if (cpus > 0) return cpus;
 
-			call = Utils::ExecuteCommand("nproc", "", false);
-			try{
-				cpus = stoi(call.output);
-			}
-			catch (exception &e){
-			}
-			if (cpus > 0) return cpus;
-		}
-		catch (std::exception &e) {
+		double quota = GetCgroupCpuLimit();
+		if (quota > 0)
+			cpus = min(cpus, max(1, (int)quota));
+		if (cpus <= 0)
 			BOOST_LOG_CHANNEL(logger::get(), "Main") << "Warning: Unable to get "
-				<< "cpu count from the system: "  << e.what() << endl;
-		}
+				<< "cpu count from the system";
 		return cpus;
 	}
 
 	double SystemInfo::GetTotalFreeMemory() {
-		double mem = 0;
-		try {
-			boost::match_results<std::string::const_iterator> results;
-			SystemCall call = Utils::ExecuteCommand(
-				"vmstat -s | grep 'free memory'", "", false);
-			boost::regex_match(call.output, results, 
-				boost::regex("[\\s|\\t]+(\\d+)[\\s|\\t]+.*"));
-			try{
-				mem = stof(results[1].str()) / (1024 * 1024);
-			}
-			catch (exception &e){
-			}
-			if (mem > 0) return mem;
-
-			call = Utils::ExecuteCommand("free | grep -i mem", "", false);
-			boost::regex re("Mem:[\\s|\\t]+\\d+[\\s|\\t]+\\d+[\\s|\\t]+(\\d+)[\\s|\\t]+.*");
-			boost::regex_match(call.output, results, re);
-			try{
-				mem = stof(results[1].str()) / (1024 * 1024);
-			}
-			catch (exception &e){
-			}
-			if (mem > 0) return mem;
-		}
-		catch (std::exception const& e) {
-			BOOST_LOG_CHANNEL(logger::get(), "Main") 
-				<< "Warning: Unable to get free memory. " << e.what() << endl;
+		auto meminfo = ReadMeminfo();
+		double mem = meminfo.find("MemAvailable") != meminfo.end() ?
+			meminfo["MemAvailable"] : meminfo["MemFree"];
+		mem /= (1024 * 1024);
+
+		double limit, usage;
+		if (GetCgroupMemory(&limit, &usage)) {
+			double free = max(0.0, limit - usage) / (1024 * 1024 * 1024);
+			if (free < mem)
+				mem = free;
 		}
 		return mem;
 	}
 
-	std::pair<double, double> SystemInfo::GetTotalMemoryUsage(int sid, int pid){
+	std::pair<double, double> SystemInfo::GetTotalMemoryUsage(int pid) {
 		std::pair<double, double> mem (0, 0);
 
-		boost::match_results<std::string::const_iterator> results;
-		string padRe = "[\\s|\\t|\\n|\\r]*";
-		boost::regex re(padRe + "(\\d+)" + padRe + "(\\d+)" + padRe + "(\\d+)" + padRe);
-	
-		SystemCall call = Utils::ExecuteCommand(("ps -o vsize=,pid=,ppid= --sid=" + 
-			boost::lexical_cast<string>(sid)).c_str());
-		if (call.exit_code == 0) {
-			for (auto str : Utils::SplitToVector(call.output, "\n")) {
-				if (str == "")
-					continue;
-				boost::regex_match(str, results, re);
-				double mem_ = stof(results[1].str()) / (1024 * 1024);
-				mem.first += mem_;
-
-				if (stoi(results[2].str()) == pid || stoi(results[3].str()) == pid)
-					mem.second += mem_;
+		//RSS and parent of every process, from /proc/<pid>/stat
+		boost::unordered_map<int, vector<int> > children;
+		boost::unordered_map<int, double> rss;
+		double pageSize = (double)sysconf(_SC_PAGESIZE);
+		DIR *proc = opendir("/proc");
+		if (proc == NULL)
+			return mem;
+		for (struct dirent *e; (e = readdir(proc)) != NULL;) {
+			if (e->d_name[0] < '0' || e->d_name[0] > '9')
+				continue;
+			string stat = ReadFirstLine(string("/proc/") + e->d_name + "/stat");
+			size_t commEnd = stat.rfind(')');
+			if (commEnd == string::npos)
+				continue;
+			//fields after the command name: state ppid ... rss is the 22nd
+			istringstream ss(stat.substr(commEnd + 2));
+			string field;
+			int ppid = 0;
+			long long pages = 0;
+			for (int f = 0; f < 22 && ss >> field; f++) {
+				if (f == 1) ppid = atoi(field.c_str());
+				if (f == 21) pages = atoll(field.c_str());
 			}
+			int p = atoi(e->d_name);
+			rss[p] = pages * pageSize / (1024 * 1024 * 1024);
+			children[ppid].push_back(p);
+		}
+		closedir(proc);
+
+		mem.second = rss[pid];
+		vector<int> tree{ pid };
+		while (!tree.empty()) {
+			int p = tree.back();
+			tree.pop_back();
+			mem.first += rss[p];
+			for (auto c : children[p])
+				tree.push_back(c);
 		}
 		return mem;
 	}